@@ -0,0 +1,388 @@
+// Compile-time cost benchmark for the constexpr front end.
+//
+// Generates scripts of increasing size, embeds each one into a translation unit
+// that runs `korka::lex`, `korka::parse` or `korka::compile` on it and feeds the
+// unit to every requested C++ compiler. For each point it records wall time,
+// peak compiler memory and, optionally, the smallest constexpr step/depth limits
+// the compiler needs to get through it.
+//
+// Usage:
+//   korka_compile_bench [--cxx <compiler>]... [--axis functions|statements|depth]...
+//                       [--sizes 1,2,4,...] [--limits] [--runs N] [--work-dir <dir>]
+//
+// Output is CSV on stdout, one row per (compiler, axis, size, stage).
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef KORKA_SOURCE_DIR
+#error "KORKA_SOURCE_DIR must point at the repository root"
+#endif
+
+#ifndef KORKA_BENCH_DEFAULT_CXX
+#define KORKA_BENCH_DEFAULT_CXX "c++"
+#endif
+
+namespace korka::bench {
+  enum class stage {
+    headers, // includes only, the baseline every other stage pays for
+    lex,
+    parse,
+    compile
+  };
+
+  constexpr auto stage_name(stage s) -> std::string_view {
+    switch (s) {
+      case stage::headers:
+        return "headers";
+      case stage::lex:
+        return "lex";
+      case stage::parse:
+        return "parse";
+      case stage::compile:
+        return "compile";
+    }
+    return "?";
+  }
+
+  enum class axis {
+    functions,
+    statements,
+    depth
+  };
+
+  constexpr auto axis_name(axis a) -> std::string_view {
+    switch (a) {
+      case axis::functions:
+        return "functions";
+      case axis::statements:
+        return "statements";
+      case axis::depth:
+        return "depth";
+    }
+    return "?";
+  }
+
+  struct script_shape {
+    std::size_t functions = 1;
+    std::size_t statements = 4;
+    std::size_t depth = 2;
+  };
+
+  // --- Script generation ---
+
+  // Nested expression of the given depth, only uses what the compiler accepts today
+  auto make_expression(std::size_t depth, std::size_t salt) -> std::string {
+    if (depth == 0) {
+      return (salt % 2 == 0) ? "a" : "b";
+    }
+
+    constexpr std::string_view ops[] = {" + ", " - ", " * "};
+    auto inner = make_expression(depth - 1, salt + 1);
+    return std::format("({}{}{})", inner, ops[(depth + salt) % std::size(ops)], salt % 7 + 1);
+  }
+
+  auto make_script(const script_shape &shape) -> std::string {
+    std::string out;
+    for (std::size_t f = 0; f < shape.functions; ++f) {
+      out += std::format("int f{}(int a, int b) {{\n", f);
+      for (std::size_t s = 0; s < shape.statements; ++s) {
+        out += std::format("  int v{} = {};\n", s, make_expression(shape.depth, f + s));
+      }
+      if (shape.statements == 0) {
+        out += "  return a;\n";
+      } else {
+        out += std::format("  return v{};\n", shape.statements - 1);
+      }
+      out += "}\n\n";
+    }
+    return out;
+  }
+
+  auto make_translation_unit(std::string_view script, stage s) -> std::string {
+    std::string out;
+    out += "#include \"korka/compiler/parser.hpp\"\n";
+    out += "#include \"korka/compiler/compiler.hpp\"\n\n";
+    out += std::format("constexpr char code[] = R\"korka({})korka\";\n\n", script);
+
+    switch (s) {
+      case stage::headers:
+        break;
+      case stage::lex:
+        out += "constexpr auto result = korka::lex<code>();\n";
+        break;
+      case stage::parse:
+        out += "constexpr auto result = korka::parse<code>();\n";
+        break;
+      case stage::compile:
+        out += "constexpr auto result = korka::compile<code>();\n";
+        break;
+    }
+    out += "\nint main() {}\n";
+    return out;
+  }
+
+  // --- Compiler invocation ---
+
+  enum class compiler_family {
+    gcc,
+    clang
+  };
+
+  struct compiler_info {
+    std::string path;
+    compiler_family family;
+  };
+
+  struct run_result {
+    bool ok;
+    double wall_ms;
+    long peak_rss_kb;
+  };
+
+  auto run_process(const std::vector<std::string> &argv) -> run_result {
+    std::vector<char *> c_argv;
+    for (auto &a: argv) c_argv.push_back(const_cast<char *>(a.c_str()));
+    c_argv.push_back(nullptr);
+
+    auto begin = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+      return {false, 0, 0};
+    }
+    if (pid == 0) {
+      // Compiler diagnostics would drown the CSV, failures are reported as rows
+      int null_fd = open("/dev/null", O_WRONLY);
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+      execvp(c_argv[0], c_argv.data());
+      _exit(127);
+    }
+
+    int status{};
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    auto end = std::chrono::steady_clock::now();
+
+    return {
+      WIFEXITED(status) && WEXITSTATUS(status) == 0,
+      std::chrono::duration<double, std::milli>(end - begin).count(),
+      usage.ru_maxrss
+    };
+  }
+
+  auto detect_family(const std::string &cxx, const std::filesystem::path &work_dir) -> compiler_family {
+    // `--version` is the only portable way to tell them apart, clang prints its name there
+    auto out_file = work_dir / "version.txt";
+    auto cmd = std::format("\"{}\" --version > \"{}\" 2>&1", cxx, out_file.string());
+    if (std::system(cmd.c_str()) == 0) {
+      std::ifstream in{out_file};
+      std::string text{std::istreambuf_iterator<char>{in}, {}};
+      if (text.find("clang") != std::string::npos) {
+        return compiler_family::clang;
+      }
+    }
+    return compiler_family::gcc;
+  }
+
+  auto steps_flag(compiler_family family, std::uint64_t n) -> std::string {
+    return family == compiler_family::clang
+           ? std::format("-fconstexpr-steps={}", n)
+           : std::format("-fconstexpr-ops-limit={}", n);
+  }
+
+  auto depth_flag(std::uint64_t n) -> std::string {
+    return std::format("-fconstexpr-depth={}", n);
+  }
+
+  // Limits are raised far above the defaults, so only the probed one can fail
+  constexpr std::uint64_t relaxed_steps = std::uint64_t{1} << 40;
+  constexpr std::uint64_t relaxed_depth = 1 << 16;
+
+  auto compile_unit(const compiler_info &cxx, const std::filesystem::path &unit,
+                    std::uint64_t steps, std::uint64_t depth) -> run_result {
+    return run_process({
+      cxx.path,
+      "-std=c++23",
+      "-fsyntax-only",
+      std::format("-I{}/include", KORKA_SOURCE_DIR),
+      std::format("-I{}/3party", KORKA_SOURCE_DIR),
+      steps_flag(cxx.family, steps),
+      depth_flag(depth),
+      unit.string()
+    });
+  }
+
+  // Smallest value in [1, hi] for which the unit still compiles
+  auto find_min_limit(std::uint64_t hi, auto &&compiles) -> std::optional<std::uint64_t> {
+    if (not compiles(hi)) {
+      return std::nullopt;
+    }
+
+    std::uint64_t lo = 1;
+    while (lo < hi) {
+      auto mid = lo + (hi - lo) / 2;
+      if (compiles(mid)) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    return lo;
+  }
+
+  // --- Driver ---
+
+  struct options {
+    std::vector<std::string> compilers;
+    std::vector<axis> axes;
+    std::vector<std::size_t> sizes{1, 2, 4, 8, 16, 32};
+    std::size_t runs = 1;
+    bool limits = false;
+    std::filesystem::path work_dir = std::filesystem::temp_directory_path() / "korka_compile_bench";
+  };
+
+  auto parse_sizes(std::string_view list) -> std::vector<std::size_t> {
+    std::vector<std::size_t> sizes;
+    while (not list.empty()) {
+      auto comma = list.find(',');
+      auto item = list.substr(0, comma);
+      std::size_t value{};
+      if (std::from_chars(item.data(), item.data() + item.size(), value).ec == std::errc{}) {
+        sizes.push_back(value);
+      }
+      if (comma == std::string_view::npos) break;
+      list.remove_prefix(comma + 1);
+    }
+    return sizes;
+  }
+
+  auto parse_options(int argc, char **argv) -> std::optional<options> {
+    options opts;
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      auto has_value = i + 1 < argc;
+
+      if (arg == "--cxx" and has_value) {
+        opts.compilers.emplace_back(argv[++i]);
+      } else if (arg == "--axis" and has_value) {
+        std::string_view value = argv[++i];
+        if (value == "functions") opts.axes.push_back(axis::functions);
+        else if (value == "statements") opts.axes.push_back(axis::statements);
+        else if (value == "depth") opts.axes.push_back(axis::depth);
+        else return std::nullopt;
+      } else if (arg == "--sizes" and has_value) {
+        opts.sizes = parse_sizes(argv[++i]);
+      } else if (arg == "--runs" and has_value) {
+        auto runs = parse_sizes(argv[++i]);
+        if (runs.empty()) return std::nullopt;
+        opts.runs = std::max<std::size_t>(1, runs.front());
+      } else if (arg == "--work-dir" and has_value) {
+        opts.work_dir = argv[++i];
+      } else if (arg == "--limits") {
+        opts.limits = true;
+      } else {
+        return std::nullopt;
+      }
+    }
+
+    if (opts.compilers.empty()) opts.compilers.emplace_back(KORKA_BENCH_DEFAULT_CXX);
+    if (opts.axes.empty()) opts.axes = {axis::functions, axis::statements, axis::depth};
+    return opts;
+  }
+
+  auto shape_for(axis a, std::size_t size) -> script_shape {
+    script_shape shape;
+    switch (a) {
+      case axis::functions:
+        shape.functions = size;
+        break;
+      case axis::statements:
+        shape.statements = size;
+        break;
+      case axis::depth:
+        shape.depth = size;
+        break;
+    }
+    return shape;
+  }
+
+  auto run(const options &opts) -> int {
+    std::filesystem::create_directories(opts.work_dir);
+
+    std::println("compiler,axis,size,functions,statements,depth,script_bytes,stage,ok,"
+                 "wall_ms,peak_rss_kb,min_constexpr_steps,min_constexpr_depth");
+
+    for (auto &path: opts.compilers) {
+      compiler_info cxx{path, detect_family(path, opts.work_dir)};
+
+      for (auto a: opts.axes) {
+        for (auto size: opts.sizes) {
+          auto shape = shape_for(a, size);
+          auto script = make_script(shape);
+
+          for (auto s: {stage::headers, stage::lex, stage::parse, stage::compile}) {
+            auto unit = opts.work_dir / std::format("{}_{}.cpp", stage_name(s), size);
+            std::ofstream{unit} << make_translation_unit(script, s);
+
+            // Best of N, compiler startup noise only ever adds time
+            run_result best{false, 0, 0};
+            for (std::size_t r = 0; r < opts.runs; ++r) {
+              auto result = compile_unit(cxx, unit, relaxed_steps, relaxed_depth);
+              if (r == 0 or result.wall_ms < best.wall_ms) {
+                best.wall_ms = result.wall_ms;
+                best.ok = result.ok;
+              }
+              best.peak_rss_kb = std::max(best.peak_rss_kb, result.peak_rss_kb);
+            }
+
+            std::string min_steps, min_depth;
+            if (opts.limits and best.ok and s != stage::headers) {
+              auto steps = find_min_limit(relaxed_steps, [&](std::uint64_t n) {
+                return compile_unit(cxx, unit, n, relaxed_depth).ok;
+              });
+              auto depth = find_min_limit(relaxed_depth, [&](std::uint64_t n) {
+                return compile_unit(cxx, unit, relaxed_steps, n).ok;
+              });
+              if (steps) min_steps = std::to_string(*steps);
+              if (depth) min_depth = std::to_string(*depth);
+            }
+
+            std::println("{},{},{},{},{},{},{},{},{},{:.1f},{},{},{}",
+                         cxx.path, axis_name(a), size,
+                         shape.functions, shape.statements, shape.depth, script.size(),
+                         stage_name(s), best.ok ? 1 : 0,
+                         best.wall_ms, best.peak_rss_kb, min_steps, min_depth);
+          }
+        }
+      }
+    }
+    return 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  auto opts = korka::bench::parse_options(argc, argv);
+  if (not opts) {
+    std::println(stderr, "usage: {} [--cxx <compiler>]... [--axis functions|statements|depth]... "
+                         "[--sizes 1,2,4,...] [--runs N] [--limits] [--work-dir <dir>]", argv[0]);
+    return 1;
+  }
+  return korka::bench::run(*opts);
+}
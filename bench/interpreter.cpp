@@ -0,0 +1,226 @@
+// Interpreter throughput benchmark.
+//
+// Compiles a handful of workloads with every instruction encoding, runs each one
+// on the checked and on the verified interpreter loop and reports the time per call
+// next to the code size, so encodings and dispatch changes can be compared.
+// Verified programs are also run as batches of `calls` rows, one row at a time and
+// in groups of 4 and 8 lanes.
+//
+// Usage:
+//   korka_interpreter_bench [--workload <name>]... [--calls N] [--runs N]
+//
+// Output is CSV on stdout, one row per (workload, encoding, loop).
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+
+namespace korka::bench {
+  struct workload {
+    std::string_view name;
+    std::string source;
+    std::string_view function;
+    std::vector<vm::stack_value_t> args;
+  };
+
+  // Straight line arithmetic, dominated by operand fetch and dispatch
+  auto make_arithmetic(std::size_t statements) -> std::string {
+    std::string out = "int arith(int a, int b) {\n  int v0 = a + b;\n";
+    for (std::size_t s = 1; s < statements; ++s) {
+      out += std::format("  int v{} = v{} * {} - b + {};\n", s, s - 1, s % 5 + 2, 100000 + s);
+    }
+    out += std::format("  return v{};\n}}\n", statements - 1);
+    return out;
+  }
+
+  // Nested expressions, most of the time goes into moving operands on and off the stack
+  auto make_expressions(std::size_t statements) -> std::string {
+    std::string out = "int expr(int a, int b) {\n  int v0 = a;\n";
+    for (std::size_t s = 1; s < statements; ++s) {
+      out += std::format("  int v{} = (v{} + a) * (b - (v{} - {}) * (a + (b - {}))) / ({} + b * b);\n",
+                         s, s - 1, s - 1, s % 7 + 1, s % 3, s % 11 + 1);
+    }
+    out += std::format("  return v{};\n}}\n", statements - 1);
+    return out;
+  }
+
+  auto workloads() -> std::vector<workload> {
+    return {
+      {
+        "fib",
+        R"(
+          int fib(int n) {
+            if (n) {
+              if (n - 1) {
+                return fib(n - 1) + fib(n - 2);
+              }
+              return 1;
+            }
+            return 0;
+          }
+        )",
+        "fib", {20}
+      },
+      {"arith", make_arithmetic(200), "arith", {3, 4}},
+      {"expr", make_expressions(200), "expr", {3, 4}},
+    };
+  }
+
+  constexpr auto encoding_name(vm::instruction_encoding e) -> std::string_view {
+    switch (e) {
+      case vm::instruction_encoding::bytes:
+        return "bytes";
+      case vm::instruction_encoding::words:
+        return "words";
+    }
+    return "?";
+  }
+
+  struct options {
+    std::vector<std::string> workloads;
+    std::size_t calls = 200;
+    std::size_t runs = 5;
+  };
+
+  auto parse_count(std::string_view s) -> std::optional<std::size_t> {
+    std::size_t v{};
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (ec != std::errc{} || ptr != s.data() + s.size() || v == 0) return std::nullopt;
+    return v;
+  }
+
+  auto parse_options(int argc, char **argv) -> std::optional<options> {
+    options opts;
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      auto next = [&]() -> std::optional<std::string_view> {
+        if (i + 1 >= argc) return std::nullopt;
+        return argv[++i];
+      };
+
+      if (arg == "--workload") {
+        auto v = next();
+        if (not v) return std::nullopt;
+        opts.workloads.emplace_back(*v);
+      } else if (arg == "--calls" || arg == "--runs") {
+        auto v = next();
+        auto n = v ? parse_count(*v) : std::nullopt;
+        if (not n) return std::nullopt;
+        (arg == "--calls" ? opts.calls : opts.runs) = *n;
+      } else {
+        return std::nullopt;
+      }
+    }
+    return opts;
+  }
+
+  /**
+   * Best of `runs` rounds of `calls` calls, in nanoseconds per call
+   */
+  template<class Program>
+  auto measure(runtime &vm, const Program &program, const workload &w, const options &opts)
+  -> std::optional<double> {
+    double best{};
+    for (std::size_t r = 0; r < opts.runs; ++r) {
+      auto begin = std::chrono::steady_clock::now();
+      for (std::size_t c = 0; c < opts.calls; ++c) {
+        if (not vm.execute(program, w.function, std::span{w.args})) return std::nullopt;
+      }
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+
+      auto per_call = elapsed.count() / static_cast<double>(opts.calls);
+      if (r == 0 || per_call < best) best = per_call;
+    }
+    return best;
+  }
+
+  /**
+   * Best of `runs` batches of `calls` rows, in nanoseconds per row
+   */
+  template<std::size_t Lanes, class Program>
+  auto measure_batch(runtime &vm, const Program &program, const workload &w, const options &opts)
+  -> std::optional<double> {
+    std::vector<std::vector<vm::stack_value_t>> columns;
+    for (auto arg: w.args) columns.emplace_back(opts.calls, arg);
+    std::vector<runtime::column_t> spans(columns.begin(), columns.end());
+    std::vector<vm::stack_value_t> out(opts.calls);
+
+    double best{};
+    for (std::size_t r = 0; r < opts.runs; ++r) {
+      auto begin = std::chrono::steady_clock::now();
+      if (not vm.execute_batch<Lanes>(program, w.function, spans, out)) return std::nullopt;
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+
+      auto per_row = elapsed.count() / static_cast<double>(opts.calls);
+      if (r == 0 || per_row < best) best = per_row;
+    }
+    return best;
+  }
+
+  auto run(const options &opts) -> int {
+    std::println("workload,encoding,loop,code_bytes,constants,result,ns_per_call");
+
+    for (auto &w: workloads()) {
+      if (not opts.workloads.empty() && std::ranges::find(opts.workloads, w.name) == opts.workloads.end()) {
+        continue;
+      }
+
+      for (auto encoding: {vm::instruction_encoding::bytes, vm::instruction_encoding::words}) {
+        auto compiled = compile_runtime(w.source, {.encoding = encoding});
+        if (not compiled) {
+          std::println(stderr, "{}: {}", w.name, to_string(compiled.error()));
+          return 1;
+        }
+
+        auto code_bytes = compiled->code().size();
+        auto constants = compiled->constants().size();
+
+        runtime vm;
+        auto result = vm.execute(*compiled, w.function, std::span{w.args});
+        auto checked = measure(vm, *compiled, w, opts);
+
+        auto verified = vm::verified<program>::make(std::move(*compiled));
+        if (not verified || not result || not checked) {
+          std::println(stderr, "{}: failed to run", w.name);
+          return 1;
+        }
+        auto unchecked = measure(vm, *verified, w, opts);
+        auto batch = measure_batch<1>(vm, *verified, w, opts);
+        auto lanes4 = measure_batch<4>(vm, *verified, w, opts);
+        auto lanes8 = measure_batch<8>(vm, *verified, w, opts);
+        if (not unchecked || not batch || not lanes4 || not lanes8) {
+          std::println(stderr, "{}: failed to run verified", w.name);
+          return 1;
+        }
+
+        for (auto [loop, ns]: {std::pair{"checked", *checked}, std::pair{"verified", *unchecked},
+                               std::pair{"batch", *batch}, std::pair{"lanes4", *lanes4},
+                               std::pair{"lanes8", *lanes8}}) {
+          std::println("{},{},{},{},{},{},{:.1f}", w.name, encoding_name(encoding), loop,
+                       code_bytes, constants, *result, ns);
+        }
+      }
+    }
+    return 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  auto opts = korka::bench::parse_options(argc, argv);
+  if (not opts) {
+    std::println(stderr, "usage: {} [--workload <name>]... [--calls N] [--runs N]", argv[0]);
+    return 1;
+  }
+  return korka::bench::run(*opts);
+}
@@ -67,6 +67,13 @@ struct std::formatter<korka::ast_walker> {
           fmt_child("args", v.args_head);
         }
       },
+      [&](const nodes::expr_index& v) {
+        out = std::format_to(out, "Index '{}'", v.name);
+        fmt_child("index", v.index);
+      },
+      [&](const nodes::expr_field& v) {
+        out = std::format_to(out, "Field '{}.{}'", v.object, v.field);
+      },
       [&](const nodes::stmt_block& v) {
         out = std::format_to(out, "Block");
         if (v.children_head != nodes::empty_node) {
@@ -90,12 +97,16 @@ struct std::formatter<korka::ast_walker> {
         out = std::format_to(out, "Return");
         if (v.expr != nodes::empty_node) fmt_child("val", v.expr);
       },
+      [&](const nodes::stmt_yield& v) {
+        out = std::format_to(out, "Yield");
+        if (v.expr != nodes::empty_node) fmt_child("val", v.expr);
+      },
       [&](const nodes::stmt_expr& v) {
         out = std::format_to(out, "ExprStmt");
         fmt_child("expr", v.expr);
       },
       [&](const nodes::decl_var& v) {
-        out = std::format_to(out, "DeclVar '{} {}'", v.type_name, v.var_name);
+        out = std::format_to(out, "DeclVar '{} {}{}'", v.type_name, v.var_name, v.array ? "[]" : "");
         if (v.init_expr != nodes::empty_node) {
           fmt_child("init", v.init_expr);
         }
@@ -103,7 +114,11 @@ struct std::formatter<korka::ast_walker> {
       [&](const nodes::decl_function& v) {
         out = std::format_to(out, "Function '{} {}'", v.ret_type, v.name);
         if (v.params_head != nodes::empty_node) fmt_child("params", v.params_head);
-        fmt_child("body", v.body);
+        if (v.body != nodes::empty_node) fmt_child("body", v.body);
+      },
+      [&](const nodes::decl_struct& v) {
+        out = std::format_to(out, "Struct '{}'", v.name);
+        if (v.fields_head != nodes::empty_node) fmt_child("fields", v.fields_head);
       },
       [&](const nodes::decl_program& v) {
         out = std::format_to(out, "Program");
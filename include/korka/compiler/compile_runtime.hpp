@@ -0,0 +1,23 @@
+#pragma once
+
+#include <expected>
+#include <span>
+#include <string_view>
+#include "korka/shared/error.hpp"
+#include "korka/vm/program.hpp"
+#include "korka/vm/structs.hpp"
+
+namespace korka {
+  struct compile_options {
+    vm::instruction_encoding encoding{vm::instruction_encoding::bytes};
+    // C++ structs scripts may take, the layouts have to outlive the call
+    std::span<const vm::struct_layout> structs{};
+  };
+
+  /**
+   * Runs the same lexer, parser and compiler as `compile<code>()`, but at runtime.
+   * The program owns everything it needs, `source` may go away afterwards.
+   */
+  auto compile_runtime(std::string_view source, const compile_options &options = {})
+  -> std::expected<program, error_t>;
+}
@@ -4,13 +4,21 @@
 #include "korka/shared/error.hpp"
 #include "korka/shared/flat_map.hpp"
 #include "korka/utils/overloaded.hpp"
+#include "korka/vm/decoder.hpp"
 #include "korka/vm/op_codes.hpp"
 #include "parser.hpp"
 #include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/program.hpp"
+#include "korka/vm/structs.hpp"
 #include "korka/utils/frozen_hash_string_view.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <ranges>
+#include <utility>
 #include <vector>
 #include <optional>
+#include <span>
 #include <string_view>
 
 namespace korka {
@@ -21,6 +29,9 @@ namespace korka {
 
   constexpr auto string_to_type(std::string_view name) -> type {
     if (name == "int") return type::i64;
+    else if (name == "char") return type::i8;
+    else if (name == "double") return type::f64;
+    else if (name == "string") return type::str;
     else if (name == "void") return type::void_;
     // TODO: other types
     return type::i64;
@@ -32,6 +43,18 @@ namespace korka {
         return "void";
       case type::i64:
         return "int";
+      case type::i8:
+        return "char";
+      case type::f64:
+        return "double";
+      case type::i64_array:
+        return "int[]";
+      case type::f64_array:
+        return "double[]";
+      case type::str:
+        return "string";
+      case type::object:
+        return "struct";
     }
   }
 
@@ -39,8 +62,12 @@ namespace korka {
     std::string_view name;
     type_info type;
 
+    // Into the slots, or into the narrow area for narrow types
     std::size_t locals_index;
 
+    // Of the struct an object points to
+    std::string_view struct_name{};
+
     static constexpr auto from_node(const nodes::decl_var &node) -> variable_info {
       return {
         .name = node.var_name,
@@ -56,6 +83,29 @@ namespace korka {
     type_info return_type;
 
     vm::bytecode_builder::label label;
+
+    // Position in the function table, declaration order
+    std::size_t index{};
+    std::size_t locals_count{};
+    std::size_t narrow_size{};
+
+    // Known once the bytecode is built
+    std::size_t offset{};
+    std::size_t size{};
+    std::size_t params_offset{}; // first row in compilation_result::params
+
+    // Deepest operand stack of the function itself, arguments included
+    std::size_t max_stack{};
+
+    // Worst case of the function and everything it calls, only known without recursion
+    bool bounded{};
+    std::size_t total_stack{};
+    std::size_t total_locals{};
+    std::size_t total_narrow{};
+    std::size_t total_frames{};
+
+    // Declared without a body, the host provides it
+    bool native{};
   };
 
   template<std::size_t NMaxParams>
@@ -66,6 +116,19 @@ namespace korka {
     type_info return_type;
 
     vm::bytecode_builder::label label;
+
+    std::size_t index{};
+    std::size_t locals_count{};
+    std::size_t narrow_size{};
+    std::size_t offset{};
+    std::size_t size{};
+
+    std::size_t max_stack{};
+    bool bounded{};
+    std::size_t total_stack{};
+    std::size_t total_locals{};
+    std::size_t total_narrow{};
+    std::size_t total_frames{};
   };
 
   template<auto info_getter>
@@ -96,27 +159,55 @@ namespace korka {
       .param_count = f.params.size(),
       .params{},
       .return_type = f.return_type,
-      .label{}
+      .label{},
+      .index = f.index,
+      .locals_count = f.locals_count,
+      .narrow_size = f.narrow_size,
+      .offset = f.offset,
+      .size = f.size,
+      .max_stack = f.max_stack,
+      .bounded = f.bounded,
+      .total_stack = f.total_stack,
+      .total_locals = f.total_locals,
+      .total_narrow = f.total_narrow,
+      .total_frames = f.total_frames
     };
 
     std::ranges::copy(f.params, std::begin(info.params));
     return info;
   }
 
+  constexpr auto function_info_to_entry(const function_info &f) -> vm::function_entry {
+    return {
+      .offset = static_cast<std::uint32_t>(f.offset),
+      .size = static_cast<std::uint32_t>(f.size),
+      .param_count = static_cast<std::uint16_t>(f.params.size()),
+      .locals_count = static_cast<std::uint16_t>(f.locals_count),
+      .return_type = std::get<type>(f.return_type),
+      .flags = static_cast<std::uint8_t>(f.native ? vm::native_flag : 0),
+      .max_stack = static_cast<std::uint16_t>(std::in_range<std::uint16_t>(f.max_stack) ? f.max_stack : 0),
+      .narrow_size = static_cast<std::uint16_t>(f.narrow_size),
+      .params = static_cast<std::uint32_t>(f.params_offset)
+    };
+  }
+
   struct symbol_table {
     struct scope {
       flat_map<std::string_view, variable_info> variables;
 
       std::size_t current_locals_size{};
+      std::size_t current_narrow_size{};
     };
     std::vector<scope> scopes;
     flat_map<std::string_view, function_info> functions;
+    std::size_t function_count{};
 
     constexpr auto push_scope() -> void { scopes.emplace_back(); }
 
     constexpr auto pop_scope() -> void { scopes.pop_back(); }
 
-    constexpr auto declare_var(std::string_view name, const type_info &type) -> std::expected<variable_info, error_t> {
+    constexpr auto declare_var(std::string_view name, const type_info &type, std::string_view struct_name = {})
+    -> std::expected<variable_info, error_t> {
       if (scopes.empty()) {
         return std::unexpected{error::other_compiler_error{
           .message = "No scope"
@@ -130,10 +221,16 @@ namespace korka {
         }};
       }
 
+      // Narrow locals are packed at their own width in an area of their own
+      auto t = std::get<korka::type>(type);
+      auto index = is_narrow(t) ? current.current_narrow_size : current.current_locals_size++;
+      if (is_narrow(t)) current.current_narrow_size += storage_width(t);
+
       variable_info info{
         .name = name,
         .type = type,
-        .locals_index = current.current_locals_size++
+        .locals_index = index,
+        .struct_name = struct_name
       };
 
       current.variables[name] = info;
@@ -141,9 +238,16 @@ namespace korka {
     }
 
     constexpr auto declare_function(std::string_view name, auto &&...args) -> std::expected<void, error_t> {
+      if (functions.contains(name)) {
+        return std::unexpected{error::redeclaration{
+          .identifier = name
+        }};
+      }
+
       functions.emplace(std::piecewise_construct,
                         std::forward_as_tuple(name),
                         std::forward_as_tuple(name, std::forward<decltype(args)>(args)...));
+      functions[name].index = function_count++;
       return {};
     }
 
@@ -166,6 +270,7 @@ namespace korka {
     constexpr auto clear() -> void {
       scopes.clear();
       functions.clear();
+      function_count = 0;
     }
   };
 
@@ -173,13 +278,30 @@ namespace korka {
   struct compilation_result {
     std::vector<std::byte> bytes;
     flat_map<std::string_view, function_info> functions;
+    std::vector<vm::stack_value_t> constants;
+    std::vector<std::byte> strings;
+    std::vector<vm::param_entry> params;
   };
 
-  template<std::size_t NBytes, std::size_t NFunctions, std::size_t NMaxParams, class SignatureMapper>
+  template<std::size_t NBytes, std::size_t NFunctions, std::size_t NMaxParams, std::size_t NConstants,
+    std::size_t NStrings, std::size_t NParams, class SignatureMapper>
   struct const_compilation_result {
-    std::array<std::byte, NBytes> bytes;
+    alignas(vm::instruction_word) std::array<std::byte, NBytes> bytes;
     frozen::unordered_map<std::string_view, const_function_info<NMaxParams>, NFunctions> functions;
 
+    // Function table ordered by index, the runtime looks functions up here
+    std::array<vm::function_entry, NFunctions> table;
+
+    std::array<vm::stack_value_t, NConstants> constants;
+
+    alignas(vm::string_size_t) std::array<std::byte, NStrings> strings;
+
+    std::array<vm::param_entry, NParams> params;
+
+    constexpr auto view() const -> vm::program_view {
+      return {bytes, table, constants, vm::instruction_encoding::bytes, nullptr, strings, params, true};
+    }
+
     template<const_string name>
     using get_signature_t = typename SignatureMapper::template get_signature_t<name>;
 
@@ -240,27 +362,85 @@ struct unique_type{};
       return frozen::make_unordered_map(functions_data);
     };
 
+    constexpr static auto table = []() constexpr {
+      std::array<vm::function_entry, function_count> table_data{};
+      for (auto &&[key, value]: r().functions) {
+        table_data[value.index] = function_info_to_entry(value);
+      }
+      return table_data;
+    }();
+
+    // --- CONSTANTS ---
+    constexpr static auto constants = to_array<[] { return r().constants; }>();
+
+    // --- STRINGS ---
+    constexpr static auto strings = to_array<[] { return r().strings; }>();
+
+    // --- PARAMETERS ---
+    constexpr static auto params = to_array<[] { return r().params; }>();
+
     using sign_mapper = signature_mapper<[](std::size_t i) { return (functions().begin() + i)->second; }, std::make_index_sequence<function_count>>;
 
-    return const_compilation_result<bytes.size(), function_count, max_params_n, sign_mapper>{
+    return const_compilation_result<bytes.size(), function_count, max_params_n, constants.size(), strings.size(),
+      params.size(), sign_mapper>{
       bytes,
-      functions()
+      functions(),
+      table,
+      constants,
+      strings,
+      params
     };
   }
 
   class compiler {
   public:
-    constexpr compiler(std::span<const nodes::node> nodes, nodes::index_t root_node)
-      : m_nodes(nodes), m_root_node(root_node) {}
+    constexpr compiler(std::span<const nodes::node> nodes, nodes::index_t root_node,
+                       vm::instruction_encoding encoding = vm::instruction_encoding::bytes,
+                       std::span<const vm::struct_layout> registered_structs = {})
+      : m_nodes(nodes), m_root_node(root_node), builder(encoding), m_registered_structs(registered_structs) {}
 
     constexpr auto compile() -> std::expected<compilation_result, error_t> {
       m_symbols.push_scope();
       auto ok = process_node(m_root_node);
       if (!ok) return std::unexpected{ok.error()};
 
+      auto bytes = builder.build();
+      if (auto failure = builder.failure()) {
+        return std::unexpected{error::other_compiler_error{.message = *failure}};
+      }
+
+      // Functions are emitted back to back in declaration order, natives have no code
+      std::vector<function_info *> by_index(m_symbols.function_count);
+      for (auto &&[name, info]: m_symbols.functions) {
+        by_index[info.index] = &m_symbols.functions[name];
+      }
+      // Parameter rows in table order, natives have them too
+      std::vector<vm::param_entry> params;
+      for (auto *f: by_index) {
+        f->params_offset = params.size();
+        for (auto &&p: f->params) {
+          auto t = std::get<type>(p.type);
+          auto size = t == type::object ? lookup_struct(p.struct_name)->size : 0;
+          params.push_back({.type = t, .object_size = static_cast<std::uint32_t>(size)});
+        }
+      }
+      std::erase_if(by_index, [](const function_info *f) { return f->native; });
+      for (std::size_t i = 0; i < by_index.size(); ++i) {
+        auto &f = *by_index[i];
+        f.offset = static_cast<std::size_t>(*builder.resolve_label(f.label));
+        auto end = i + 1 < by_index.size()
+                   ? static_cast<std::size_t>(*builder.resolve_label(by_index[i + 1]->label))
+                   : bytes.size();
+        f.size = end - f.offset;
+      }
+      measure_stacks(bytes);
+
       return compilation_result{
-        builder.build(),
-        m_symbols.functions
+        std::move(bytes),
+        m_symbols.functions,
+        builder.constants(),
+        builder.strings(),
+        std::move(params)
       };
     }
 
@@ -273,8 +453,314 @@ struct unique_type{};
     // Info for ast walker
     std::optional<type_info> m_current_func_ret;
 
+    // Structs the script declared, and the C++ structs the host registered
+    flat_map<std::string_view, vm::struct_layout> m_structs;
+    std::span<const vm::struct_layout> m_registered_structs;
+
+    // `while (i < size(xs))` around the code being compiled. Until `i` is assigned in the
+    // body, `xs[i]` is in range: `i` only counts up from zero and the view keeps its size.
+    struct index_guard {
+      std::string_view index;
+      std::string_view array;
+      bool dirty;
+    };
+    std::vector<index_guard> m_guards;
+
+    // Locals of the current function that only ever count up from a non negative literal
+    std::vector<std::string_view> m_counters;
+
     using result_t = std::expected<type_info, error_t>;
 
+    // A call, and the depth of the caller's stack below the callee's arguments
+    struct call_site {
+      std::size_t base;
+      std::size_t callee;
+    };
+
+    enum class visit : std::uint8_t {
+      unvisited,
+      visiting,
+      done
+    };
+
+    /**
+     * Stack depth of every function and the worst case over the calls it makes. Statements
+     * leave the stack as they found it and so do both arms of an `if` and loop bodies, so one
+     * pass in code order sees every depth a function reaches.
+     */
+    constexpr auto measure_stacks(std::span<const std::byte> bytes) -> void {
+      std::vector<function_info *> by_index(m_symbols.function_count);
+      for (auto &&[name, info]: m_symbols.functions) {
+        by_index[info.index] = &m_symbols.functions[name];
+      }
+
+      std::vector<vm::function_entry> table;
+      for (auto *f: by_index) {
+        table.push_back(function_info_to_entry(*f));
+      }
+
+      std::vector<std::vector<call_site>> calls(by_index.size());
+      for (std::size_t i = 0; i < by_index.size(); ++i) {
+        auto &f = *by_index[i];
+        auto depth = static_cast<std::int64_t>(f.params.size());
+        auto deepest = depth;
+        for (auto pc = f.offset; pc < f.offset + f.size;) {
+          auto instr = vm::decode(bytes, pc, builder.encoding());
+          if (not instr) break;
+
+          auto [pops, pushes] = vm::effect_of(*instr, table);
+          if (instr->op == vm::op_code::call) {
+            calls[i].push_back({static_cast<std::size_t>(depth - pops), static_cast<std::size_t>(instr->operand)});
+          }
+          depth += pushes - pops;
+          deepest = std::max(deepest, depth);
+          pc += instr->size;
+        }
+        f.max_stack = static_cast<std::size_t>(deepest);
+      }
+
+      std::vector<visit> state(by_index.size(), visit::unvisited);
+      for (std::size_t i = 0; i < by_index.size(); ++i) {
+        bound_calls(i, by_index, calls, state);
+      }
+    }
+
+    // Totals of the function, false if it can reach itself
+    constexpr auto bound_calls(std::size_t index, std::span<function_info *const> functions,
+                               std::span<const std::vector<call_site>> calls, std::vector<visit> &state) -> bool {
+      auto &f = *functions[index];
+      if (state[index] == visit::visiting) return false;
+      if (state[index] == visit::done) return f.bounded;
+      state[index] = visit::visiting;
+
+      f.bounded = true;
+      f.total_stack = f.max_stack;
+      std::size_t callee_locals{}, callee_narrow{}, callee_frames{};
+      for (auto [base, callee]: calls[index]) {
+        if (not bound_calls(callee, functions, calls, state)) {
+          f.bounded = false;
+          continue;
+        }
+        const auto &c = *functions[callee];
+        f.total_stack = std::max(f.total_stack, base + c.total_stack);
+        callee_locals = std::max(callee_locals, c.total_locals);
+        callee_narrow = std::max(callee_narrow, c.total_narrow);
+        callee_frames = std::max(callee_frames, c.total_frames);
+      }
+      f.total_locals = f.locals_count + callee_locals;
+      f.total_narrow = f.narrow_size + callee_narrow;
+      // Natives run on the host stack
+      f.total_frames = f.native ? 0 : 1 + callee_frames;
+      if (not f.bounded) {
+        f.total_stack = f.total_locals = f.total_narrow = f.total_frames = 0;
+      }
+
+      state[index] = visit::done;
+      return f.bounded;
+    }
+
+    /**
+     * Calls `f(name, value)` for every `name = value` in the subtree, loops and branches
+     * included
+     */
+    constexpr auto for_each_assignment(nodes::index_t idx, auto &&f) const -> void {
+      if (idx == nodes::empty_node) return;
+      auto list = [&](nodes::index_t head) {
+        for (auto item: nodes::get_list_view(m_nodes, head)) for_each_assignment(item, f);
+      };
+      std::visit(overloaded{
+        [&](const nodes::expr_unary &v) { for_each_assignment(v.child, f); },
+        [&](const nodes::expr_binary &v) {
+          if (v.op == "=" && std::holds_alternative<nodes::expr_var>(m_nodes[v.left].data)) {
+            f(std::get<nodes::expr_var>(m_nodes[v.left].data).name, v.right);
+          }
+          for_each_assignment(v.left, f);
+          for_each_assignment(v.right, f);
+        },
+        [&](const nodes::expr_call &v) { list(v.args_head); },
+        [&](const nodes::expr_index &v) { for_each_assignment(v.index, f); },
+        [&](const nodes::stmt_block &v) { list(v.children_head); },
+        [&](const nodes::stmt_if &v) {
+          for_each_assignment(v.condition, f);
+          for_each_assignment(v.then_branch, f);
+          for_each_assignment(v.else_branch, f);
+        },
+        [&](const nodes::stmt_while &v) {
+          for_each_assignment(v.condition, f);
+          for_each_assignment(v.body, f);
+        },
+        [&](const nodes::stmt_return &v) { for_each_assignment(v.expr, f); },
+        [&](const nodes::stmt_yield &v) { for_each_assignment(v.expr, f); },
+        [&](const nodes::stmt_expr &v) { for_each_assignment(v.expr, f); },
+        [&](const nodes::decl_var &v) { for_each_assignment(v.init_expr, f); },
+        [&](const auto &) {}
+      }, m_nodes[idx].data);
+    }
+
+    constexpr auto non_negative_literal(nodes::index_t idx) const -> bool {
+      if (idx == nodes::empty_node) return true; // locals start at zero
+      const auto *lit = std::get_if<nodes::expr_literal>(&m_nodes[idx].data);
+      if (not lit) return false;
+      const auto *value = std::get_if<std::int64_t>(lit);
+      // Small steps cannot wrap past a count of elements
+      return value && *value >= 0 && *value <= std::numeric_limits<std::int32_t>::max();
+    }
+
+    // Names only ever assigned `name = name + <small literal>` in the function body
+    constexpr auto find_counters(nodes::index_t body) const -> std::vector<std::string_view> {
+      std::vector<std::string_view> assigned, rejected;
+      for_each_assignment(body, [&](std::string_view name, nodes::index_t value) {
+        assigned.push_back(name);
+        const auto *sum = std::get_if<nodes::expr_binary>(&m_nodes[value].data);
+        const auto *var = sum ? std::get_if<nodes::expr_var>(&m_nodes[sum->left].data) : nullptr;
+        if (not sum || sum->op != "+" || not var || var->name != name || not non_negative_literal(sum->right)) {
+          rejected.push_back(name);
+        }
+      });
+      std::erase_if(assigned, [&](std::string_view name) { return std::ranges::find(rejected, name) != rejected.end(); });
+      return assigned;
+    }
+
+    // The array in a `size(xs)` call, when `size` is the builtin
+    constexpr auto array_size_call(nodes::index_t idx) -> std::optional<variable_info> {
+      const auto *call = std::get_if<nodes::expr_call>(&m_nodes[idx].data);
+      if (not call || call->name != "size" || m_symbols.lookup_function("size")) return std::nullopt;
+      if (call->args_head == nodes::empty_node || m_nodes[call->args_head].next != nodes::empty_node) {
+        return std::nullopt;
+      }
+      const auto *var = std::get_if<nodes::expr_var>(&m_nodes[call->args_head].data);
+      if (not var) return std::nullopt;
+      auto info = m_symbols.lookup_variable(var->name);
+      if (not info || not is_array(std::get<type>(info->type))) return std::nullopt;
+      return info;
+    }
+
+    // `i < size(xs)` with `i` a counter
+    constexpr auto guard_of(nodes::index_t condition) -> std::optional<index_guard> {
+      const auto *cmp = std::get_if<nodes::expr_binary>(&m_nodes[condition].data);
+      if (not cmp || cmp->op != "<") return std::nullopt;
+      const auto *index = std::get_if<nodes::expr_var>(&m_nodes[cmp->left].data);
+      auto array = array_size_call(cmp->right);
+      if (not index || not array || std::ranges::find(m_counters, index->name) == m_counters.end()) return std::nullopt;
+      return index_guard{.index = index->name, .array = array->name, .dirty = false};
+    }
+
+    // An index that a guard covers skips the bounds check
+    constexpr auto proven_in_range(std::string_view array, nodes::index_t index) const -> bool {
+      const auto *var = std::get_if<nodes::expr_var>(&m_nodes[index].data);
+      if (not var) return false;
+      return std::ranges::any_of(m_guards, [&](const index_guard &g) {
+        return not g.dirty && g.index == var->name && g.array == array;
+      });
+    }
+
+    // After the assignment, and from the top of a loop that makes it, no guard on it holds
+    constexpr auto invalidate_guards(std::string_view name) -> void {
+      for (auto &g: m_guards) {
+        if (g.index == name) g.dirty = true;
+      }
+    }
+
+    constexpr auto ends_with_return(nodes::index_t body) const -> bool {
+      const auto &block = std::get<nodes::stmt_block>(m_nodes[body].data);
+      bool last_is_return = false;
+      for (auto stmt: nodes::get_list_view(m_nodes, block.children_head)) {
+        last_is_return = std::holds_alternative<nodes::stmt_return>(m_nodes[stmt].data);
+      }
+      return last_is_return;
+    }
+
+    /**
+     * Type an expression will have, without emitting it. Operands of mixed math are converted
+     * as they are pushed, so the type has to be known before the left side is compiled.
+     */
+    constexpr auto expression_type(nodes::index_t idx) -> result_t {
+      return std::visit(overloaded{
+        [&](const nodes::expr_literal &lit) -> result_t {
+          if (std::holds_alternative<double>(lit)) return type_info{type::f64};
+          if (std::holds_alternative<std::string_view>(lit)) return type_info{type::str};
+          return type_info{type::i64};
+        },
+        [&](const nodes::expr_var &var) -> result_t {
+          auto info = m_symbols.lookup_variable(var.name);
+          if (not info) {
+            return std::unexpected{error::undefined_symbol{.identifier = var.name}};
+          }
+          if (is_narrow(std::get<type>(info->type))) return type_info{type::i64};
+          return info->type;
+        },
+        [&](const nodes::expr_call &call) -> result_t {
+          if (array_size_call(idx)) return type_info{type::i64};
+          auto info = m_symbols.lookup_function(call.name);
+          if (not info) {
+            return std::unexpected{error::undefined_symbol{.identifier = call.name}};
+          }
+          return info->return_type;
+        },
+        [&](const nodes::expr_index &expr) -> result_t {
+          auto info = m_symbols.lookup_variable(expr.name);
+          if (not info) {
+            return std::unexpected{error::undefined_symbol{.identifier = expr.name}};
+          }
+          return type_info{element_type(std::get<type>(info->type))};
+        },
+        [&](const nodes::expr_field &expr) -> result_t {
+          auto field = lookup_field(expr);
+          if (not field) {
+            return std::unexpected{field.error()};
+          }
+          return type_info{is_narrow(field->type) ? type::i64 : field->type};
+        },
+        [&](const nodes::expr_binary &expr) -> result_t {
+          if (expr.op == "=") return type_info{type::void_};
+          auto left = expression_type(expr.left);
+          if (not left) return left;
+          auto right = expression_type(expr.right);
+          if (not right) return right;
+
+          auto code = vm::get_op_code_for_math(type_info{type::f64}, type_info{type::f64}, expr.op);
+          if (code && vm::is_comparison(*code)) return type_info{type::i64};
+          if (*left == type_info{type::f64} || *right == type_info{type::f64}) return type_info{type::f64};
+          return left;
+        },
+        [&](const auto &) -> result_t {
+          return type_info{type::void_};
+        }
+      }, m_nodes[idx].data);
+    }
+
+    /**
+     * Implicit conversion between ints and doubles, as in C. False if there is none.
+     */
+    constexpr auto emit_conversion(type_info from, type_info to) -> bool {
+      if (from == to) return true;
+      if (from == type_info{type::i64} && to == type_info{type::f64}) {
+        builder.emit_op(vm::op_code::i64_to_f64);
+        return true;
+      }
+      if (from == type_info{type::f64} && to == type_info{type::i64}) {
+        builder.emit_op(vm::op_code::f64_to_i64);
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     * Leaves the int a condition jumps on. A double is true when it is not zero, strings
+     * and arrays are no conditions.
+     */
+    constexpr auto emit_truth(type_info condition) -> result_t {
+      if (condition == type_info{type::f64}) {
+        builder.emit_const<type::f64>(0.0);
+        builder.emit_op(vm::op_code::f64_ne);
+      } else if (condition != type_info{type::i64}) {
+        return std::unexpected{error::other_compiler_error{
+          .message = "Condition must be a number"
+        }};
+      }
+      return type_info{type::i64};
+    }
+
     constexpr auto process_node(nodes::index_t idx) -> result_t {
       const auto &node = m_nodes[idx];
 
@@ -290,7 +776,17 @@ struct unique_type{};
           return type_info{type::void_};
         },
         [&](const nodes::decl_function &function) -> result_t {
+          if (lookup_struct(function.ret_type)) {
+            return std::unexpected{error::other_compiler_error{
+              .message = "Structs are only passed as parameters"
+            }};
+          }
           type_info ret_type = string_to_type(function.ret_type);
+          if (is_narrow(std::get<type>(ret_type))) {
+            return std::unexpected{error::other_compiler_error{
+              .message = "Narrow types are only supported for local variables"
+            }};
+          }
           m_current_func_ret = ret_type;
 
           // Function pointer
@@ -300,9 +796,39 @@ struct unique_type{};
           std::vector<variable_info> parameters;
           for (auto p_idx: nodes::get_list_view(m_nodes, function.params_head)) {
             const auto &p_node = std::get<nodes::decl_var>(m_nodes[p_idx].data);
+
+            // An object is a pointer to a host struct, its fields are reached through it
+            if (const auto *layout = lookup_struct(p_node.type_name)) {
+              if (p_node.array) {
+                return std::unexpected{error::other_compiler_error{
+                  .message = "Arrays hold ints or doubles"
+                }};
+              }
+              parameters.push_back({
+                                     .name = p_node.var_name,
+                                     .type = type::object,
+                                     .locals_index = 0,
+                                     .struct_name = layout->name
+                                   });
+              continue;
+            }
+            auto p_type = string_to_type(p_node.type_name);
+            if (is_narrow(p_type)) {
+              return std::unexpected{error::other_compiler_error{
+                .message = "Narrow types are only supported for local variables"
+              }};
+            }
+            if (p_node.array) {
+              if (p_type != type::i64 && p_type != type::f64) {
+                return std::unexpected{error::other_compiler_error{
+                  .message = "Arrays hold ints or doubles"
+                }};
+              }
+              p_type = p_type == type::f64 ? type::f64_array : type::i64_array;
+            }
             parameters.push_back({
                                    .name = p_node.var_name,
-                                   .type = string_to_type(p_node.type_name),
+                                   .type = p_type,
                                    .locals_index = 0
                                  });
           }
@@ -317,18 +843,29 @@ struct unique_type{};
           );
           if (not reg_ok) return std::unexpected{reg_ok.error()};
 
+          if (function.body == nodes::empty_node) {
+            m_symbols.functions[function.name].native = true;
+            m_current_func_ret.reset();
+            return {};
+          }
+
           // Entering function scope
           m_symbols.push_scope();
           m_current_func_ret = ret_type;
+          m_counters = find_counters(function.body);
+          std::erase_if(m_counters, [&](std::string_view name) {
+            return std::ranges::any_of(parameters, [&](const variable_info &p) { return p.name == name; });
+          });
           builder.bind_label(label);
 
           // Handle parameters as local variables
           for (auto &&param: parameters) {
-            auto ok = m_symbols.declare_var(param.name, param.type);
+            auto ok = m_symbols.declare_var(param.name, param.type, param.struct_name);
             if (not ok) {
               return std::unexpected{ok.error()};
             }
           }
+          builder.emit_param_load(static_cast<std::uint8_t>(parameters.size()));
 
           // Function body
           for (auto stmt: nodes::get_list_view(m_nodes, function.body)) {
@@ -338,6 +875,25 @@ struct unique_type{};
             }
           }
 
+          // Falling off the end returns, zero for non-void functions and "" for strings
+          if (not ends_with_return(function.body)) {
+            if (ret_type == type_info{type::void_}) {
+              builder.emit_op(vm::op_code::ret_void);
+            } else if (ret_type == type_info{type::str}) {
+              if (not builder.emit_string_const("")) {
+                m_symbols.pop_scope();
+                return std::unexpected{error::other_compiler_error{.message = "Constant pool is full"}};
+              }
+              builder.emit_op(vm::op_code::ret);
+            } else {
+              builder.emit_const<type::i64>(0);
+              builder.emit_op(vm::op_code::ret);
+            }
+          }
+
+          m_symbols.functions[function.name].locals_count = m_symbols.scopes.back().current_locals_size;
+          m_symbols.functions[function.name].narrow_size = m_symbols.scopes.back().current_narrow_size;
+
           // cleanup
           m_symbols.pop_scope();
           m_current_func_ret.reset();
@@ -351,6 +907,14 @@ struct unique_type{};
             if constexpr (std::is_same_v<T, std::int64_t>) {
               builder.emit_const<type::i64>(val);
               return type_info{type::i64};
+            } else if constexpr (std::is_same_v<T, double>) {
+              builder.emit_const<type::f64>(val);
+              return type_info{type::f64};
+            } else if constexpr (std::is_same_v<T, std::string_view>) {
+              if (not builder.emit_string_const(val)) {
+                return std::unexpected{error::other_compiler_error{.message = "Constant pool is full"}};
+              }
+              return type_info{type::str};
             }
             return std::unexpected{
               error::other_compiler_error{.message = "This type is not supported as a literal yet"}};
@@ -364,11 +928,21 @@ struct unique_type{};
         },
 
         [&](const nodes::stmt_return &stmt) -> result_t {
+          if (stmt.expr == nodes::empty_node) {
+            if (m_current_func_ret && *m_current_func_ret != type_info{type::void_}) {
+              return std::unexpected{error::other_compiler_error{
+                .message = "Function return type mismatch"
+              }};
+            }
+            builder.emit_op(vm::op_code::ret_void);
+            return type_info{type::void_};
+          }
+
           auto actual_type = process_node(stmt.expr);
           if (!actual_type) return actual_type;
 
           // Semantic Check: Does return type match function signature?
-          if (m_current_func_ret && *actual_type != *m_current_func_ret) {
+          if (m_current_func_ret && not emit_conversion(*actual_type, *m_current_func_ret)) {
             // TODO: proper error
             return std::unexpected{error::other_compiler_error{
               .message = "Function return type mismatch"
@@ -376,20 +950,67 @@ struct unique_type{};
           }
 
           builder.emit_op(vm::op_code::ret);
-          return *actual_type;
+          return m_current_func_ret ? *m_current_func_ret : *actual_type;
+        },
+        [&](const nodes::stmt_yield &stmt) -> result_t {
+          // A bare `yield;` hands 0 to the host
+          if (stmt.expr == nodes::empty_node) {
+            builder.emit_const<type::i64>(0);
+          } else {
+            auto value = process_node(stmt.expr);
+            if (not value) return value;
+            if (*value != type_info{type::i64}) {
+              return std::unexpected{error::other_compiler_error{
+                .message = "Yielded value must be an int"
+              }};
+            }
+          }
+
+          builder.emit_op(vm::op_code::yield);
+          return type_info{type::void_};
         },
         [&](const nodes::decl_var &var) -> result_t {
+          if (lookup_struct(var.type_name)) {
+            return std::unexpected{error::other_compiler_error{
+              .message = "Structs are only passed as parameters"
+            }};
+          }
           auto ok = m_symbols.declare_var(var.var_name, string_to_type(var.type_name));
           if (!ok) {
             return std::unexpected{ok.error()};
           }
+          if (ok->type != type_info{type::i64} || not non_negative_literal(var.init_expr)) {
+            std::erase(m_counters, var.var_name);
+          }
 
           if (var.init_expr != nodes::empty_node) {
             auto expr = process_node(var.init_expr);
             if (not expr) {
               return expr;
             }
-            builder.emit_save_local(ok->locals_index);
+            auto index = static_cast<vm::local_index_t>(ok->locals_index);
+            if (is_narrow(std::get<type>(ok->type))) {
+              // Ints are stored into narrow locals, which keep the low bits
+              if (not emit_conversion(*expr, type_info{type::i64})) {
+                return std::unexpected{error::other_compiler_error{
+                  .message = "Narrow locals are initialized from an int"
+                }};
+              }
+              builder.emit_save_local_i8(index);
+            } else {
+              if (not emit_conversion(*expr, ok->type)) {
+                return std::unexpected{error::other_compiler_error{
+                  .message = "Variable type mismatch in the declaration"
+                }};
+              }
+              builder.emit_save_local(index);
+            }
+          } else if (ok->type == type_info{type::str}) {
+            // A string slot is never null, comparing it must not read through it
+            if (not builder.emit_string_const("")) {
+              return std::unexpected{error::other_compiler_error{.message = "Constant pool is full"}};
+            }
+            builder.emit_save_local(static_cast<vm::local_index_t>(ok->locals_index));
           }
           return ok->type;
         },
@@ -402,18 +1023,44 @@ struct unique_type{};
             }};
           }
 
+          // Narrow values are widened on the stack and take part in expressions as ints
+          if (is_narrow(std::get<type>(info->type))) {
+            builder.emit_load_local_i8(static_cast<vm::local_index_t>(info->locals_index));
+            return type_info{type::i64};
+          }
           builder.emit_load_local(info->locals_index);
           return info->type;
         },
         [&](const nodes::expr_binary &expr) -> result_t {
+          if (expr.op == "=") {
+            return compile_assignment(expr);
+          }
+
+          auto left_type = expression_type(expr.left);
+          if (not left_type) {
+            return left_type;
+          }
+          auto right_type = expression_type(expr.right);
+          if (not right_type) {
+            return right_type;
+          }
+          // An int next to a double is promoted, each side right after it is pushed
+          auto promoted = *left_type == type_info{type::f64} || *right_type == type_info{type::f64};
+
           auto left = process_node(expr.left);
           if (not left) {
             return left;
           }
+          if (promoted && emit_conversion(*left, type_info{type::f64})) {
+            left = type_info{type::f64};
+          }
           auto right = process_node(expr.right);
           if (not right) {
             return right;
           }
+          if (promoted && emit_conversion(*right, type_info{type::f64})) {
+            right = type_info{type::f64};
+          }
 
           if ((*left) != (*right)) {
             return std::unexpected{error::other_compiler_error{
@@ -427,14 +1074,97 @@ struct unique_type{};
           }
           builder.emit_op(*code);
 
+          if (vm::is_comparison(*code)) {
+            return type_info{type::i64};
+          }
           return *left;
         },
 
+        [&](const nodes::stmt_expr &stmt) -> result_t {
+          if (stmt.expr == nodes::empty_node) {
+            return type_info{type::void_};
+          }
+
+          auto expr = process_node(stmt.expr);
+          if (not expr) {
+            return expr;
+          }
+
+          // The value is unused
+          if (*expr != type_info{type::void_}) {
+            builder.emit_op(vm::op_code::pop);
+          }
+          return type_info{type::void_};
+        },
+
+        [&](const nodes::expr_call &call) -> result_t {
+          // `size(xs)` counts the elements of an array, unless the script has its own `size`
+          if (auto array = array_size_call(idx)) {
+            builder.emit_array_size(static_cast<vm::local_index_t>(array->locals_index));
+            return type_info{type::i64};
+          }
+
+          auto info = m_symbols.lookup_function(call.name);
+          if (not info) {
+            return std::unexpected{error::undefined_symbol{
+              .identifier = call.name
+            }};
+          }
+
+          std::size_t arg_count{};
+          for (auto arg: nodes::get_list_view(m_nodes, call.args_head)) {
+            if (arg_count >= info->params.size()) {
+              return std::unexpected{error::other_compiler_error{
+                .message = "Too many arguments in the function call"
+              }};
+            }
+
+            // Objects are passed on as they came, only to parameters of the same struct
+            const auto &param = info->params[arg_count];
+            if (param.type == type_info{type::object}) {
+              const auto *var = std::get_if<nodes::expr_var>(&m_nodes[arg].data);
+              auto passed = var ? m_symbols.lookup_variable(var->name) : std::nullopt;
+              if (not passed || passed->type != param.type || passed->struct_name != param.struct_name) {
+                return std::unexpected{error::other_compiler_error{
+                  .message = "Argument type mismatch in the function call"
+                }};
+              }
+            }
+
+            auto arg_type = process_node(arg);
+            if (not arg_type) {
+              return arg_type;
+            }
+            if (not emit_conversion(*arg_type, param.type)) {
+              return std::unexpected{error::other_compiler_error{
+                .message = "Argument type mismatch in the function call"
+              }};
+            }
+            ++arg_count;
+          }
+
+          if (arg_count != info->params.size()) {
+            return std::unexpected{error::other_compiler_error{
+              .message = "Too few arguments in the function call"
+            }};
+          }
+
+          if (info->native) {
+            builder.emit_call_native(static_cast<vm::function_index_t>(info->index));
+          } else {
+            builder.emit_call(static_cast<vm::function_index_t>(info->index));
+          }
+          return info->return_type;
+        },
+
         [&](const nodes::stmt_if &if_) -> result_t {
           auto condition_expr = process_node(if_.condition);
           if (not condition_expr) {
             return condition_expr;
           }
+          if (auto ok = emit_truth(*condition_expr); not ok) {
+            return ok;
+          }
 
           auto else_branch_label = builder.make_label();
           auto end_label = builder.make_label();
@@ -467,6 +1197,114 @@ struct unique_type{};
           return {};
         },
 
+        [&](const nodes::expr_index &expr) -> result_t {
+          auto array = lookup_array(expr.name);
+          if (not array) {
+            return std::unexpected{array.error()};
+          }
+          auto index = compile_index(expr.index);
+          if (not index) {
+            return index;
+          }
+          builder.emit_array_load(static_cast<vm::local_index_t>(array->locals_index),
+                                  not proven_in_range(expr.name, expr.index));
+          return type_info{element_type(std::get<type>(array->type))};
+        },
+
+        [&](const nodes::expr_field &expr) -> result_t {
+          auto field = lookup_field(expr);
+          if (not field) {
+            return std::unexpected{field.error()};
+          }
+          builder.emit_load_local(m_symbols.lookup_variable(expr.object)->locals_index);
+          builder.emit_field_load(static_cast<vm::field_offset_t>(field->offset), is_narrow(field->type));
+          return type_info{is_narrow(field->type) ? type::i64 : field->type};
+        },
+
+        [&](const nodes::decl_struct &decl) -> result_t {
+          if (m_structs.contains(decl.name)) {
+            return std::unexpected{error::redeclaration{.identifier = decl.name}};
+          }
+
+          // Laid out the way a C++ compiler lays out the same members
+          vm::struct_layout layout{.name = decl.name};
+          for (auto f_idx: nodes::get_list_view(m_nodes, decl.fields_head)) {
+            const auto &f = std::get<nodes::decl_var>(m_nodes[f_idx].data);
+            if (f.array || (f.type_name != "int" && f.type_name != "double" && f.type_name != "char")) {
+              return std::unexpected{error::other_compiler_error{
+                .message = "Struct fields are ints, doubles or chars"
+              }};
+            }
+            if (layout.find(f.var_name)) {
+              return std::unexpected{error::redeclaration{.identifier = f.var_name}};
+            }
+            vm::append_field(layout, f.var_name, string_to_type(f.type_name));
+          }
+          if (layout.fields.empty()) {
+            return std::unexpected{error::other_compiler_error{
+              .message = "Structs need at least one field"
+            }};
+          }
+          if (not std::in_range<vm::field_offset_t>(layout.fields.back().offset)) {
+            return std::unexpected{error::other_compiler_error{
+              .message = "Struct is too large"
+            }};
+          }
+          vm::finish_layout(layout);
+
+          // A struct the host registered is only declared again as it is
+          auto registered = std::ranges::find(m_registered_structs, decl.name, &vm::struct_layout::name);
+          if (registered != m_registered_structs.end()) {
+            auto same = registered->size == layout.size && registered->fields.size() == layout.fields.size()
+                        && std::ranges::all_of(layout.fields, [&](const vm::struct_field &f) {
+                          const auto *host = registered->find(f.name);
+                          return host && *host == f;
+                        });
+            if (not same) {
+              return std::unexpected{error::other_compiler_error{
+                .message = "Struct layout differs from the registered C++ struct"
+              }};
+            }
+          }
+
+          m_structs[decl.name] = std::move(layout);
+          return type_info{type::void_};
+        },
+
+        [&](const nodes::stmt_while &loop) -> result_t {
+          // Every pass through the body may follow an assignment further down in it
+          for_each_assignment(idx, [&](std::string_view name, nodes::index_t) { invalidate_guards(name); });
+
+          auto start_label = builder.make_label();
+          auto end_label = builder.make_label();
+          builder.bind_label(start_label);
+
+          auto condition_expr = process_node(loop.condition);
+          if (not condition_expr) {
+            return condition_expr;
+          }
+          if (auto ok = emit_truth(*condition_expr); not ok) {
+            return ok;
+          }
+          builder.emit_jmp_if_zero(end_label);
+
+          auto guard = guard_of(loop.condition);
+          if (guard) {
+            m_guards.push_back(*guard);
+          }
+          auto body = process_node(loop.body);
+          if (guard) {
+            m_guards.pop_back();
+          }
+          if (not body) {
+            return body;
+          }
+
+          builder.emit_jmp(start_label);
+          builder.bind_label(end_label);
+          return {};
+        },
+
         [&](const auto &value) -> result_t {
           std::ignore = value;
           return std::unexpected{error::other_compiler_error{
@@ -475,6 +1313,135 @@ struct unique_type{};
         }
       }, node.data);
     }
+
+    constexpr auto lookup_array(std::string_view name) -> std::expected<variable_info, error_t> {
+      auto info = m_symbols.lookup_variable(name);
+      if (not info) {
+        return std::unexpected{error::undefined_symbol{.identifier = name}};
+      }
+      if (not is_array(std::get<type>(info->type))) {
+        return std::unexpected{error::other_compiler_error{
+          .message = "Only arrays can be indexed"
+        }};
+      }
+      return *info;
+    }
+
+    // Structs of the script first, they were checked against the registered ones
+    constexpr auto lookup_struct(std::string_view name) const -> const vm::struct_layout * {
+      if (auto it = m_structs.find(name); it != std::end(m_structs)) {
+        return &it->second;
+      }
+      auto registered = std::ranges::find(m_registered_structs, name, &vm::struct_layout::name);
+      return registered == m_registered_structs.end() ? nullptr : &*registered;
+    }
+
+    constexpr auto lookup_field(const nodes::expr_field &expr) -> std::expected<vm::struct_field, error_t> {
+      auto info = m_symbols.lookup_variable(expr.object);
+      if (not info) {
+        return std::unexpected{error::undefined_symbol{.identifier = expr.object}};
+      }
+      if (info->type != type_info{type::object}) {
+        return std::unexpected{error::other_compiler_error{
+          .message = "Only structs have fields"
+        }};
+      }
+      const auto *field = lookup_struct(info->struct_name)->find(expr.field);
+      if (not field) {
+        return std::unexpected{error::undefined_symbol{.identifier = expr.field}};
+      }
+      return *field;
+    }
+
+    constexpr auto compile_index(nodes::index_t index) -> result_t {
+      auto index_type = process_node(index);
+      if (not index_type) {
+        return index_type;
+      }
+      if (*index_type != type_info{type::i64}) {
+        return std::unexpected{error::other_compiler_error{
+          .message = "Array index must be an int"
+        }};
+      }
+      return index_type;
+    }
+
+    // `x = value`, `xs[i] = value` and `o.f = value`, statements only, they leave nothing on the stack
+    constexpr auto compile_assignment(const nodes::expr_binary &expr) -> result_t {
+      if (const auto *target = std::get_if<nodes::expr_field>(&m_nodes[expr.left].data)) {
+        auto field = lookup_field(*target);
+        if (not field) {
+          return std::unexpected{field.error()};
+        }
+        builder.emit_load_local(m_symbols.lookup_variable(target->object)->locals_index);
+        auto value = process_node(expr.right);
+        if (not value) {
+          return value;
+        }
+        // Char fields keep the low bits of an int, like narrow locals
+        auto narrow = is_narrow(field->type);
+        if (not emit_conversion(*value, type_info{narrow ? type::i64 : field->type})) {
+          return std::unexpected{error::other_compiler_error{
+            .message = "Assigned value does not match the field"
+          }};
+        }
+        builder.emit_field_save(static_cast<vm::field_offset_t>(field->offset), narrow);
+        return type_info{type::void_};
+      }
+
+      if (const auto *target = std::get_if<nodes::expr_index>(&m_nodes[expr.left].data)) {
+        auto array = lookup_array(target->name);
+        if (not array) {
+          return std::unexpected{array.error()};
+        }
+        auto index = compile_index(target->index);
+        if (not index) {
+          return index;
+        }
+        auto value = process_node(expr.right);
+        if (not value) {
+          return value;
+        }
+        if (not emit_conversion(*value, type_info{element_type(std::get<type>(array->type))})) {
+          return std::unexpected{error::other_compiler_error{
+            .message = "Assigned value does not match the array"
+          }};
+        }
+        builder.emit_array_save(static_cast<vm::local_index_t>(array->locals_index),
+                                not proven_in_range(target->name, target->index));
+        return type_info{type::void_};
+      }
+
+      const auto &target = std::get<nodes::expr_var>(m_nodes[expr.left].data);
+      auto info = m_symbols.lookup_variable(target.name);
+      if (not info) {
+        return std::unexpected{error::undefined_symbol{.identifier = target.name}};
+      }
+      auto t = std::get<type>(info->type);
+      if (is_array(t) || t == type::object) {
+        return std::unexpected{error::other_compiler_error{
+          .message = "Arrays and objects cannot be assigned"
+        }};
+      }
+
+      auto value = process_node(expr.right);
+      if (not value) {
+        return value;
+      }
+      if (not emit_conversion(*value, is_narrow(t) ? type_info{type::i64} : info->type)) {
+        return std::unexpected{error::other_compiler_error{
+          .message = "Assigned value does not match the variable"
+        }};
+      }
+      auto index = static_cast<vm::local_index_t>(info->locals_index);
+      if (is_narrow(t)) {
+        builder.emit_save_local_i8(index);
+      } else {
+        builder.emit_save_local(index);
+      }
+      invalidate_guards(target.name);
+      return type_info{type::void_};
+    }
   };
 
   template<auto &&nodes, nodes::index_t root>
@@ -9,8 +9,11 @@ namespace korka {
     kCloseBrace,        // }
     kOpenParenthesis,   // (
     kCloseParenthesis,  // )
+    kOpenBracket,       // [
+    kCloseBracket,      // ]
     kSemicolon,         // ;
     kComma,             // ,
+    kDot,               // .
 
     kBang,    kBangEqual,     // !, !=
     kEqual,   kEqualEqual,    // =, ==
@@ -27,10 +30,12 @@ namespace korka {
     kInt,               // int
 
     kReturn,            // return
+    kYield,             // yield
     kAnd, kOr,          // and, or
     kIf, kElse,         // if, else
     kTrue, kFalse,      // true, false
     kFor, kWhile,       // for, while
+    kStruct,            // struct
 
 
     kIdentifier,        // [a-zA-Z]\w*
@@ -42,10 +42,11 @@ namespace korka {
     }
 
   private:
-    static constexpr frozen::unordered_map<frozen::string, lex_kind, 10> keywords{
+    static constexpr frozen::unordered_map<frozen::string, lex_kind, 12> keywords{
       {"int",    lex_kind::kInt},
 
       {"return", lex_kind::kReturn},
+      {"yield",  lex_kind::kYield},
       {"and",    lex_kind::kAnd},
       {"or",     lex_kind::kOr},
       {"if",     lex_kind::kIf},
@@ -54,6 +55,7 @@ namespace korka {
       {"false",  lex_kind::kFalse},
       {"for",    lex_kind::kFor},
       {"while",  lex_kind::kWhile},
+      {"struct", lex_kind::kStruct},
     };
 
     std::string_view m_source;
@@ -79,10 +81,16 @@ namespace korka {
           return make_token(lex_kind::kOpenParenthesis);
         case ')':
           return make_token(lex_kind::kCloseParenthesis);
+        case '[':
+          return make_token(lex_kind::kOpenBracket);
+        case ']':
+          return make_token(lex_kind::kCloseBracket);
         case ';':
           return make_token(lex_kind::kSemicolon);
         case ',':
           return make_token(lex_kind::kComma);
+        case '.':
+          return make_token(lex_kind::kDot);
         case '+':
           return make_token(match('=') ? lex_kind::kPlusEqual : lex_kind::kPlus);
         case '-':
@@ -91,6 +99,8 @@ namespace korka {
           return make_token(match('=') ? lex_kind::kStarEqual : lex_kind::kStar);
         case '%':
           return make_token(match('=') ? lex_kind::kPercentEqual : lex_kind::kPercent);
+        case '!':
+          return make_token(match('=') ? lex_kind::kBangEqual : lex_kind::kBang);
         case '=':
           return make_token(match('=') ? lex_kind::kEqualEqual : lex_kind::kEqual);
         case '<':
@@ -21,20 +21,24 @@ namespace korka {
     struct expr_unary { std::string_view op; index_t child; };
     struct expr_binary { std::string_view op; index_t left; index_t right; };
     struct expr_call { std::string_view name; index_t args_head; };
+    struct expr_index { std::string_view name; index_t index; };
+    struct expr_field { std::string_view object; std::string_view field; };
     struct stmt_block { index_t children_head; };
     struct stmt_if { index_t condition; index_t then_branch; index_t else_branch; };
     struct stmt_while { index_t condition; index_t body; };
     struct stmt_return { index_t expr; };
+    struct stmt_yield { index_t expr; };
     struct stmt_expr { index_t expr; };
-    struct decl_var { std::string_view type_name; std::string_view var_name; index_t init_expr; };
+    struct decl_var { std::string_view type_name; std::string_view var_name; index_t init_expr; bool array = false; };
     struct decl_function { std::string_view ret_type; std::string_view name; index_t params_head; index_t body; };
     struct decl_program { index_t external_declarations_head; };
+    struct decl_struct { std::string_view name; index_t fields_head; };
 
     struct node {
       using data_t = std::variant<
         expr_literal, expr_var, expr_unary, expr_binary, expr_call,
         stmt_block, stmt_if, stmt_while, stmt_return, stmt_expr, decl_var,
-        decl_function, decl_program
+        decl_function, decl_program, stmt_yield, expr_index, expr_field, decl_struct
       >;
       data_t data;
       index_t next = empty_node;
@@ -115,6 +119,7 @@ namespace korka {
       auto head = parse_external_declaration();
       if (!head) return std::unexpected{head.error()};
 
+      index_t tail = *head;
       while (peek()) {
         if (peek()->kind == lex_kind::kEof) {
           break;
@@ -123,7 +128,8 @@ namespace korka {
         if (not decl) return std::unexpected{decl.error()};
         if (*decl == empty_node) break;
 
-        m_pool.append_list(*head, *decl);
+        m_pool.nodes[tail].next = *decl;
+        tail = *decl;
       }
 
       index_t root = m_pool.add(decl_program{*head});
@@ -136,6 +142,10 @@ namespace korka {
     std::size_t m_current{0};
 
     constexpr auto parse_external_declaration() -> parse_result {
+      if (match(lex_kind::kStruct)) {
+        return parse_struct_declaration();
+      }
+
       auto type = parse_type_specifier();
       if (not type) return std::unexpected{type.error()};
 
@@ -149,6 +159,16 @@ namespace korka {
         if (!match(lex_kind::kCloseParenthesis))
           return make_error("Expected ')' after parameters");
 
+        // A declaration without a body is provided by the host
+        if (match(lex_kind::kSemicolon)) {
+          return m_pool.add(decl_function{
+            .ret_type = *type,
+            .name = *name,
+            .params_head = *params,
+            .body = empty_node
+          });
+        }
+
         auto body = parse_compound_stmt();
         if (!body) return std::unexpected{body.error()};
 
@@ -163,6 +183,29 @@ namespace korka {
       return make_error("Global variables not implemented yet");
     };
 
+    // `struct name { type field; ... };`, fields are kept as declarations without initializers
+    constexpr auto parse_struct_declaration() -> parse_result {
+      auto name = parse_id();
+      if (!name) return std::unexpected{name.error()};
+      if (!match(lex_kind::kOpenBrace)) return make_error("Expected '{' after struct name");
+
+      index_t head = empty_node;
+      while (not match(lex_kind::kCloseBrace)) {
+        auto type = parse_type_specifier();
+        if (!type) return std::unexpected{type.error()};
+        auto field = parse_id();
+        if (!field) return std::unexpected{field.error()};
+        if (!match(lex_kind::kSemicolon)) return make_error("Expected ';' after field");
+
+        auto node = m_pool.add(decl_var{*type, *field, empty_node});
+        if (head == empty_node) head = node;
+        else m_pool.append_list(head, node);
+      }
+
+      if (!match(lex_kind::kSemicolon)) return make_error("Expected ';' after struct");
+      return m_pool.add(decl_struct{*name, head});
+    }
+
     constexpr auto parse_parameter_list() -> parse_result {
       if (auto next = peek(); next && next->kind == lex_kind::kCloseParenthesis) {
         return empty_node;
@@ -187,7 +230,14 @@ namespace korka {
       auto name = parse_id();
       if (!name) return std::unexpected{name.error()};
 
-      return m_pool.add(decl_var{*type, *name, empty_node});
+      // `int xs[]`, an array the host passes in
+      bool array = false;
+      if (match(lex_kind::kOpenBracket)) {
+        if (!match(lex_kind::kCloseBracket)) return make_error("Expected ']' after '['");
+        array = true;
+      }
+
+      return m_pool.add(decl_var{*type, *name, empty_node, array});
     }
 
     constexpr auto parse_type_specifier() -> std::expected<std::string_view, error_t> {
@@ -248,6 +298,7 @@ namespace korka {
         case lex_kind::kIf:        return parse_if_statement();
         case lex_kind::kWhile:     return parse_while_statement();
         case lex_kind::kReturn:    return parse_return_statement();
+        case lex_kind::kYield:     return parse_yield_statement();
         default:                   return parse_expression_stmt();
       }
     }
@@ -266,6 +317,20 @@ namespace korka {
       return m_pool.add(stmt_return{expr_idx});
     }
 
+    constexpr auto parse_yield_statement() -> parse_result {
+      if (!match(lex_kind::kYield)) return make_error("Expected 'yield'");
+
+      index_t expr_idx = empty_node;
+      if (auto next = peek(); next && next->kind != lex_kind::kSemicolon) {
+        auto expr = parse_expression();
+        if (!expr) return std::unexpected{expr.error()};
+        expr_idx = *expr;
+      }
+
+      if (!match(lex_kind::kSemicolon)) return make_error("Expected ';' after yield");
+      return m_pool.add(stmt_yield{expr_idx});
+    }
+
     constexpr auto parse_while_statement() -> parse_result {
       if (!match(lex_kind::kWhile)) return make_error("Expected 'while'");
       if (!match(lex_kind::kOpenParenthesis)) return make_error("Expected '('");
@@ -307,6 +372,7 @@ namespace korka {
       if (!match(lex_kind::kOpenBrace)) return make_error("Expected '{'");
 
       index_t head = empty_node;
+      index_t tail = empty_node;
 
       while (true) {
         auto tok = peek();
@@ -324,7 +390,8 @@ namespace korka {
         if (!node_res) return node_res;
 
         if (head == empty_node) head = *node_res;
-        else m_pool.append_list(head, *node_res);
+        else m_pool.nodes[tail].next = *node_res;
+        tail = *node_res;
       }
 
       if (!match(lex_kind::kCloseBrace)) return make_error("Expected '}'");
@@ -354,7 +421,18 @@ namespace korka {
           return m_pool.add(expr_binary{"=", var_idx, *right});
         }
       }
-      return parse_logical_or();
+
+      auto left = parse_logical_or();
+      if (!left) return left;
+      // `xs[i] = value` and `r.field = value`
+      bool assignable = std::holds_alternative<expr_index>(m_pool.nodes[*left].data)
+                        || std::holds_alternative<expr_field>(m_pool.nodes[*left].data);
+      if (assignable && match(lex_kind::kEqual)) {
+        auto right = parse_assignment();
+        if (!right) return std::unexpected{right.error()};
+        return m_pool.add(expr_binary{"=", *left, *right});
+      }
+      return left;
     }
 
     constexpr auto parse_logical_or() -> parse_result {
@@ -457,6 +535,17 @@ namespace korka {
           if (auto next = peek(); next && next->kind == lex_kind::kOpenParenthesis) {
             return parse_func_call(id_tok->lexeme);
           }
+          if (match(lex_kind::kOpenBracket)) {
+            auto index = parse_expression();
+            if (!index) return index;
+            if (!match(lex_kind::kCloseBracket)) return make_error("Expected ']' after index");
+            return m_pool.add(expr_index{id_tok->lexeme, *index});
+          }
+          if (match(lex_kind::kDot)) {
+            auto field = parse_id();
+            if (!field) return std::unexpected{field.error()};
+            return m_pool.add(expr_field{id_tok->lexeme, *field});
+          }
           return m_pool.add(expr_var{id_tok->lexeme});
         }
         case lex_kind::kStringLiteral:
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/shared/error.hpp"
+#include "korka/vm/image.hpp"
+#include "korka/vm/verifier.hpp"
+
+namespace korka {
+  /**
+   * On-disk cache of runtime compiled scripts. Entries are images named after a hash of the
+   * source, the compiler version, the image format and the compile options, so a hit is a
+   * single mmap.
+   *
+   * Safe to share a directory between threads and processes: entries are written to a
+   * private temporary file and renamed into place, readers never see a partial file.
+   *
+   * The directory must be trusted. Every entry passes `vm::verify` before it is returned, and
+   * one that does not is recompiled, but a verified image can still hold any program, so
+   * whoever can write the directory decides what runs.
+   */
+  class script_cache {
+  public:
+    explicit script_cache(std::filesystem::path directory, compile_options options = {});
+
+    /**
+     * Maps and verifies the cached image of `source`, compiling and storing it on a miss
+     */
+    auto load(std::string_view source) -> std::expected<vm::verified<vm::mapped_image>, error_t>;
+
+    /**
+     * File the compiled `source` is cached in
+     */
+    auto entry_path(std::string_view source) const -> std::filesystem::path;
+
+    auto hits() const -> std::size_t { return m_hits.load(std::memory_order_relaxed); }
+
+    auto misses() const -> std::size_t { return m_misses.load(std::memory_order_relaxed); }
+
+  private:
+    std::filesystem::path m_directory;
+    compile_options m_options;
+    std::atomic<std::size_t> m_hits{};
+    std::atomic<std::size_t> m_misses{};
+  };
+}
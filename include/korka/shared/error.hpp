@@ -3,6 +3,7 @@
 #include <variant>
 #include "korka/compiler/lex_token.hpp"
 #include "korka/utils/const_format.hpp"
+#include "korka/utils/string.hpp"
 #include <optional>
 
 namespace korka {
@@ -89,6 +90,14 @@ namespace korka {
       return korka::format("Compiler Error: ~", err.message);
     }
 
+    struct other_runtime_error {
+      std::string_view message;
+    };
+
+    constexpr auto report(const other_runtime_error &err) -> std::string {
+      return korka::format("Runtime Error: ~", err.message);
+    }
+
     struct other_error {
       std::string_view message;
     };
@@ -106,6 +115,7 @@ namespace korka {
     error::undefined_symbol,
     error::unknown_type,
     error::other_compiler_error,
+    error::other_runtime_error,
     error::other_error>;
 
   constexpr auto to_string(const error_t &err) -> std::string {
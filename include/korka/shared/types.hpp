@@ -1,12 +1,62 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <span>
+#include <string_view>
 
 namespace korka {
-  enum class type {
+  enum class type : std::uint8_t {
     void_,
-    i64
+    i64,
+    i8, // `char` in scripts, widened to an int on the operand stack
+    f64, // `double` in scripts, kept in full slots as its bit pattern
+    // `int xs[]` and `double xs[]` parameters, the slot points at host memory
+    i64_array,
+    f64_array,
+    str, // `string` in scripts, the slot points at a string record
+    object // struct parameters, the slot points at a host object
   };
 
+  /**
+   * Bytes a local of the type takes in a frame. Locals narrower than a stack slot get an
+   * area of their own, so they are stored at their natural width.
+   */
+  constexpr auto storage_width(type t) -> std::size_t {
+    switch (t) {
+      case type::void_:
+        return 0;
+      case type::i64:
+        return sizeof(std::int64_t);
+      case type::i8:
+        return sizeof(std::int8_t);
+      case type::f64:
+        return sizeof(double);
+      case type::i64_array:
+      case type::f64_array:
+      case type::str:
+      case type::object:
+        return sizeof(std::int64_t);
+    }
+    return 0;
+  }
+
+  constexpr auto is_array(type t) -> bool {
+    return t == type::i64_array || t == type::f64_array;
+  }
+
+  // Slots that point at host memory rather than hold a number
+  constexpr auto is_reference(type t) -> bool {
+    return is_array(t) || t == type::str || t == type::object;
+  }
+
+  constexpr auto element_type(type t) -> type {
+    return t == type::f64_array ? type::f64 : type::i64;
+  }
+
+  constexpr auto is_narrow(type t) -> bool {
+    return storage_width(t) != 0 && storage_width(t) < sizeof(std::int64_t);
+  }
+
   namespace detail {
     template<type>
     struct type_to_cpp_;
@@ -19,6 +69,36 @@ namespace korka {
     struct type_to_cpp_<type::i64> {
       using type = std::int64_t;
     };
+
+    template<>
+    struct type_to_cpp_<type::i8> {
+      using type = std::int8_t;
+    };
+
+    template<>
+    struct type_to_cpp_<type::f64> {
+      using type = double;
+    };
+
+    template<>
+    struct type_to_cpp_<type::i64_array> {
+      using type = std::span<std::int64_t>;
+    };
+
+    template<>
+    struct type_to_cpp_<type::f64_array> {
+      using type = std::span<double>;
+    };
+
+    template<>
+    struct type_to_cpp_<type::str> {
+      using type = std::string_view;
+    };
+
+    template<>
+    struct type_to_cpp_<type::object> {
+      using type = void *;
+    };
   }
 
   template<type T>
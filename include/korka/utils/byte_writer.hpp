@@ -1,8 +1,12 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <concepts>
 #include <vector>
 #include <span>
 #include <cstdint>
+#include <iterator>
 #include <ranges>
 
 namespace korka {
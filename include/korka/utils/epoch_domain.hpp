@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace korka {
+  /**
+   * Epoch based reclamation. Readers pin the current epoch while they use shared objects,
+   * writers retire unlinked objects and they are destroyed once every reader that could
+   * still see them has unpinned.
+   */
+  class epoch_domain {
+  public:
+    static constexpr std::size_t max_readers = 256;
+
+    class guard {
+    public:
+      guard(const guard &) = delete;
+      auto operator=(const guard &) -> guard & = delete;
+
+      guard(guard &&other) noexcept
+        : m_domain(std::exchange(other.m_domain, nullptr)), m_slot(other.m_slot) {}
+
+      ~guard() {
+        if (m_domain) m_domain->unpin(m_slot);
+      }
+
+    private:
+      friend class epoch_domain;
+
+      guard(epoch_domain *domain, std::size_t slot) : m_domain(domain), m_slot(slot) {}
+
+      epoch_domain *m_domain;
+      std::size_t m_slot;
+    };
+
+    epoch_domain() = default;
+    epoch_domain(const epoch_domain &) = delete;
+    auto operator=(const epoch_domain &) -> epoch_domain & = delete;
+
+    ~epoch_domain() {
+      // Nobody can be pinned once the domain dies
+      for (auto &r: m_retired) r.deleter();
+    }
+
+    /**
+     * Shared objects loaded after this stay alive until the guard is gone
+     */
+    auto pin() -> guard {
+      auto start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+      while (true) {
+        for (std::size_t i = 0; i < max_readers; ++i) {
+          auto index = (start + i) % max_readers;
+          auto &s = m_slots[index];
+
+          bool expected = false;
+          if (not s.used.load(std::memory_order_relaxed)
+              && s.used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            // seq_cst orders this against the writer's unlink and scan
+            s.epoch.store(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            return guard{this, index};
+          }
+        }
+        std::this_thread::yield();
+      }
+    }
+
+    /**
+     * Destroys the object once no reader can reach it, call after it was unlinked
+     */
+    auto retire(std::function<void()> deleter) -> void {
+      auto epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+      std::lock_guard lock{m_retired_mutex};
+      m_retired.push_back({epoch, std::move(deleter)});
+    }
+
+    /**
+     * Destroys what is safe to destroy, returns how many objects are still waiting
+     */
+    auto collect() -> std::size_t {
+      auto oldest = oldest_pinned_epoch();
+
+      std::vector<retired> ready;
+      {
+        std::lock_guard lock{m_retired_mutex};
+        auto keep = std::partition(m_retired.begin(), m_retired.end(), [&](const retired &r) {
+          return r.epoch > oldest;
+        });
+        ready.assign(std::make_move_iterator(keep), std::make_move_iterator(m_retired.end()));
+        m_retired.erase(keep, m_retired.end());
+      }
+
+      for (auto &r: ready) r.deleter();
+
+      std::lock_guard lock{m_retired_mutex};
+      return m_retired.size();
+    }
+
+  private:
+    struct alignas(64) slot {
+      std::atomic<std::uint64_t> epoch{}; // 0 while unpinned
+      std::atomic<bool> used{};
+    };
+
+    struct retired {
+      std::uint64_t epoch;
+      std::function<void()> deleter;
+    };
+
+    std::atomic<std::uint64_t> m_epoch{1};
+    std::array<slot, max_readers> m_slots{};
+
+    std::mutex m_retired_mutex;
+    std::vector<retired> m_retired;
+
+    auto unpin(std::size_t index) -> void {
+      auto &s = m_slots[index];
+      s.epoch.store(0, std::memory_order_seq_cst);
+      s.used.store(false, std::memory_order_release);
+    }
+
+    auto oldest_pinned_epoch() const -> std::uint64_t {
+      auto oldest = std::numeric_limits<std::uint64_t>::max();
+      for (auto &s: m_slots) {
+        auto e = s.epoch.load(std::memory_order_seq_cst);
+        if (e != 0) oldest = std::min(oldest, e);
+      }
+      return oldest;
+    }
+  };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include "korka/vm/options.hpp"
+
+namespace korka::vm {
+  /**
+   * Host memory that `int xs[]` and `double xs[]` parameters index in place, nothing is copied.
+   * The argument slot holds a pointer to the view, so the view and the memory behind it have
+   * to outlive the call, or the coroutine that took it, and keep their size meanwhile.
+   *
+   *   std::vector<double> prices = load();
+   *   vm::array_view view{std::span{prices}};
+   *   vm.execute(*program, "total", {vm::array_arg(view)});
+   *
+   * Nothing checks that an argument slot really holds a view, or that its element type
+   * matches the parameter: passing one is up to the host, like binding natives.
+   */
+  struct array_view {
+    std::byte *data{};
+    std::size_t size{};
+
+    array_view() = default;
+
+    explicit array_view(std::span<std::int64_t> values)
+      : data(reinterpret_cast<std::byte *>(values.data())), size(values.size()) {}
+
+    explicit array_view(std::span<double> values)
+      : data(reinterpret_cast<std::byte *>(values.data())), size(values.size()) {}
+  };
+
+  inline auto array_arg(const array_view &view) -> stack_value_t {
+    return static_cast<stack_value_t>(reinterpret_cast<std::intptr_t>(&view));
+  }
+
+  inline auto as_array(stack_value_t slot) -> const array_view & {
+    return *reinterpret_cast<const array_view *>(static_cast<std::intptr_t>(slot));
+  }
+
+  // Negative indices wrap around to huge ones, one compare covers both ends
+  inline auto array_in_bounds(const array_view &array, stack_value_t index) -> bool {
+    return static_cast<std::uint64_t>(index) < array.size;
+  }
+
+  // Elements are read and written as their bit pattern, doubles as well as ints
+  inline auto array_load(const array_view &array, stack_value_t index) -> stack_value_t {
+    stack_value_t value;
+    std::memcpy(&value, array.data + static_cast<std::size_t>(index) * sizeof(stack_value_t), sizeof(value));
+    return value;
+  }
+
+  inline auto array_store(const array_view &array, stack_value_t index, stack_value_t value) -> void {
+    std::memcpy(array.data + static_cast<std::size_t>(index) * sizeof(stack_value_t), &value, sizeof(value));
+  }
+}
@@ -1,10 +1,19 @@
+#pragma once
+
 #include "korka/utils/byte_writer.hpp"
 #include "korka/utils/utils.hpp"
+#include "korka/shared/flat_map.hpp"
 #include "korka/shared/types.hpp"
 #include "op_codes.hpp"
 #include "options.hpp"
-#include <cstdlib>
+#include "strings.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace korka::vm {
   class bytecode_builder {
@@ -14,11 +23,20 @@ namespace korka::vm {
     };
 
   public:
+    constexpr bytecode_builder() = default;
+
+    constexpr explicit bytecode_builder(instruction_encoding encoding) : m_encoding(encoding) {}
+
+    constexpr auto encoding() const -> instruction_encoding {
+      return m_encoding;
+    }
+
     constexpr auto new_reg() -> reg_id_t {
       return m_next_reg++;
     }
 
     constexpr auto make_label() -> label {
+      m_label_pos.push_back(unbound_label);
       return {next_label++};
     }
 
@@ -26,37 +44,173 @@ namespace korka::vm {
      * Saves the label on the next byte
      */
     constexpr auto bind_label(const label &l) -> auto {
-      m_label_pos.emplace_back(l, m_data.data().size());
+      m_label_pos[l.id] = static_cast<int>(m_data.data().size());
     }
 
-    constexpr auto resolve_label(const label &label_) -> std::optional<int> {
-      for (auto &&[l, i]: m_label_pos) {
-        if (l.id == label_.id)
-          return i;
+    constexpr auto resolve_label(const label &label_) const -> std::optional<int> {
+      if (label_.id < 0 || static_cast<std::size_t>(label_.id) >= m_label_pos.size()
+          || m_label_pos[label_.id] == unbound_label) {
+        return std::nullopt;
       }
-      return std::nullopt;
+      return m_label_pos[label_.id];
     }
 
     // ops
 
     constexpr auto emit_op(op_code code) -> std::size_t {
+      if (m_encoding == instruction_encoding::words) {
+        return m_last_op_pos = m_data.write(pack_word(code, 0));
+      }
       return m_last_op_pos = m_data.write<op_code_size>(static_cast<int>(code));
     }
 
+    /**
+     * An op with its operand, in whichever form the encoding uses
+     */
+    template<std::integral T>
+    constexpr auto emit_op(op_code code, T operand) -> std::size_t {
+      if (m_encoding == instruction_encoding::words) {
+        return m_last_op_pos = m_data.write(pack_word(code, static_cast<std::int64_t>(operand)));
+      }
+      auto pos = emit_op(code);
+      m_data.write_many(operand);
+      return pos;
+    }
+
     constexpr auto emit_load_local(local_index_t index) {
-      emit_op(op_code::lload);
-      m_data.write_many(index);
+      emit_op(op_code::lload, index);
     }
 
     constexpr auto emit_save_local(local_index_t index) {
-      emit_op(op_code::lsave);
-      m_data.write_many(index);
+      emit_op(op_code::lsave, index);
+    }
+
+    // Index into the narrow area of the frame
+    constexpr auto emit_load_local_i8(local_index_t index) {
+      emit_op(op_code::lload_i8, index);
+    }
+
+    constexpr auto emit_save_local_i8(local_index_t index) {
+      emit_op(op_code::lsave_i8, index);
+    }
+
+    // Element of the array in the local, `checked` off where the index is known to be in range
+    constexpr auto emit_array_load(local_index_t index, bool checked) {
+      emit_op(checked ? op_code::aload : op_code::aload_u, index);
+    }
+
+    constexpr auto emit_array_save(local_index_t index, bool checked) {
+      emit_op(checked ? op_code::asave : op_code::asave_u, index);
+    }
+
+    constexpr auto emit_array_size(local_index_t index) {
+      emit_op(op_code::alen, index);
+    }
+
+    // Field of the object on the stack, `narrow` for char fields
+    constexpr auto emit_field_load(field_offset_t offset, bool narrow) {
+      emit_op(narrow ? op_code::fload_i8 : op_code::fload, offset);
+    }
+
+    constexpr auto emit_field_save(field_offset_t offset, bool narrow) {
+      emit_op(narrow ? op_code::fsave_i8 : op_code::fsave, offset);
+    }
+
+    constexpr auto emit_param_load(std::uint8_t count) {
+      emit_op(op_code::pload, count);
+    }
+
+    constexpr auto emit_call(function_index_t index) {
+      emit_op(op_code::call, index);
+    }
+
+    constexpr auto emit_call_native(function_index_t index) {
+      emit_op(op_code::call_native, index);
     }
 
     template<korka::type Type>
     constexpr auto emit_const(const type_to_cpp_t<Type> &value) {
-      emit_op(get_const_op_by_type<Type>());
-      m_data.write_many(value);
+      if constexpr (Type == korka::type::i64) {
+        emit_i64_const(value);
+      } else if constexpr (Type == korka::type::f64) {
+        // Doubles are pushed as their bit pattern, 0.0 and small patterns get the short forms
+        emit_i64_const(std::bit_cast<std::int64_t>(value));
+      } else {
+        emit_op(get_const_op_by_type<Type>());
+        m_data.write_many(value);
+      }
+    }
+
+    /**
+     * Picks the shortest encoding: a dedicated op, a narrow immediate or the constant pool
+     */
+    constexpr auto emit_i64_const(std::int64_t value) {
+      if (value == 0) {
+        emit_op(op_code::i64_const_0);
+      } else if (value == 1) {
+        emit_op(op_code::i64_const_1);
+      } else if (std::in_range<std::int8_t>(value)) {
+        emit_op(op_code::i64_const_i8, static_cast<std::int8_t>(value));
+      } else if (std::in_range<std::int16_t>(value)) {
+        emit_op(op_code::i64_const_i16, static_cast<std::int16_t>(value));
+      } else if (auto index = pool_constant(value)) {
+        if (m_encoding == instruction_encoding::words) {
+          emit_op(op_code::i64_const_pool, *index);
+        } else {
+          emit_op(op_code::i64_const_pool, static_cast<constant_index_t>(*index));
+        }
+      } else if (m_encoding == instruction_encoding::bytes) {
+        emit_op(op_code::i64_const, value);
+      } else {
+        // 2^24 distinct wide constants, there is no room left to encode this one
+        fail("Constant pool is full");
+      }
+    }
+
+    /**
+     * Pushes the record of the text, every occurrence of a text shares one record.
+     * False if the constant pool has no room for its offset.
+     */
+    constexpr auto emit_string_const(std::string_view text) -> bool {
+      std::size_t offset;
+      if (auto it = m_string_offsets.find(text); it != m_string_offsets.end()) {
+        offset = it->second;
+      } else {
+        offset = append_string(m_strings, text);
+        m_string_offsets.insert(text, offset);
+      }
+
+      auto index = pool_constant(static_cast<stack_value_t>(offset));
+      if (not index) return false;
+      if (m_encoding == instruction_encoding::words) {
+        emit_op(op_code::str_const, *index);
+      } else {
+        emit_op(op_code::str_const, static_cast<constant_index_t>(*index));
+      }
+      return true;
+    }
+
+    /**
+     * Records of the string literals, str_const refers to them by offset
+     */
+    constexpr auto strings() const -> const std::vector<std::byte> & {
+      return m_strings;
+    }
+
+    /**
+     * Why the code cannot be encoded, empty if it can. Emits and `build` record the first
+     * reason instead of stopping: a full constant pool in the word encoding, a jump out of
+     * reach or a jump to a label that was never bound.
+     */
+    constexpr auto failure() const -> std::optional<std::string_view> {
+      return m_failure;
+    }
+
+    /**
+     * Deduplicated constant pool, indexed by i64_const_pool
+     */
+    constexpr auto constants() const -> const std::vector<stack_value_t> & {
+      return m_constants;
     }
 
     // --- JUMPS ---
@@ -71,43 +225,166 @@ namespace korka::vm {
 //      record_jump(op_code::jmp_if, target, cond);
 //    }
 
+    /**
+     * Resolves the jumps and returns the code. Jumps are emitted in the long form and relaxed
+     * to the short one here wherever the offset fits in a byte; labels are moved along, so
+     * `resolve_label` gives final positions afterwards.
+     */
     constexpr auto build() -> std::vector<std::byte> {
-      auto data = m_data.data();
+      if (m_encoding == instruction_encoding::words) {
+        return build_words();
+      }
+
+      const auto &data = m_data.data();
+      constexpr int long_size = op_code_size + sizeof(jump_offset);
+      constexpr int shrink = sizeof(jump_offset) - sizeof(short_jump_offset);
+
       for (auto &&j: m_jumps) {
-        auto label_pos = resolve_label(j.target);
-        if (not label_pos) {
-          std::abort();
+        if (not resolve_label(j.target)) {
+          fail("Jump to an unbound label");
+          return {};
         }
-        int target_pc = *label_pos;
-        jump_offset offset = target_pc - j.instr_index;
+      }
+
+      // Jumps are recorded in code order, so the bytes saved before a position are a prefix count
+      std::vector<bool> is_short(m_jumps.size(), true);
+      std::vector<int> shorts_before(m_jumps.size() + 1);
+      auto new_pos = [&](int pos) {
+        auto it = std::lower_bound(m_jumps.begin(), m_jumps.end(), pos,
+                                   [](const pending_jump &j, int p) { return j.instr_index < p; });
+        return pos - shrink * shorts_before[static_cast<std::size_t>(it - m_jumps.begin())];
+      };
 
-        std::ranges::copy(
-          std::bit_cast<std::array<std::byte, sizeof(offset)>>(offset),
-          std::begin(data) + j.instr_index + op_code_size);
+      // Growing a jump can only push others out of range, so this settles
+      for (bool changed = true; changed;) {
+        changed = false;
+        for (std::size_t i = 0; i < m_jumps.size(); ++i) {
+          shorts_before[i + 1] = shorts_before[i] + (is_short[i] ? 1 : 0);
+        }
+        for (std::size_t i = 0; i < m_jumps.size(); ++i) {
+          auto offset = new_pos(*resolve_label(m_jumps[i].target)) - new_pos(m_jumps[i].instr_index);
+          if (is_short[i] && not std::in_range<short_jump_offset>(offset)) {
+            is_short[i] = false;
+            changed = true;
+          }
+        }
       }
 
-      return data;
+      std::vector<std::byte> out;
+      out.reserve(data.size());
+      int copied = 0;
+      for (std::size_t i = 0; i < m_jumps.size(); ++i) {
+        const auto &j = m_jumps[i];
+        out.insert(out.end(), data.begin() + copied, data.begin() + j.instr_index);
+        copied = j.instr_index + long_size;
+
+        auto op = static_cast<op_code>(data[static_cast<std::size_t>(j.instr_index)]);
+        auto offset = new_pos(*resolve_label(j.target)) - new_pos(j.instr_index);
+        if (is_short[i]) {
+          out.push_back(static_cast<std::byte>(op == op_code::jmp ? op_code::jmp_s : op_code::jmpz_s));
+          out.push_back(std::bit_cast<std::byte>(static_cast<short_jump_offset>(offset)));
+        } else {
+          out.push_back(static_cast<std::byte>(op));
+          std::ranges::copy(std::bit_cast<std::array<std::byte, sizeof(jump_offset)>>(offset),
+                            std::back_inserter(out));
+        }
+      }
+      out.insert(out.end(), data.begin() + copied, data.end());
+
+      for (auto &pos: m_label_pos) {
+        if (pos != unbound_label) pos = new_pos(pos);
+      }
+      m_jumps.clear();
+      m_data.data() = out;
+
+      return out;
     }
 
   private:
+    static constexpr auto pack_word(op_code code, std::int64_t operand) -> instruction_word {
+      constexpr auto mask = (instruction_word{1} << word_operand_bits) - 1;
+      return static_cast<instruction_word>(code) | (static_cast<instruction_word>(operand) & mask) << 8;
+    }
+
+    /**
+     * Word encoded jumps are one word either way, they only need their offsets filled in
+     */
+    constexpr auto build_words() -> std::vector<std::byte> {
+      auto &data = m_data.data();
+      for (auto &&j: m_jumps) {
+        auto target = resolve_label(j.target);
+        if (not target) {
+          fail("Jump to an unbound label");
+          return {};
+        }
+
+        auto offset = *target - j.instr_index;
+        if (offset < -(1 << (word_operand_bits - 1)) || offset >= (1 << (word_operand_bits - 1))) {
+          fail("Jump is out of reach of the word encoding");
+          return {};
+        }
+
+        auto word_at = data.begin() + j.instr_index;
+        std::array<std::byte, sizeof(instruction_word)> word{};
+        std::ranges::copy_n(word_at, word.size(), word.begin());
+        auto op = static_cast<op_code>(std::bit_cast<instruction_word>(word) & 0xff);
+        std::ranges::copy(std::bit_cast<std::array<std::byte, sizeof(instruction_word)>>(pack_word(op, offset)),
+                          word_at);
+      }
+      m_jumps.clear();
+      return data;
+    }
+
     struct pending_jump {
       jump_offset instr_index;
       label target;
     };
 
+    instruction_encoding m_encoding{instruction_encoding::bytes};
     byte_writer m_data;
     reg_id_t m_next_reg{};
     int next_label{};
     std::size_t m_last_op_pos{};
 
     std::vector<pending_jump> m_jumps;
-    std::vector<std::pair<label, int>> m_label_pos;
+
+    // Bound position of every label, indexed by label id
+    static constexpr int unbound_label = -1;
+    std::vector<int> m_label_pos;
+
+    std::vector<stack_value_t> m_constants;
+    flat_map<stack_value_t, word_constant_index_t> m_constant_index;
+
+    std::vector<std::byte> m_strings;
+    flat_map<std::string_view, std::size_t> m_string_offsets;
+
+    std::optional<std::string_view> m_failure;
+
+    constexpr auto fail(std::string_view reason) -> void {
+      if (not m_failure) m_failure = reason;
+    }
+
+    constexpr auto pool_constant(stack_value_t value) -> std::optional<word_constant_index_t> {
+      if (auto it = m_constant_index.find(value); it != m_constant_index.end()) {
+        return it->second;
+      }
+
+      auto limit = m_encoding == instruction_encoding::words
+                   ? std::size_t{1} << word_operand_bits
+                   : std::size_t{1} << (8 * sizeof(constant_index_t));
+      if (m_constants.size() >= limit) {
+        return std::nullopt;
+      }
+      auto index = static_cast<word_constant_index_t>(m_constants.size());
+      m_constants.push_back(value);
+      m_constant_index.insert(value, index);
+      return index;
+    }
 
     constexpr auto
     record_jump(op_code op, const label &label_) -> void {
-      auto index = emit_op(op);
-      m_data.write_many(jump_offset{});
-      m_jumps.emplace_back(index, label_);
+      auto index = emit_op(op, jump_offset{});
+      m_jumps.emplace_back(static_cast<jump_offset>(index), label_);
     }
   };
 
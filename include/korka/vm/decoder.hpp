@@ -0,0 +1,332 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <span>
+#include "korka/vm/op_codes.hpp"
+#include "korka/vm/program.hpp"
+
+namespace korka::vm {
+  /**
+   * One decoded instruction, for tools that walk bytecode (verification, relinking).
+   * The interpreter decodes inline and does not go through here.
+   */
+  struct instruction {
+    op_code op;
+    std::size_t offset;    // of the op code
+    std::size_t size;      // op code and operand, a whole word in the word encoding
+    std::int64_t operand;  // sign or zero extended, 0 if there is none
+  };
+
+  /**
+   * Bytes of the operand that follows the op code, nullopt for unknown op codes
+   */
+  constexpr auto operand_size(op_code op) -> std::optional<std::size_t> {
+    switch (op) {
+      case op_code::lload:
+      case op_code::lsave:
+      case op_code::lload_i8:
+      case op_code::lsave_i8:
+      case op_code::aload:
+      case op_code::asave:
+      case op_code::aload_u:
+      case op_code::asave_u:
+      case op_code::alen:
+        return sizeof(local_index_t);
+      case op_code::pload:
+        return sizeof(std::uint8_t);
+      case op_code::fload:
+      case op_code::fsave:
+      case op_code::fload_i8:
+      case op_code::fsave_i8:
+        return sizeof(field_offset_t);
+      case op_code::i64_const:
+        return sizeof(std::int64_t);
+      case op_code::i64_const_i8:
+        return sizeof(std::int8_t);
+      case op_code::i64_const_i16:
+        return sizeof(std::int16_t);
+      case op_code::i64_const_pool:
+      case op_code::str_const:
+        return sizeof(constant_index_t);
+      case op_code::jmp:
+      case op_code::jmpz:
+        return sizeof(jump_offset);
+      case op_code::jmp_s:
+      case op_code::jmpz_s:
+        return sizeof(short_jump_offset);
+      case op_code::call:
+      case op_code::call_native:
+        return sizeof(function_index_t);
+      case op_code::i64_const_0:
+      case op_code::i64_const_1:
+      case op_code::pop:
+      case op_code::i64_add:
+      case op_code::i64_sub:
+      case op_code::i64_mul:
+      case op_code::i64_div:
+      case op_code::ret:
+      case op_code::ret_void:
+      case op_code::yield:
+      case op_code::f64_add:
+      case op_code::f64_sub:
+      case op_code::f64_mul:
+      case op_code::f64_div:
+      case op_code::f64_eq:
+      case op_code::f64_ne:
+      case op_code::f64_lt:
+      case op_code::f64_le:
+      case op_code::f64_gt:
+      case op_code::f64_ge:
+      case op_code::i64_to_f64:
+      case op_code::f64_to_i64:
+      case op_code::i64_eq:
+      case op_code::i64_ne:
+      case op_code::i64_lt:
+      case op_code::i64_le:
+      case op_code::i64_gt:
+      case op_code::i64_ge:
+      case op_code::str_eq:
+      case op_code::str_ne:
+        return 0;
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * Operand of a word encoded instruction, read back as its byte form type
+   */
+  template<class T>
+  constexpr auto word_operand(instruction_word word) -> T {
+    if constexpr (std::is_signed_v<T>) {
+      return static_cast<T>(static_cast<std::int32_t>(word) >> 8);
+    } else {
+      return static_cast<T>(word >> 8);
+    }
+  }
+
+  namespace detail {
+    template<class T>
+    constexpr auto read_operand(std::span<const std::byte> code, std::size_t pos) -> std::int64_t {
+      std::array<std::byte, sizeof(T)> bytes{};
+      for (std::size_t i = 0; i < sizeof(T); ++i) bytes[i] = code[pos + i];
+      return static_cast<std::int64_t>(std::bit_cast<T>(bytes));
+    }
+
+    constexpr auto decode_word(std::span<const std::byte> code, std::size_t pc) -> std::optional<instruction> {
+      if (pc % sizeof(instruction_word) != 0 || pc + sizeof(instruction_word) > code.size()) return std::nullopt;
+
+      auto word = static_cast<instruction_word>(read_operand<instruction_word>(code, pc));
+      auto op = static_cast<op_code>(word & 0xff);
+      if (not operand_size(op) || op == op_code::i64_const) return std::nullopt;
+
+      std::int64_t operand{};
+      switch (op) {
+        case op_code::lload:
+        case op_code::lsave:
+        case op_code::lload_i8:
+        case op_code::lsave_i8:
+        case op_code::aload:
+        case op_code::asave:
+        case op_code::aload_u:
+        case op_code::asave_u:
+        case op_code::alen:
+          operand = word_operand<local_index_t>(word);
+          break;
+        case op_code::pload:
+          operand = word_operand<std::uint8_t>(word);
+          break;
+        case op_code::fload:
+        case op_code::fsave:
+        case op_code::fload_i8:
+        case op_code::fsave_i8:
+          operand = word_operand<field_offset_t>(word);
+          break;
+        case op_code::i64_const_i8:
+          operand = word_operand<std::int8_t>(word);
+          break;
+        case op_code::i64_const_i16:
+          operand = word_operand<std::int16_t>(word);
+          break;
+        case op_code::i64_const_pool:
+        case op_code::str_const:
+          operand = word >> 8;
+          break;
+        case op_code::jmp:
+        case op_code::jmpz:
+          operand = word_operand<jump_offset>(word);
+          break;
+        case op_code::jmp_s:
+        case op_code::jmpz_s:
+          operand = word_operand<short_jump_offset>(word);
+          break;
+        case op_code::call:
+        case op_code::call_native:
+          operand = word_operand<function_index_t>(word);
+          break;
+        default:
+          break;
+      }
+      return instruction{op, pc, sizeof(instruction_word), operand};
+    }
+  }
+
+  /**
+   * Stack slots an instruction pops and pushes
+   */
+  struct stack_effect {
+    std::int64_t pops;
+    std::int64_t pushes;
+  };
+
+  /**
+   * Calls take the effect from the signature of the callee in `functions`
+   */
+  constexpr auto effect_of(const instruction &instr, std::span<const function_entry> functions) -> stack_effect {
+    switch (instr.op) {
+      case op_code::lload:
+      case op_code::lload_i8:
+      case op_code::alen:
+      case op_code::i64_const:
+      case op_code::i64_const_0:
+      case op_code::i64_const_1:
+      case op_code::i64_const_i8:
+      case op_code::i64_const_i16:
+      case op_code::i64_const_pool:
+      case op_code::str_const:
+        return {0, 1};
+      case op_code::lsave:
+      case op_code::lsave_i8:
+      case op_code::pop:
+      case op_code::jmpz:
+      case op_code::jmpz_s:
+      case op_code::ret:
+      case op_code::yield:
+        return {1, 0};
+      case op_code::pload:
+        return {instr.operand, 0};
+      case op_code::i64_add:
+      case op_code::i64_sub:
+      case op_code::i64_mul:
+      case op_code::i64_div:
+      case op_code::f64_add:
+      case op_code::f64_sub:
+      case op_code::f64_mul:
+      case op_code::f64_div:
+      case op_code::f64_eq:
+      case op_code::f64_ne:
+      case op_code::f64_lt:
+      case op_code::f64_le:
+      case op_code::f64_gt:
+      case op_code::f64_ge:
+      case op_code::i64_eq:
+      case op_code::i64_ne:
+      case op_code::i64_lt:
+      case op_code::i64_le:
+      case op_code::i64_gt:
+      case op_code::i64_ge:
+      case op_code::str_eq:
+      case op_code::str_ne:
+        return {2, 1};
+      case op_code::i64_to_f64:
+      case op_code::f64_to_i64:
+      case op_code::aload:
+      case op_code::aload_u:
+      case op_code::fload:
+      case op_code::fload_i8:
+        return {1, 1};
+      case op_code::asave:
+      case op_code::asave_u:
+      case op_code::fsave:
+      case op_code::fsave_i8:
+        return {2, 0};
+      case op_code::call:
+      case op_code::call_native: {
+        const auto &callee = functions[static_cast<std::size_t>(instr.operand)];
+        return {callee.param_count, callee.return_type == type::void_ ? 0 : 1};
+      }
+      case op_code::jmp:
+      case op_code::jmp_s:
+      case op_code::ret_void:
+        return {0, 0};
+    }
+    return {0, 0};
+  }
+
+  constexpr auto is_jump(op_code op) -> bool {
+    return op == op_code::jmp || op == op_code::jmpz || op == op_code::jmp_s || op == op_code::jmpz_s;
+  }
+
+  /**
+   * Decodes the instruction at `pc`, nullopt if it is unknown or runs past the code
+   */
+  constexpr auto decode(std::span<const std::byte> code, std::size_t pc,
+                        instruction_encoding encoding = instruction_encoding::bytes) -> std::optional<instruction> {
+    if (encoding == instruction_encoding::words) {
+      return detail::decode_word(code, pc);
+    }
+    if (pc + op_code_size > code.size()) return std::nullopt;
+
+    auto op = static_cast<op_code>(code[pc]);
+    auto size = operand_size(op);
+    if (not size || pc + op_code_size + *size > code.size()) return std::nullopt;
+
+    auto pos = pc + op_code_size;
+    std::int64_t operand{};
+    switch (op) {
+      case op_code::lload:
+      case op_code::lsave:
+      case op_code::lload_i8:
+      case op_code::lsave_i8:
+      case op_code::aload:
+      case op_code::asave:
+      case op_code::aload_u:
+      case op_code::asave_u:
+      case op_code::alen:
+        operand = detail::read_operand<local_index_t>(code, pos);
+        break;
+      case op_code::pload:
+        operand = detail::read_operand<std::uint8_t>(code, pos);
+        break;
+      case op_code::fload:
+      case op_code::fsave:
+      case op_code::fload_i8:
+      case op_code::fsave_i8:
+        operand = detail::read_operand<field_offset_t>(code, pos);
+        break;
+      case op_code::i64_const:
+        operand = detail::read_operand<std::int64_t>(code, pos);
+        break;
+      case op_code::i64_const_i8:
+        operand = detail::read_operand<std::int8_t>(code, pos);
+        break;
+      case op_code::i64_const_i16:
+        operand = detail::read_operand<std::int16_t>(code, pos);
+        break;
+      case op_code::i64_const_pool:
+      case op_code::str_const:
+        operand = detail::read_operand<constant_index_t>(code, pos);
+        break;
+      case op_code::jmp:
+      case op_code::jmpz:
+        operand = detail::read_operand<jump_offset>(code, pos);
+        break;
+      case op_code::jmp_s:
+      case op_code::jmpz_s:
+        operand = detail::read_operand<short_jump_offset>(code, pos);
+        break;
+      case op_code::call:
+      case op_code::call_native:
+        operand = detail::read_operand<function_index_t>(code, pos);
+        break;
+      default:
+        break;
+    }
+
+    return instruction{op, pc, op_code_size + *size, operand};
+  }
+}
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <expected>
+#include <span>
+#include <string_view>
+#include "korka/shared/error.hpp"
+#include "korka/utils/string.hpp"
+#include "korka/vm/arrays.hpp"
+#include "korka/vm/decoder.hpp"
+#include "korka/vm/f64.hpp"
+#include "korka/vm/op_codes.hpp"
+#include "korka/vm/program.hpp"
+#include "korka/vm/strings.hpp"
+#include "korka/vm/structs.hpp"
+#include "korka/vm/vm_runtime.hpp"
+
+namespace korka {
+  /**
+   * Slots an embedded run keeps on the native stack, from the compiler's worst case
+   */
+  struct embed_bounds {
+    std::size_t stack;
+    std::size_t locals;
+    std::size_t frames;
+    std::size_t narrow{}; // bytes
+  };
+
+  namespace detail {
+    template<class T>
+    auto embed_read(std::span<const std::byte> code, std::size_t &pc) -> T {
+      T value;
+      std::memcpy(&value, code.data() + pc, sizeof(T));
+      pc += sizeof(T);
+      return value;
+    }
+
+    template<vm::instruction_encoding Encoding>
+    auto embed_fetch(std::span<const std::byte> code, std::size_t &pc, vm::instruction_word &word) -> vm::op_code {
+      if constexpr (Encoding == vm::instruction_encoding::words) {
+        word = embed_read<vm::instruction_word>(code, pc);
+        return static_cast<vm::op_code>(word & 0xff);
+      } else {
+        return static_cast<vm::op_code>(embed_read<std::uint8_t>(code, pc));
+      }
+    }
+
+    template<class T, vm::instruction_encoding Encoding>
+    auto embed_operand(std::span<const std::byte> code, std::size_t &pc, vm::instruction_word word) -> T {
+      if constexpr (Encoding == vm::instruction_encoding::words) {
+        return vm::word_operand<T>(word);
+      } else {
+        return embed_read<T>(code, pc);
+      }
+    }
+
+    template<embed_bounds Bounds, vm::instruction_encoding Encoding>
+    auto run_embed(const vm::program_view &program, std::size_t function,
+                   std::span<const vm::stack_value_t> args) -> runtime::result_t {
+      using vm::op_code;
+      auto fail = [](std::string_view message) {
+        return std::unexpected<error_t>{error::other_runtime_error{message}};
+      };
+      auto wrap = [](std::uint64_t v) { return static_cast<vm::stack_value_t>(v); };
+
+      // Left uninitialized, every slot is written before it is read
+      std::array<vm::stack_value_t, Bounds.stack> stack;
+      std::array<vm::stack_value_t, Bounds.locals> locals;
+      std::array<vm::call_frame, Bounds.frames> frames;
+      std::array<std::int8_t, Bounds.narrow> narrow;
+
+      const auto code = program.code;
+      const auto &first = program.functions[function];
+      std::size_t pc = first.offset;
+      std::size_t sp = args.size();
+      std::size_t depth = 1;
+      std::size_t locals_base = 0;
+      std::size_t locals_top = first.locals_count;
+      std::size_t narrow_base = 0;
+      std::size_t narrow_top = first.narrow_size;
+      std::ranges::copy(args, stack.begin());
+      std::fill_n(locals.begin(), first.locals_count, 0);
+      std::fill_n(narrow.begin(), first.narrow_size, 0);
+      frames[0] = {.return_pc = 0, .stack_base = 0, .locals_base = 0, .function = function, .narrow_base = 0};
+
+      while (true) {
+        auto instr_pc = pc;
+        vm::instruction_word word{};
+        auto op = embed_fetch<Encoding>(code, pc, word);
+        switch (op) {
+          case op_code::lload:
+            stack[sp++] = locals[locals_base + embed_operand<vm::local_index_t, Encoding>(code, pc, word)];
+            break;
+          case op_code::lsave:
+            locals[locals_base + embed_operand<vm::local_index_t, Encoding>(code, pc, word)] = stack[--sp];
+            break;
+          case op_code::pload: {
+            auto count = embed_operand<std::uint8_t, Encoding>(code, pc, word);
+            sp -= count;
+            std::copy_n(stack.begin() + static_cast<std::ptrdiff_t>(sp), count,
+                        locals.begin() + static_cast<std::ptrdiff_t>(locals_base));
+            break;
+          }
+          case op_code::lload_i8:
+            stack[sp++] = narrow[narrow_base + embed_operand<vm::local_index_t, Encoding>(code, pc, word)];
+            break;
+          case op_code::lsave_i8:
+            narrow[narrow_base + embed_operand<vm::local_index_t, Encoding>(code, pc, word)] =
+              static_cast<std::int8_t>(stack[--sp]);
+            break;
+          case op_code::i64_const:
+            stack[sp++] = embed_read<std::int64_t>(code, pc);
+            break;
+          case op_code::i64_const_0:
+            stack[sp++] = 0;
+            break;
+          case op_code::i64_const_1:
+            stack[sp++] = 1;
+            break;
+          case op_code::i64_const_i8:
+            stack[sp++] = embed_operand<std::int8_t, Encoding>(code, pc, word);
+            break;
+          case op_code::i64_const_i16:
+            stack[sp++] = embed_operand<std::int16_t, Encoding>(code, pc, word);
+            break;
+          case op_code::i64_const_pool:
+            if constexpr (Encoding == vm::instruction_encoding::words) {
+              stack[sp++] = program.constants[word >> 8];
+            } else {
+              stack[sp++] = program.constants[embed_read<vm::constant_index_t>(code, pc)];
+            }
+            break;
+          case op_code::str_const: {
+            std::size_t index;
+            if constexpr (Encoding == vm::instruction_encoding::words) {
+              index = word >> 8;
+            } else {
+              index = embed_read<vm::constant_index_t>(code, pc);
+            }
+            stack[sp++] = vm::string_at(program.strings, program.constants[index]);
+            break;
+          }
+          case op_code::pop:
+            --sp;
+            break;
+
+          case op_code::i64_add:
+          case op_code::i64_sub:
+          case op_code::i64_mul:
+          case op_code::i64_div: {
+            auto a = stack[--sp];
+            auto b = stack[sp - 1];
+            auto ua = static_cast<std::uint64_t>(a), ub = static_cast<std::uint64_t>(b);
+
+            vm::stack_value_t c{};
+            if (op == op_code::i64_add) c = wrap(ub + ua);
+            else if (op == op_code::i64_sub) c = wrap(ub - ua);
+            else if (op == op_code::i64_mul) c = wrap(ub * ua);
+            else {
+              if (a == 0) return fail("Division by zero");
+              c = (a == -1) ? wrap(0 - ub) : b / a;
+            }
+            stack[sp - 1] = c;
+            break;
+          }
+
+          case op_code::f64_add:
+          case op_code::f64_sub:
+          case op_code::f64_mul:
+          case op_code::f64_div:
+          case op_code::f64_eq:
+          case op_code::f64_ne:
+          case op_code::f64_lt:
+          case op_code::f64_le:
+          case op_code::f64_gt:
+          case op_code::f64_ge: {
+            auto a = vm::as_f64(stack[--sp]);
+            stack[sp - 1] = vm::f64_binary(op, vm::as_f64(stack[sp - 1]), a);
+            break;
+          }
+          case op_code::i64_to_f64:
+            stack[sp - 1] = vm::from_f64(static_cast<double>(stack[sp - 1]));
+            break;
+          case op_code::f64_to_i64:
+            stack[sp - 1] = vm::f64_to_i64(vm::as_f64(stack[sp - 1]));
+            break;
+
+          case op_code::i64_eq:
+          case op_code::i64_ne:
+          case op_code::i64_lt:
+          case op_code::i64_le:
+          case op_code::i64_gt:
+          case op_code::i64_ge: {
+            auto a = stack[--sp];
+            stack[sp - 1] = vm::i64_compare(op, stack[sp - 1], a);
+            break;
+          }
+
+          case op_code::str_eq:
+          case op_code::str_ne: {
+            auto a = stack[--sp];
+            stack[sp - 1] = vm::strings_equal(program.strings, stack[sp - 1], a) == (op == op_code::str_eq);
+            break;
+          }
+
+          case op_code::aload:
+          case op_code::aload_u: {
+            const auto &array = vm::as_array(locals[locals_base + embed_operand<vm::local_index_t, Encoding>(code, pc, word)]);
+            auto i = stack[sp - 1];
+            if ((op == op_code::aload || not program.proven_bounds) && not vm::array_in_bounds(array, i)) {
+              return fail("Array index out of range");
+            }
+            stack[sp - 1] = vm::array_load(array, i);
+            break;
+          }
+          case op_code::asave:
+          case op_code::asave_u: {
+            const auto &array = vm::as_array(locals[locals_base + embed_operand<vm::local_index_t, Encoding>(code, pc, word)]);
+            auto value = stack[--sp];
+            auto i = stack[--sp];
+            if ((op == op_code::asave || not program.proven_bounds) && not vm::array_in_bounds(array, i)) {
+              return fail("Array index out of range");
+            }
+            vm::array_store(array, i, value);
+            break;
+          }
+          case op_code::alen:
+            stack[sp++] = static_cast<vm::stack_value_t>(
+              vm::as_array(locals[locals_base + embed_operand<vm::local_index_t, Encoding>(code, pc, word)]).size);
+            break;
+
+          case op_code::fload:
+          case op_code::fload_i8: {
+            auto offset = embed_operand<vm::field_offset_t, Encoding>(code, pc, word);
+            auto object = stack[sp - 1];
+            stack[sp - 1] = op == op_code::fload ? vm::field_load(object, offset) : vm::field_load_i8(object, offset);
+            break;
+          }
+          case op_code::fsave:
+          case op_code::fsave_i8: {
+            auto offset = embed_operand<vm::field_offset_t, Encoding>(code, pc, word);
+            auto value = stack[--sp];
+            auto object = stack[--sp];
+            if (op == op_code::fsave) {
+              vm::field_store(object, offset, value);
+            } else {
+              vm::field_store_i8(object, offset, value);
+            }
+            break;
+          }
+
+          case op_code::jmp:
+          case op_code::jmpz: {
+            auto offset = embed_operand<vm::jump_offset, Encoding>(code, pc, word);
+            if (op == op_code::jmp || stack[--sp] == 0) {
+              pc = instr_pc + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(offset));
+            }
+            break;
+          }
+          case op_code::jmp_s:
+          case op_code::jmpz_s: {
+            auto offset = embed_operand<vm::short_jump_offset, Encoding>(code, pc, word);
+            if (op == op_code::jmp_s || stack[--sp] == 0) {
+              pc = instr_pc + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(offset));
+            }
+            break;
+          }
+
+          case op_code::call: {
+            auto index = embed_operand<vm::function_index_t, Encoding>(code, pc, word);
+            const auto &callee = program.functions[index];
+            frames[depth++] = {
+              .return_pc = pc,
+              .stack_base = sp - callee.param_count,
+              .locals_base = locals_top,
+              .function = index,
+              .narrow_base = narrow_top
+            };
+            locals_base = locals_top;
+            locals_top += callee.locals_count;
+            narrow_base = narrow_top;
+            narrow_top += callee.narrow_size;
+            std::fill_n(locals.begin() + static_cast<std::ptrdiff_t>(locals_base), callee.locals_count, 0);
+            std::fill_n(narrow.begin() + static_cast<std::ptrdiff_t>(narrow_base), callee.narrow_size, 0);
+            pc = callee.offset;
+            break;
+          }
+
+          case op_code::ret:
+          case op_code::ret_void: {
+            const auto &f = frames[--depth];
+            auto value = op == op_code::ret ? stack[sp - 1] : 0;
+            if (depth == 0) {
+              return value;
+            }
+
+            sp = f.stack_base;
+            if (op == op_code::ret) stack[sp++] = value;
+            locals_top = f.locals_base;
+            locals_base = frames[depth - 1].locals_base;
+            narrow_top = f.narrow_base;
+            narrow_base = frames[depth - 1].narrow_base;
+            pc = f.return_pc;
+            break;
+          }
+
+          case op_code::yield:
+            return fail("Yield outside of a coroutine");
+          case op_code::call_native:
+            return fail("Unbound native function");
+
+          default:
+            return fail("Unknown op code");
+        }
+      }
+    }
+  }
+
+  /**
+   * Runs a function with its stacks in fixed size arrays on the native stack: nothing is
+   * allocated and the code is not checked against the bounds, they must cover the worst case
+   * of the function. Meant for code the compiler produced; division by zero is still
+   * reported, natives and `yield` fail.
+   */
+  template<embed_bounds Bounds>
+  auto run_embed(const vm::program_view &program, std::size_t function,
+                 std::span<const vm::stack_value_t> args) -> runtime::result_t {
+    if (function >= program.functions.size() || vm::is_native(program.functions[function])) {
+      return std::unexpected<error_t>{error::other_runtime_error{"Function index out of range"}};
+    }
+    if (args.size() != program.functions[function].param_count) {
+      return std::unexpected<error_t>{error::other_runtime_error{"Argument count mismatch"}};
+    }
+    auto params = vm::params_of(program, program.functions[function]);
+    for (std::size_t i = 0; i < params.size(); ++i) {
+      if (is_array(params[i].type) && args[i] == 0) {
+        return std::unexpected<error_t>{error::other_runtime_error{"Array argument is missing"}};
+      }
+      if (params[i].type == type::str && args[i] == 0) {
+        return std::unexpected<error_t>{error::other_runtime_error{"String argument is missing"}};
+      }
+      if (params[i].type == type::object && args[i] == 0) {
+        return std::unexpected<error_t>{error::other_runtime_error{"Object argument is missing"}};
+      }
+    }
+    if (program.encoding == vm::instruction_encoding::words) {
+      return detail::run_embed<Bounds, vm::instruction_encoding::words>(program, function, args);
+    }
+    return detail::run_embed<Bounds, vm::instruction_encoding::bytes>(program, function, args);
+  }
+
+  /**
+   * `korka::run_embed<compiled, "score">(a, b)` sizes the arrays from what `compile` worked out
+   * for the function, which has to be free of recursion.
+   */
+  template<const auto &Compiled, const_string Function, std::convertible_to<vm::stack_value_t>... Args>
+  auto run_embed(Args... args) -> runtime::result_t {
+    constexpr auto info = Compiled.functions.at(std::string_view{Function});
+    static_assert(info.bounded, "Recursive functions have no worst case stack, run them on a runtime");
+    static_assert(sizeof...(Args) == info.param_count, "Argument count mismatch");
+
+    constexpr embed_bounds bounds{info.total_stack, info.total_locals, info.total_frames, info.total_narrow};
+    std::array<vm::stack_value_t, sizeof...(Args)> values{static_cast<vm::stack_value_t>(args)...};
+    return run_embed<bounds>(Compiled.view(), info.index, values);
+  }
+}
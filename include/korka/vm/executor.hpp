@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+#include "korka/vm/program.hpp"
+#include "korka/vm/vm_runtime.hpp"
+
+namespace korka {
+  /**
+   * Fixed pool of worker threads for many short, independent invocations. Every worker owns a
+   * runtime and a deque of tasks: it takes its own work from the back and, once that runs out,
+   * steals from the front of the others. Tasks submitted from a worker stay on its deque.
+   *
+   *   executor pool;
+   *   auto score = pool.submit(program, "score", {a, b});
+   *   pool.submit(program, "log", {id}, [](runtime::result_t r) { ... });
+   *
+   * Programs must outlive the tasks submitted for them.
+   */
+  class executor {
+  public:
+    using callback_t = std::function<void(runtime::result_t)>;
+
+    explicit executor(std::size_t threads = std::thread::hardware_concurrency());
+
+    executor(const executor &) = delete;
+    auto operator=(const executor &) -> executor & = delete;
+
+    /**
+     * Runs every task that was already submitted, then stops the workers
+     */
+    ~executor();
+
+    auto submit(const vm::program_view &program, std::size_t function,
+                std::span<const vm::stack_value_t> args) -> std::future<runtime::result_t>;
+
+    /**
+     * `done` is called on the worker that ran the task
+     */
+    auto submit(const vm::program_view &program, std::size_t function,
+                std::span<const vm::stack_value_t> args, callback_t done) -> void;
+
+    template<vm::executable Program>
+    auto submit(const Program &program, std::string_view function,
+                std::span<const vm::stack_value_t> args) -> std::future<runtime::result_t> {
+      auto index = program.find(function);
+      if (not index) {
+        std::promise<runtime::result_t> failed;
+        failed.set_value(std::unexpected{error::undefined_symbol{.identifier = function}});
+        return failed.get_future();
+      }
+      return submit(program.view(), *index, args);
+    }
+
+    template<vm::executable Program>
+    auto submit(const Program &program, std::string_view function,
+                std::span<const vm::stack_value_t> args, callback_t done) -> void {
+      auto index = program.find(function);
+      if (not index) {
+        done(std::unexpected{error::undefined_symbol{.identifier = function}});
+        return;
+      }
+      submit(program.view(), *index, args, std::move(done));
+    }
+
+    template<vm::executable Program>
+    auto submit(const Program &program, std::string_view function,
+                std::initializer_list<vm::stack_value_t> args = {}) -> std::future<runtime::result_t> {
+      return submit(program, function, std::span{args.begin(), args.size()});
+    }
+
+    template<vm::executable Program>
+    auto submit(const Program &program, std::string_view function,
+                std::initializer_list<vm::stack_value_t> args, callback_t done) -> void {
+      submit(program, function, std::span{args.begin(), args.size()}, std::move(done));
+    }
+
+    auto thread_count() const -> std::size_t { return m_worker_count; }
+
+    /**
+     * Tasks a worker took from another worker's deque
+     */
+    auto steals() const -> std::size_t { return m_steals.load(std::memory_order_relaxed); }
+
+  private:
+    struct task {
+      vm::program_view program;
+      std::size_t function;
+      std::vector<vm::stack_value_t> args;
+      std::variant<std::promise<runtime::result_t>, callback_t> done;
+    };
+
+    struct alignas(64) worker {
+      std::mutex mutex;
+      std::deque<task> tasks;
+      runtime vm;
+      std::thread thread;
+    };
+
+    std::size_t m_worker_count;
+    std::unique_ptr<worker[]> m_workers;
+
+    // Submitted but not yet taken by a worker, read by workers before they go to sleep
+    alignas(64) std::atomic<std::size_t> m_pending{};
+    alignas(64) std::atomic<std::size_t> m_sleeping{};
+    alignas(64) std::atomic<std::size_t> m_next{};
+    alignas(64) std::atomic<std::size_t> m_steals{};
+
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping{};
+
+    auto push(task t) -> void;
+
+    auto take(std::size_t self) -> std::optional<task>;
+
+    auto work(std::size_t self) -> void;
+  };
+}
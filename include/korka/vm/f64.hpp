@@ -0,0 +1,62 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include "korka/vm/op_codes.hpp"
+#include "korka/vm/options.hpp"
+
+namespace korka::vm {
+  /**
+   * f64 values live in stack slots and locals as their bit pattern, nothing tags them.
+   * Hosts pass `double` arguments through `from_f64` and read results with `as_f64`.
+   */
+  constexpr auto from_f64(double value) -> stack_value_t {
+    return std::bit_cast<stack_value_t>(value);
+  }
+
+  constexpr auto as_f64(stack_value_t value) -> double {
+    return std::bit_cast<double>(value);
+  }
+
+  /**
+   * Truncates toward zero like a C++ cast, but out of range values saturate and NaN gives 0
+   */
+  constexpr auto f64_to_i64(double value) -> stack_value_t {
+    constexpr double limit = 9223372036854775808.0; // 2^63
+    if (value != value) return 0;
+    if (value >= limit) return std::numeric_limits<stack_value_t>::max();
+    if (value < -limit) return std::numeric_limits<stack_value_t>::min();
+    return static_cast<stack_value_t>(value);
+  }
+
+  /**
+   * B op A for the binary f64 ops, comparisons give 0 or 1
+   */
+  constexpr auto f64_binary(op_code op, double b, double a) -> stack_value_t {
+    switch (op) {
+      case op_code::f64_add:
+        return from_f64(b + a);
+      case op_code::f64_sub:
+        return from_f64(b - a);
+      case op_code::f64_mul:
+        return from_f64(b * a);
+      case op_code::f64_div:
+        return from_f64(b / a);
+      case op_code::f64_eq:
+        return b == a;
+      case op_code::f64_ne:
+        return b != a;
+      case op_code::f64_lt:
+        return b < a;
+      case op_code::f64_le:
+        return b <= a;
+      case op_code::f64_gt:
+        return b > a;
+      case op_code::f64_ge:
+        return b >= a;
+      default:
+        return 0;
+    }
+  }
+}
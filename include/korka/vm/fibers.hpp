@@ -0,0 +1,128 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "korka/vm/program.hpp"
+#include "korka/vm/vm_runtime.hpp"
+
+namespace korka {
+  /**
+   * Green threads for scripts. Fibers are coroutines on a shared run queue: a step resumes one
+   * fiber until its next `yield` and puts it back at the end of the queue, so thousands of
+   * fibers take turns on a few runtimes. A suspended fiber only keeps its own frames, and
+   * its stacks start at the size it needs and grow by copying when they overflow.
+   *
+   * Without threads the host drives the queue with `run`, with threads the workers do.
+   * A fiber that calls an asynchronous native leaves the queue until the call completes and
+   * goes on from there on whichever thread picks it up next.
+   * With a fuel budget, fibers that run too long without yielding are preempted as well:
+   *
+   *   fiber_scheduler fibers{4, 10'000};
+   *   fibers.spawn(program, "session", {id}, [](runtime::result_t r) { ... });
+   *
+   * Programs must outlive their fibers.
+   */
+  class fiber_scheduler {
+  public:
+    using callback_t = std::function<void(runtime::result_t)>;
+
+    explicit fiber_scheduler(std::size_t threads = 0, std::uint64_t fuel = runtime::unlimited_fuel);
+
+    fiber_scheduler(const fiber_scheduler &) = delete;
+    auto operator=(const fiber_scheduler &) -> fiber_scheduler & = delete;
+
+    /**
+     * Waits for the native calls fibers are suspended in, then stops the workers. Fibers that
+     * did not finish are dropped without their callbacks.
+     */
+    ~fiber_scheduler();
+
+    /**
+     * Queues a new fiber, it runs up to its first `yield` on its first step. `done` gets the
+     * return value or the error.
+     */
+    auto spawn(const vm::program_view &program, std::size_t function,
+               std::span<const vm::stack_value_t> args, callback_t done = {}) -> void;
+
+    template<vm::executable Program>
+    auto spawn(const Program &program, std::string_view function,
+               std::span<const vm::stack_value_t> args, callback_t done = {}) -> void {
+      auto index = program.find(function);
+      if (not index) {
+        if (done) done(std::unexpected{error::undefined_symbol{.identifier = function}});
+        return;
+      }
+      spawn(program.view(), *index, args, std::move(done));
+    }
+
+    template<vm::executable Program>
+    auto spawn(const Program &program, std::string_view function,
+               std::initializer_list<vm::stack_value_t> args, callback_t done = {}) -> void {
+      spawn(program, function, std::span{args.begin(), args.size()}, std::move(done));
+    }
+
+    /**
+     * Runs up to `max_steps` steps on the calling thread, returns how many it ran.
+     * Fibers spawned from callbacks join the end of the queue.
+     */
+    auto run(std::size_t max_steps = SIZE_MAX) -> std::size_t;
+
+    /**
+     * Blocks until a fiber suspended in a native call can run again, or none is suspended
+     */
+    auto wait() -> void;
+
+    /**
+     * Fibers that have not finished yet
+     */
+    auto active() const -> std::size_t;
+
+  private:
+    struct fiber {
+      coroutine co;
+      vm::program_view program;
+      std::size_t function{};
+      std::vector<vm::stack_value_t> args; // until the first step
+      callback_t done;
+      bool started{};
+    };
+
+    enum class step_result {
+      finished,
+      runnable,
+      waiting // on a native call
+    };
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_woken; // a waiting fiber is back in the queue
+    std::deque<fiber> m_queue;
+    std::size_t m_running{}; // taken off the queue by a step
+    std::size_t m_waiting{}; // suspended in native calls
+    bool m_stopping{};
+
+    std::uint64_t m_fuel;
+    runtime m_vm; // for `run`
+    std::vector<std::thread> m_workers;
+
+    // Resumes the fiber once
+    static auto step(runtime &vm, fiber &f) -> step_result;
+
+    // Puts the fiber back where the step left it, `m_running` still counts it
+    auto requeue(fiber f, step_result result) -> void;
+
+    auto push(fiber f) -> void;
+
+    auto work() -> void;
+  };
+}
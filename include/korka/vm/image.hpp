@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "korka/shared/error.hpp"
+#include "korka/vm/program.hpp"
+
+namespace korka::vm {
+  /**
+   * On-disk container for compiled programs. Everything the interpreter touches is stored
+   * in its in-memory layout, so a loaded image is executed right from the mapped file.
+   *
+   * <header>
+   * <function_entry[count]>    function table, 24-byte rows
+   * <image_function[count]>    names of the table rows
+   * <u32[count]>               table indices sorted by name, for lookups
+   * <param_entry[]>            parameter rows of all functions, back to back
+   * <char[]>                   names
+   * <stack_value_t[]>          constant pool
+   * <byte[]>                   string records
+   * <byte[]>                   code, cache line aligned
+   *
+   * Sections are addressed by offsets from the start of the file.
+   */
+  inline constexpr std::array<char, 8> image_magic{'K', 'O', 'R', 'K', 'A', 'I', 'M', 'G'};
+  inline constexpr std::uint32_t image_version = 6;
+  inline constexpr std::uint32_t image_byte_order = 0x01020304;
+  inline constexpr std::size_t image_code_alignment = 64;
+
+  struct image_section {
+    std::uint64_t offset;
+    std::uint64_t size; // bytes
+  };
+
+  struct image_header {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t file_size;
+    std::uint32_t function_count;
+    instruction_encoding encoding;
+    std::uint8_t reserved[3];
+
+    image_section functions;
+    image_section function_info;
+    image_section by_name;
+    image_section params;
+    image_section names;
+    image_section constants;
+    image_section strings;
+    image_section code;
+  };
+
+  struct image_function {
+    std::uint32_t name_offset;
+    std::uint32_t name_size;
+    std::uint32_t params_offset; // same as the row's function_entry::params
+    std::uint32_t reserved;
+  };
+
+  /**
+   * Serializes the program into the image format
+   */
+  auto write_image(const program &p) -> std::vector<std::byte>;
+
+  auto save_image(const program &p, const std::filesystem::path &path) -> std::expected<void, error_t>;
+
+  /**
+   * Validated, non-owning view of an image. Checking it costs the same for any image size,
+   * nothing is copied or decoded.
+   */
+  class image_view {
+  public:
+    static auto from_bytes(std::span<const std::byte> bytes) -> std::expected<image_view, error_t>;
+
+    auto view() const -> program_view {
+      return {m_code, m_functions, m_constants, m_encoding, nullptr, m_strings, m_params};
+    }
+
+    auto find(std::string_view name) const -> std::optional<std::size_t>;
+
+    auto function_count() const -> std::size_t { return m_functions.size(); }
+
+    auto function_name(std::size_t index) const -> std::string_view;
+
+    auto param_types(std::size_t index) const -> std::span<const param_entry>;
+
+  private:
+    std::span<const function_entry> m_functions;
+    std::span<const image_function> m_info;
+    std::span<const std::uint32_t> m_by_name;
+    std::span<const param_entry> m_params;
+    std::string_view m_names;
+    std::span<const stack_value_t> m_constants;
+    std::span<const std::byte> m_strings;
+    std::span<const std::byte> m_code;
+    instruction_encoding m_encoding{};
+  };
+
+  /**
+   * Read-only shared mapping of an image file, pages are shared by every process mapping it
+   */
+  class mapped_image {
+  public:
+    static auto open(const std::filesystem::path &path) -> std::expected<mapped_image, error_t>;
+
+    mapped_image(const mapped_image &) = delete;
+    auto operator=(const mapped_image &) -> mapped_image & = delete;
+
+    mapped_image(mapped_image &&other) noexcept;
+    auto operator=(mapped_image &&other) noexcept -> mapped_image &;
+
+    ~mapped_image();
+
+    auto image() const -> const image_view & { return m_image; }
+
+    auto view() const -> program_view { return m_image.view(); }
+
+    auto find(std::string_view name) const -> std::optional<std::size_t> { return m_image.find(name); }
+
+  private:
+    mapped_image() = default;
+
+    auto unmap() -> void;
+
+    void *m_data{};
+    std::size_t m_size{};
+    image_view m_image;
+
+    // Fallback for platforms without mmap
+    std::vector<std::byte> m_buffer;
+  };
+}
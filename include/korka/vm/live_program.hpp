@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <expected>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include "korka/shared/error.hpp"
+#include "korka/utils/epoch_domain.hpp"
+#include "korka/vm/program.hpp"
+
+namespace korka {
+  /**
+   * A program whose functions can be replaced while other threads are running it.
+   *
+   * Every invocation runs on an immutable snapshot: `acquire` pins the current one, swaps
+   * publish a new snapshot atomically and retire the old one, which is destroyed once no
+   * pinned invocation can still be inside it. Calls started after a swap see the new code,
+   * invocations already running finish on the snapshot they started with.
+   *
+   *   runtime vm;
+   *   vm.execute(live.acquire(), "update", {dt});
+   */
+  class live_program {
+  public:
+    class pinned {
+    public:
+      auto view() const -> vm::program_view { return m_program->view(); }
+
+      auto find(std::string_view name) const -> std::optional<std::size_t> { return m_program->find(name); }
+
+      auto get() const -> const program & { return *m_program; }
+
+    private:
+      friend class live_program;
+
+      pinned(epoch_domain::guard guard, const program *p) : m_guard(std::move(guard)), m_program(p) {}
+
+      epoch_domain::guard m_guard;
+      const program *m_program;
+    };
+
+    explicit live_program(program initial);
+
+    live_program(const live_program &) = delete;
+    auto operator=(const live_program &) -> live_program & = delete;
+
+    ~live_program();
+
+    /**
+     * Current snapshot, stays valid while the returned object lives
+     */
+    auto acquire() const -> pinned;
+
+    /**
+     * Replaces the whole program
+     */
+    auto publish(program next) -> void;
+
+    /**
+     * Replaces the bytecode of function `name` with the one from `source`. The signature has to
+     * stay the same, and every function it calls has to exist here with the same signature.
+     */
+    auto replace_function(std::string_view name, const program &source) -> std::expected<void, error_t>;
+
+    /**
+     * Destroys retired snapshots nobody uses anymore, returns how many are still waiting
+     */
+    auto collect() -> std::size_t;
+
+  private:
+    mutable epoch_domain m_epochs;
+    std::atomic<const program *> m_current;
+    std::mutex m_writer_mutex;
+  };
+}
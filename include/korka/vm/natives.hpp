@@ -0,0 +1,128 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "korka/shared/error.hpp"
+#include "korka/vm/program.hpp"
+
+namespace korka::vm {
+  /**
+   * Result slot of one asynchronous native call, shared by the call handle and whoever waits
+   */
+  class native_state {
+  public:
+    auto complete(stack_value_t value) -> void;
+
+    auto ready() const -> bool;
+
+    // Blocks until the call completed
+    auto wait() -> stack_value_t;
+
+    // Calls `wake` once the call completed, right away if it already has
+    auto on_ready(std::function<void()> wake) -> void;
+
+    // Only valid once ready
+    auto value() const -> stack_value_t { return m_value; }
+
+  private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_done;
+    std::function<void()> m_wake;
+    stack_value_t m_value{};
+    bool m_ready{};
+  };
+
+  /**
+   * Handed to an asynchronous native, it calls `complete` exactly once, from any thread.
+   * Void natives complete without a value.
+   */
+  class native_call {
+  public:
+    explicit native_call(std::shared_ptr<native_state> state) : m_state(std::move(state)) {}
+
+    auto complete(stack_value_t value = 0) const -> void { m_state->complete(value); }
+
+  private:
+    std::shared_ptr<native_state> m_state;
+  };
+
+  /**
+   * A host function bound to a native row. Arguments are only valid during the call and
+   * natives must not call back into the runtime that called them.
+   */
+  struct native_function {
+    using sync_t = std::function<stack_value_t(std::span<const stack_value_t>)>;
+    using async_t = std::function<void(std::span<const stack_value_t>, native_call)>;
+
+    sync_t sync;
+    async_t async;
+
+    auto bound() const -> bool { return sync || async; }
+  };
+
+  /**
+   * A program with host functions bound to the natives it declares, `int fetch(int id);`
+   * in the script. Natives that are left unbound fail when they are called.
+   *
+   *   linked<program> app{std::move(*compiled)};
+   *   app.bind("clamp", [](auto args) { return std::min<stack_value_t>(args[0], 100); });
+   *   app.bind_async("fetch", [&](auto args, native_call done) { db.get(args[0], done); });
+   *
+   * Asynchronous natives suspend coroutines and fibers until they complete, plain calls
+   * block on them.
+   */
+  template<executable Program>
+  class linked {
+  public:
+    explicit linked(Program program)
+      : m_program(std::move(program)), m_natives(m_program.view().functions.size()) {}
+
+    auto bind(std::string_view name, native_function::sync_t fn) -> std::expected<void, error_t> {
+      auto index = native_index(name);
+      if (not index) return std::unexpected{index.error()};
+      m_natives[*index] = {.sync = std::move(fn), .async{}};
+      return {};
+    }
+
+    auto bind_async(std::string_view name, native_function::async_t fn) -> std::expected<void, error_t> {
+      auto index = native_index(name);
+      if (not index) return std::unexpected{index.error()};
+      m_natives[*index] = {.sync{}, .async = std::move(fn)};
+      return {};
+    }
+
+    auto view() const -> program_view {
+      auto view = m_program.view();
+      view.natives = m_natives.data();
+      return view;
+    }
+
+    auto find(std::string_view name) const -> std::optional<std::size_t> { return m_program.find(name); }
+
+    auto get() const -> const Program & { return m_program; }
+
+  private:
+    Program m_program;
+    std::vector<native_function> m_natives;
+
+    auto native_index(std::string_view name) const -> std::expected<std::size_t, error_t> {
+      auto index = m_program.find(name);
+      if (not index) {
+        return std::unexpected{error::undefined_symbol{.identifier = name}};
+      }
+      if (not is_native(m_program.view().functions[*index])) {
+        return std::unexpected{error::other_error{"Only native functions can be bound"}};
+      }
+      return *index;
+    }
+  };
+}
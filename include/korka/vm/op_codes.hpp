@@ -1,11 +1,21 @@
 #pragma once
 
 #include <cstdint>
+#include <expected>
+#include <string_view>
+#include <variant>
 #include "korka/shared/types.hpp"
+#include "korka/shared/error.hpp"
+#include "korka/utils/overloaded.hpp"
+#include "korka/vm/options.hpp"
 
 namespace korka::vm {
   using local_index_t = std::uint8_t;
   using jump_offset = std::int32_t;
+  using function_index_t = std::uint16_t;
+  using constant_index_t = std::uint16_t;
+  using short_jump_offset = std::int8_t;
+  using field_offset_t = std::uint16_t;
 
   enum class op_code {
     // --- Memory & Stack ---
@@ -24,6 +34,17 @@ namespace korka::vm {
     // Pushes a value onto the stack
     i64_const, // <op><i64:8>
 
+    // Compact forms of i64_const, the builder picks the shortest one
+    i64_const_0, // <op>
+    i64_const_1, // <op>
+    i64_const_i8, // <op><i8:1>, sign extended
+    i64_const_i16, // <op><i16:2>, sign extended
+    i64_const_pool, // <op><constant_index_t>, value from the constant pool
+
+    // Drops the value on top of the stack
+    // <op>
+    pop,
+
     // --- Math ---
     // Order:
     // A = pop() # first on stack
@@ -41,9 +62,107 @@ namespace korka::vm {
     // // <op><jump_address>
     jmp, // jumps no matter what
     jmpz, // pops value and jumps if it's zero
+    // <op><short_jump_offset>, used when the offset fits in a byte
+    jmp_s,
+    jmpz_s,
+
+    // - Calls -
+    // Arguments are pushed left to right, the callee takes them with pload
+    // <op><function_index_t>
+    call,
 
     // - Other -
-    ret
+    // Pops the return value, leaves the frame and pushes the value for the caller
+    ret,
+    // Leaves the frame of a void function
+    ret_void,
+
+    // - Coroutines -
+    // Pops a value and suspends the invocation, the host gets the value.
+    // Resuming continues with the next instruction
+    // <op>
+    yield,
+
+    // - Host -
+    // Calls a native row of the function table, arguments are passed like for `call`.
+    // An asynchronous native suspends a coroutine until it completes
+    // <op><function_index_t>
+    call_native,
+
+    // - Narrow locals -
+    // Locals narrower than a slot live in a byte area of the frame with indices of their own.
+    // Loads sign extend to a full slot, saves keep the low bits
+    // <op><local_index_t>
+    lload_i8,
+    lsave_i8,
+
+    // --- f64 ---
+    // Same operand order as the i64 math, on the bit patterns of doubles. Division by zero
+    // follows IEEE 754 and does not trap
+    // <op>
+    f64_add,
+    f64_sub,
+    f64_mul,
+    f64_div,
+
+    // Push 1 if `B op A` holds, else 0
+    // <op>
+    f64_eq,
+    f64_ne,
+    f64_lt,
+    f64_le,
+    f64_gt,
+    f64_ge,
+
+    // Convert the value on top of the stack, f64_to_i64 truncates and saturates, NaN gives 0
+    // <op>
+    i64_to_f64,
+    f64_to_i64,
+
+    // --- Comparisons ---
+    // Push 1 if `B op A` holds for the ints, else 0
+    // <op>
+    i64_eq,
+    i64_ne,
+    i64_lt,
+    i64_le,
+    i64_gt,
+    i64_ge,
+
+    // --- Arrays ---
+    // The local holds a pointer to a host `array_view`, elements are full slots.
+    // aload pops the index and pushes the element, asave pops the value and then the index.
+    // Indices out of range are an error, the _u forms skip the check where the compiler
+    // proved it holds
+    // <op><local_index_t>
+    aload,
+    asave,
+    aload_u,
+    asave_u,
+
+    // Push the element count of the array in the local
+    // <op><local_index_t>
+    alen,
+
+    // --- Strings ---
+    // Pushes a pointer to the record in the string pool at the offset the constant pool holds
+    // <op><constant_index_t>
+    str_const,
+
+    // Push 1 if `B op A` holds for the texts, else 0
+    // <op>
+    str_eq,
+    str_ne,
+
+    // --- Structs ---
+    // Fields of host objects, in place. The operand is the byte offset of the field in the
+    // object, a pointer on the stack. fload pops the object and pushes the field, fsave pops
+    // the value and then the object. The _i8 forms sign extend and keep the low byte
+    // <op><field_offset_t>
+    fload,
+    fsave,
+    fload_i8,
+    fsave_i8
   };
 
   template<korka::type Type>
@@ -76,10 +195,56 @@ namespace korka::vm {
             return op_code::i64_mul;
           if (op == "/")
             return op_code::i64_div;
+          if (op == "==")
+            return op_code::i64_eq;
+          if (op == "!=")
+            return op_code::i64_ne;
+          if (op == "<")
+            return op_code::i64_lt;
+          if (op == "<=")
+            return op_code::i64_le;
+          if (op == ">")
+            return op_code::i64_gt;
+          if (op == ">=")
+            return op_code::i64_ge;
           return std::unexpected{error::other_error{
             .message = "Unsupported math operation for i64"
           }};
         }
+        if (type == korka::type::f64) {
+          if (op == "+")
+            return op_code::f64_add;
+          if (op == "-")
+            return op_code::f64_sub;
+          if (op == "*")
+            return op_code::f64_mul;
+          if (op == "/")
+            return op_code::f64_div;
+          if (op == "==")
+            return op_code::f64_eq;
+          if (op == "!=")
+            return op_code::f64_ne;
+          if (op == "<")
+            return op_code::f64_lt;
+          if (op == "<=")
+            return op_code::f64_le;
+          if (op == ">")
+            return op_code::f64_gt;
+          if (op == ">=")
+            return op_code::f64_ge;
+          return std::unexpected{error::other_error{
+            .message = "Unsupported math operation for f64"
+          }};
+        }
+        if (type == korka::type::str) {
+          if (op == "==")
+            return op_code::str_eq;
+          if (op == "!=")
+            return op_code::str_ne;
+          return std::unexpected{error::other_error{
+            .message = "Strings can only be compared for equality"
+          }};
+        }
         return std::unexpected{error::other_error{
           .message = "Unsupported type for math"
         }};
@@ -93,6 +258,32 @@ namespace korka::vm {
     }, ltype);
   }
 
+  // Comparisons push an int whatever they compare
+  constexpr auto is_comparison(op_code op) -> bool {
+    return (op >= op_code::f64_eq && op <= op_code::f64_ge) || (op >= op_code::i64_eq && op <= op_code::i64_ge)
+           || op == op_code::str_eq || op == op_code::str_ne;
+  }
+
+  // B op A for the int comparisons
+  constexpr auto i64_compare(op_code op, stack_value_t b, stack_value_t a) -> stack_value_t {
+    switch (op) {
+      case op_code::i64_eq:
+        return b == a;
+      case op_code::i64_ne:
+        return b != a;
+      case op_code::i64_lt:
+        return b < a;
+      case op_code::i64_le:
+        return b <= a;
+      case op_code::i64_gt:
+        return b > a;
+      case op_code::i64_ge:
+        return b >= a;
+      default:
+        return 0;
+    }
+  }
+
   constexpr int op_code_size = 1;
 
   template<auto getter>
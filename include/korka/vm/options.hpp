@@ -4,4 +4,24 @@
 namespace korka::vm {
   using reg_id_t = std::uint8_t;
   using stack_value_t = std::int64_t;
+
+  /**
+   * How instructions are laid out in the code.
+   *
+   * bytes: <op:1> followed by the operand in its own width, unaligned.
+   * words: one aligned 32-bit native-endian word per instruction, the op code in the low
+   *        8 bits and the operand in the high 24. Operands are read back as their byte form
+   *        type, sign extended for signed ones. i64_const does not exist here, large values
+   *        go to the constant pool, and jumps are never relaxed.
+   */
+  enum class instruction_encoding : std::uint8_t {
+    bytes,
+    words
+  };
+
+  using instruction_word = std::uint32_t;
+  constexpr int word_operand_bits = 24;
+
+  // The constant pool index is the one operand that uses all 24 bits in the word encoding
+  using word_constant_index_t = std::uint32_t;
 }
\ No newline at end of file
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "korka/shared/types.hpp"
+#include "korka/vm/options.hpp"
+
+namespace korka::vm {
+  /**
+   * A row of the runtime function table, everything the interpreter needs to enter a function.
+   * Rows are stored in declaration order, `call` refers to them by index.
+   */
+  struct function_entry {
+    std::uint32_t offset;       // first instruction
+    std::uint32_t size;         // bytes of code, functions are laid out back to back
+    std::uint16_t param_count;
+    std::uint16_t locals_count; // parameters included
+    korka::type return_type;
+    std::uint8_t flags{};       // function_flags
+    std::uint16_t max_stack{};  // operand stack slots, arguments included, 0 if unknown
+    std::uint16_t narrow_size{}; // bytes of locals narrower than a slot, kept apart from them
+    std::uint16_t reserved{};
+    std::uint32_t params{};     // first row of the parameters in program_view::params
+  };
+
+  /**
+   * What a parameter slot holds. The verifier trusts arguments to match, so references
+   * come in only where the function expects them.
+   */
+  struct param_entry {
+    korka::type type;
+    std::array<std::uint8_t, 3> reserved{};
+    std::uint32_t object_size{}; // bytes of the struct behind an object, fields past it are rejected
+
+    friend constexpr auto operator==(const param_entry &, const param_entry &) -> bool = default;
+  };
+
+  enum function_flags : std::uint8_t {
+    // Declared by the script and provided by the host, the row has no code
+    native_flag = 1 << 0
+  };
+
+  constexpr auto is_native(const function_entry &entry) -> bool {
+    return (entry.flags & native_flag) != 0;
+  }
+
+  struct native_function;
+
+  /**
+   * Non-owning view of an executable program. Compile-time results, runtime compiled
+   * programs and loaded images all hand this to the interpreter.
+   */
+  struct program_view {
+    std::span<const std::byte> code;
+    std::span<const function_entry> functions;
+    std::span<const stack_value_t> constants;
+    instruction_encoding encoding{instruction_encoding::bytes};
+
+    // Host functions indexed like `functions`, null until the program is `linked`
+    const native_function *natives{};
+
+    // Records of the string literals, str_const finds them through the constant pool
+    std::span<const std::byte> strings{};
+
+    // Parameter rows, each function_entry points at its own
+    std::span<const param_entry> params{};
+
+    // Straight from the compiler, whose proofs let `aload_u` and `asave_u` skip the bounds
+    // check. The verifier does not redo them, anywhere else the checks stay
+    bool proven_bounds{};
+  };
+
+  /**
+   * Parameter rows of the function, empty if the table points outside of them
+   */
+  constexpr auto params_of(const program_view &program, const function_entry &entry) -> std::span<const param_entry> {
+    if (entry.params > program.params.size() || entry.param_count > program.params.size() - entry.params) {
+      return {};
+    }
+    return program.params.subspan(entry.params, entry.param_count);
+  }
+
+  /**
+   * Anything the runtime can look functions up in by name and run
+   */
+  template<class T>
+  concept executable = requires(const T &p, std::string_view name) {
+    { p.view() } -> std::same_as<program_view>;
+    { p.find(name) } -> std::same_as<std::optional<std::size_t>>;
+  };
+}
+
+namespace korka {
+  /**
+   * A program compiled at runtime, owns its bytecode and function table.
+   */
+  class program {
+  public:
+    struct function {
+      std::string name;
+      std::vector<type> params;
+      type return_type;
+    };
+
+    program() = default;
+
+    /**
+     * Without `params` the rows come from the parameter types of `functions`. Only the
+     * compiler passes `compiled`, it vouches for the indices `aload_u` and `asave_u` skip.
+     */
+    program(std::vector<std::byte> code, std::vector<vm::function_entry> table, std::vector<function> functions,
+            std::vector<vm::stack_value_t> constants = {},
+            vm::instruction_encoding encoding = vm::instruction_encoding::bytes,
+            std::vector<std::byte> strings = {}, std::vector<vm::param_entry> params = {}, bool compiled = false)
+      : m_code(std::move(code)), m_table(std::move(table)), m_functions(std::move(functions)),
+        m_constants(std::move(constants)), m_encoding(encoding), m_strings(std::move(strings)),
+        m_params(std::move(params)), m_compiled(compiled) {
+      if (m_params.empty()) {
+        for (std::size_t i = 0; i < m_table.size() && i < m_functions.size(); ++i) {
+          m_table[i].params = static_cast<std::uint32_t>(m_params.size());
+          for (auto t: m_functions[i].params) m_params.push_back({t});
+        }
+      }
+      m_by_name.resize(m_functions.size());
+      for (std::size_t i = 0; i < m_by_name.size(); ++i) m_by_name[i] = i;
+      std::ranges::sort(m_by_name, {}, [&](std::size_t i) -> std::string_view { return m_functions[i].name; });
+    }
+
+    auto view() const -> vm::program_view {
+      return {m_code, m_table, m_constants, m_encoding, nullptr, m_strings, m_params, m_compiled};
+    }
+
+    /**
+     * Index of the function in the function table
+     */
+    auto find(std::string_view name) const -> std::optional<std::size_t> {
+      auto it = std::ranges::lower_bound(m_by_name, name, {},
+                                         [&](std::size_t i) -> std::string_view { return m_functions[i].name; });
+      if (it != m_by_name.end() && m_functions[*it].name == name) {
+        return *it;
+      }
+      return std::nullopt;
+    }
+
+    auto code() const -> std::span<const std::byte> { return m_code; }
+
+    auto table() const -> std::span<const vm::function_entry> { return m_table; }
+
+    auto functions() const -> std::span<const function> { return m_functions; }
+
+    auto constants() const -> std::span<const vm::stack_value_t> { return m_constants; }
+
+    auto encoding() const -> vm::instruction_encoding { return m_encoding; }
+
+    auto strings() const -> std::span<const std::byte> { return m_strings; }
+
+    auto params() const -> std::span<const vm::param_entry> { return m_params; }
+
+    auto compiled() const -> bool { return m_compiled; }
+
+  private:
+    std::vector<std::byte> m_code;
+    std::vector<vm::function_entry> m_table;
+    std::vector<function> m_functions;
+    std::vector<vm::stack_value_t> m_constants;
+    vm::instruction_encoding m_encoding{};
+    std::vector<std::byte> m_strings;
+    std::vector<vm::param_entry> m_params;
+    bool m_compiled{};
+
+    // Function indices sorted by name
+    std::vector<std::size_t> m_by_name;
+  };
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include "korka/vm/vm_runtime.hpp"
+
+namespace korka {
+  /**
+   * Lock-free pool of runtimes for threads that share programs. Acquiring pops a warm runtime
+   * off a free list with a single CAS, releasing pushes it back; nothing is allocated on the
+   * way unless every pooled runtime is in use, then the lease gets a fresh one of its own.
+   *
+   *   static runtime_pool pool;
+   *   auto vm = pool.acquire();
+   *   vm->execute(program, "handle", {request_id});
+   */
+  class runtime_pool {
+  public:
+    class lease {
+    public:
+      lease(const lease &) = delete;
+      auto operator=(const lease &) -> lease & = delete;
+
+      lease(lease &&other) noexcept;
+      auto operator=(lease &&other) noexcept -> lease &;
+
+      ~lease();
+
+      auto operator*() const -> runtime & { return *m_runtime; }
+
+      auto operator->() const -> runtime * { return m_runtime; }
+
+    private:
+      friend class runtime_pool;
+
+      lease(runtime_pool *pool, std::uint32_t slot, runtime *vm) : m_pool(pool), m_slot(slot), m_runtime(vm) {}
+
+      auto release() -> void;
+
+      runtime_pool *m_pool;
+      std::uint32_t m_slot;
+      runtime *m_runtime;
+    };
+
+    explicit runtime_pool(std::size_t capacity = std::thread::hardware_concurrency());
+
+    runtime_pool(const runtime_pool &) = delete;
+    auto operator=(const runtime_pool &) -> runtime_pool & = delete;
+
+    /**
+     * Leases must not outlive the pool
+     */
+    auto acquire() -> lease;
+
+    auto capacity() const -> std::size_t { return m_capacity; }
+
+    /**
+     * Acquisitions that found the pool empty
+     */
+    auto overflows() const -> std::size_t { return m_overflows.load(std::memory_order_relaxed); }
+
+  private:
+    static constexpr std::uint32_t no_slot = UINT32_MAX;
+
+    struct alignas(64) slot {
+      runtime vm;
+      std::atomic<std::uint32_t> next{no_slot};
+    };
+
+    std::size_t m_capacity;
+    std::unique_ptr<slot[]> m_slots;
+
+    // Top of the free list in the low half, a counter in the high half against ABA
+    alignas(64) std::atomic<std::uint64_t> m_head{no_slot};
+    alignas(64) std::atomic<std::size_t> m_overflows{};
+
+    auto pop() -> std::uint32_t;
+
+    auto push(std::uint32_t index) -> void;
+  };
+}
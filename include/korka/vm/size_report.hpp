@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <string>
+#include "korka/shared/error.hpp"
+#include "korka/vm/program.hpp"
+
+namespace korka::vm {
+  /**
+   * Where the bytes of a program go, to see what the compact encodings buy
+   */
+  struct size_report {
+    std::size_t code_bytes{};
+    std::size_t constant_pool_bytes{};
+    std::size_t instructions{};
+    std::size_t operand_bytes{};
+
+    std::size_t short_jumps{};
+    std::size_t long_jumps{};
+
+    std::size_t compact_constants{}; // const_0, const_1, i8 and i16 immediates
+    std::size_t pooled_constants{};
+    std::size_t inline_constants{};  // full 8-byte immediates
+  };
+
+  auto report_size(const program_view &program) -> std::expected<size_report, error_t>;
+
+  auto to_string(const size_report &report) -> std::string;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "korka/vm/options.hpp"
+
+namespace korka::vm {
+  /**
+   * Strings live in records: the size as a u64, the characters and a terminating zero.
+   * A `string` slot holds a pointer to a record, so passing one around copies nothing.
+   *
+   * String literals are records in the string pool of the program, one per distinct text.
+   * The pool is part of the image and is never written, natives can keep the views they get
+   * for as long as the program lives.
+   */
+  using string_size_t = std::uint64_t;
+
+  inline constexpr std::size_t string_header_size = sizeof(string_size_t);
+
+  /**
+   * Appends a record for `text` to the pool, returns its offset
+   */
+  constexpr auto append_string(std::vector<std::byte> &pool, std::string_view text) -> std::size_t {
+    auto offset = pool.size();
+    auto header = std::bit_cast<std::array<std::byte, string_header_size>>(static_cast<string_size_t>(text.size()));
+    pool.insert(pool.end(), header.begin(), header.end());
+    for (char c: text) pool.push_back(static_cast<std::byte>(c));
+    pool.push_back(std::byte{0});
+    return offset;
+  }
+
+  /**
+   * Whether a whole record starts at `offset`, for code that did not come from the compiler
+   */
+  inline auto string_in_pool(std::span<const std::byte> pool, stack_value_t offset) -> bool {
+    if (offset < 0 || static_cast<std::uint64_t>(offset) > pool.size()
+        || pool.size() - static_cast<std::size_t>(offset) < string_header_size + 1) {
+      return false;
+    }
+    string_size_t size;
+    std::memcpy(&size, pool.data() + offset, sizeof(size));
+    return size < pool.size() - static_cast<std::size_t>(offset) - string_header_size;
+  }
+
+  inline auto string_at(std::span<const std::byte> pool, stack_value_t offset) -> stack_value_t {
+    return static_cast<stack_value_t>(reinterpret_cast<std::intptr_t>(pool.data() + offset));
+  }
+
+  inline auto as_string(stack_value_t slot) -> std::string_view {
+    const auto *record = reinterpret_cast<const std::byte *>(static_cast<std::intptr_t>(slot));
+    string_size_t size;
+    std::memcpy(&size, record, sizeof(size));
+    return {reinterpret_cast<const char *>(record + string_header_size), static_cast<std::size_t>(size)};
+  }
+
+  /**
+   * The pool holds every text once, so two of its records are equal only if they are the
+   * same record. Strings from the host are compared by their characters.
+   */
+  inline auto strings_equal(std::span<const std::byte> pool, stack_value_t a, stack_value_t b) -> bool {
+    if (a == b) return true;
+
+    auto in_pool = [&](stack_value_t slot) {
+      auto begin = reinterpret_cast<std::uintptr_t>(pool.data());
+      auto address = static_cast<std::uintptr_t>(slot);
+      return address >= begin && address - begin < pool.size();
+    };
+    if (in_pool(a) && in_pool(b)) return false;
+    return as_string(a) == as_string(b);
+  }
+
+  /**
+   * A string the host passes to a script, the text is copied into a record once and the
+   * record can then be passed to any number of calls.
+   *
+   *   vm::host_string name{"orders"};
+   *   vm.execute(*program, "lookup", {vm::string_arg(name)});
+   */
+  class host_string {
+  public:
+    explicit host_string(std::string_view text) {
+      append_string(m_record, text);
+    }
+
+    auto view() const -> std::string_view {
+      return as_string(slot());
+    }
+
+    auto slot() const -> stack_value_t {
+      return static_cast<stack_value_t>(reinterpret_cast<std::intptr_t>(m_record.data()));
+    }
+
+  private:
+    std::vector<std::byte> m_record;
+  };
+
+  inline auto string_arg(const host_string &text) -> stack_value_t {
+    return text.slot();
+  }
+}
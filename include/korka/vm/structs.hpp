@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "korka/shared/types.hpp"
+#include "korka/vm/options.hpp"
+
+namespace korka::vm {
+  struct struct_field {
+    std::string_view name;
+    korka::type type;
+    std::size_t offset;
+
+    constexpr auto operator==(const struct_field &) const -> bool = default;
+  };
+
+  /**
+   * Where the fields of a struct are, in bytes from its start. Scripts declare structs with
+   * `struct request { int id; double price; };` and get the layout a C++ compiler gives the
+   * same members, so a script reads and writes a host object in place through a pointer.
+   */
+  struct struct_layout {
+    std::string_view name;
+    std::size_t size{};
+    std::size_t alignment{1};
+    std::vector<struct_field> fields;
+
+    constexpr auto find(std::string_view field) const -> const struct_field * {
+      auto it = std::ranges::find(fields, field, &struct_field::name);
+      return it == fields.end() ? nullptr : &*it;
+    }
+  };
+
+  /**
+   * Places the next field at the first offset its alignment allows, like a C++ compiler does
+   * for standard layout types. Every field type is aligned to its width.
+   */
+  constexpr auto append_field(struct_layout &layout, std::string_view name, korka::type t) -> void {
+    auto width = storage_width(t);
+    auto offset = (layout.size + width - 1) / width * width;
+    layout.fields.push_back({name, t, offset});
+    layout.size = offset + width;
+    layout.alignment = std::max(layout.alignment, width);
+  }
+
+  // Trailing padding, so arrays of the struct keep every element aligned
+  constexpr auto finish_layout(struct_layout &layout) -> void {
+    layout.size = (layout.size + layout.alignment - 1) / layout.alignment * layout.alignment;
+  }
+
+  namespace detail {
+    template<class M>
+    constexpr auto field_type() -> korka::type {
+      if constexpr (std::is_same_v<M, std::int64_t>) {
+        return korka::type::i64;
+      } else if constexpr (std::is_same_v<M, double>) {
+        return korka::type::f64;
+      } else if constexpr (std::is_same_v<M, std::int8_t> || std::is_same_v<M, char>) {
+        return korka::type::i8;
+      } else {
+        static_assert(false, "Script fields are int64_t, double or char");
+      }
+    }
+  }
+
+  /**
+   * A member of a registered C++ struct. Only the address of the member in an object that is
+   * never constructed is taken, the same thing `offsetof` does.
+   */
+  template<class T, class M>
+  auto field(std::string_view name, M T::*member) -> struct_field {
+    static_assert(std::is_standard_layout_v<T>, "Only standard layout types have a C compatible layout");
+    union probe {
+      char none;
+      T object;
+
+      probe() : none{} {}
+
+      ~probe() {}
+    } p;
+    auto offset = reinterpret_cast<const std::byte *>(&(p.object.*member))
+                  - reinterpret_cast<const std::byte *>(&p.object);
+    return {name, detail::field_type<M>(), static_cast<std::size_t>(offset)};
+  }
+
+  /**
+   * Registers a C++ struct under the name scripts use. A script that declares the struct
+   * must lay it out the same way or it does not compile; a script that does not declare it
+   * uses the registered fields, which may leave other members out.
+   *
+   *   auto request = vm::layout_of<Request>("request", {
+   *     vm::field("id", &Request::id),
+   *     vm::field("price", &Request::price),
+   *   });
+   *   auto p = korka::compile_runtime(source, {.structs = std::span{&request, 1}});
+   */
+  template<class T>
+  auto layout_of(std::string_view name, std::initializer_list<struct_field> fields) -> struct_layout {
+    return {name, sizeof(T), alignof(T), fields};
+  }
+
+  /**
+   * The argument for a struct parameter. The object is read and written in place, it has to
+   * outlive the call, or the coroutine that took it.
+   */
+  template<class T>
+  auto object_arg(T &object) -> stack_value_t {
+    return static_cast<stack_value_t>(reinterpret_cast<std::intptr_t>(&object));
+  }
+
+  inline auto field_address(stack_value_t object, std::size_t offset) -> std::byte * {
+    return reinterpret_cast<std::byte *>(static_cast<std::intptr_t>(object)) + offset;
+  }
+
+  // Full width fields are read and written as their bit pattern, doubles as well as ints
+  inline auto field_load(stack_value_t object, std::size_t offset) -> stack_value_t {
+    stack_value_t value;
+    std::memcpy(&value, field_address(object, offset), sizeof(value));
+    return value;
+  }
+
+  inline auto field_store(stack_value_t object, std::size_t offset, stack_value_t value) -> void {
+    std::memcpy(field_address(object, offset), &value, sizeof(value));
+  }
+
+  inline auto field_load_i8(stack_value_t object, std::size_t offset) -> stack_value_t {
+    std::int8_t value;
+    std::memcpy(&value, field_address(object, offset), sizeof(value));
+    return value;
+  }
+
+  inline auto field_store_i8(stack_value_t object, std::size_t offset, stack_value_t value) -> void {
+    auto narrow = static_cast<std::int8_t>(value);
+    std::memcpy(field_address(object, offset), &narrow, sizeof(narrow));
+  }
+}
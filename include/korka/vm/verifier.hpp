@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "korka/shared/error.hpp"
+#include "korka/vm/program.hpp"
+
+namespace korka::vm {
+  /**
+   * Facts the verifier proved about one function
+   */
+  struct function_facts {
+    std::uint32_t max_stack; // operand stack slots, arguments included
+    // Past a leading `pload` of every parameter, where the verified loop enters the function
+    // with the arguments already in place as its first locals. 0 if the code has none.
+    std::uint32_t body_offset{};
+  };
+
+  /**
+   * Checks the program once, so the interpreter can run it without per-instruction checks:
+   * - every function lies inside the code and decodes into known instructions
+   * - jumps land on instruction boundaries inside their function
+   * - local operands are below the frame size of their area, calls refer to existing functions
+   * - the stack depth is the same on every path into an instruction and never underflows
+   * - array ops only reach arrays the caller passed in: every slot has a kind joined over the
+   *   paths, array parameters are never overwritten and calls get arrays of the right type
+   * - string ops and string parameters and returns only see strings, from the pool or passed in
+   * - field ops only reach objects passed in, within the struct size their parameter row gives
+   * - execution cannot run off the end of a function
+   * - `ret` is used by functions returning a value, `ret_void` by void ones, and returns a
+   *   slot of the declared kind; nothing returns arrays or objects
+   * - ints and doubles only meet ops of their own type, constants fit both
+   */
+  auto verify(const program_view &program) -> std::expected<std::vector<function_facts>, error_t>;
+
+  /**
+   * Same checks for a single function, they only depend on its own code and the table
+   */
+  auto verify_function(const program_view &program, std::size_t function) -> std::expected<function_facts, error_t>;
+
+  /**
+   * Verifies functions of one program the first time they are called instead of all of them
+   * up front, so preparing a large bundle costs as much as the code that actually runs.
+   *
+   * Every function has a state word. The first caller takes the latch and verifies, callers
+   * racing it wait for the result, later calls only load the word.
+   */
+  class lazy_verifier {
+  public:
+    explicit lazy_verifier(std::size_t function_count);
+
+    auto ensure(const program_view &program, std::size_t function) -> std::expected<void, error_t> {
+      if (m_state[function].load(std::memory_order_acquire) == ready) [[likely]] {
+        return {};
+      }
+      return prepare(program, function);
+    }
+
+    /**
+     * Facts of the functions `ensure` succeeded for, the other rows are unspecified
+     */
+    auto facts() const -> std::span<const function_facts> { return {m_facts.get(), m_count}; }
+
+    auto verified_count() const -> std::size_t;
+
+  private:
+    enum : std::uint32_t {
+      unverified,
+      verifying,
+      ready,
+      failed
+    };
+
+    std::size_t m_count;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> m_state;
+    std::unique_ptr<function_facts[]> m_facts;
+    std::unique_ptr<std::optional<error_t>[]> m_errors;
+
+    auto prepare(const program_view &program, std::size_t function) -> std::expected<void, error_t>;
+  };
+
+  /**
+   * A program that passed `verify`, the runtime executes these on its unchecked path
+   */
+  template<executable Program>
+  class verified {
+  public:
+    static auto make(Program program) -> std::expected<verified, error_t> {
+      auto facts = verify(program.view());
+      if (not facts) {
+        return std::unexpected{facts.error()};
+      }
+      return verified{std::move(program), std::move(*facts)};
+    }
+
+    auto view() const -> program_view { return m_program.view(); }
+
+    auto find(std::string_view name) const -> std::optional<std::size_t> { return m_program.find(name); }
+
+    auto facts() const -> std::span<const function_facts> { return m_facts; }
+
+    auto get() const -> const Program & { return m_program; }
+
+  private:
+    verified(Program program, std::vector<function_facts> facts)
+      : m_program(std::move(program)), m_facts(std::move(facts)) {}
+
+    Program m_program;
+    std::vector<function_facts> m_facts;
+  };
+
+  /**
+   * A program verified function by function as it runs, executed on the unchecked path
+   */
+  template<executable Program>
+  class lazily_verified {
+  public:
+    explicit lazily_verified(Program program)
+      : m_program(std::move(program)),
+        m_verifier(std::make_unique<lazy_verifier>(m_program.view().functions.size())) {}
+
+    auto view() const -> program_view { return m_program.view(); }
+
+    auto find(std::string_view name) const -> std::optional<std::size_t> { return m_program.find(name); }
+
+    auto verifier() const -> lazy_verifier & { return *m_verifier; }
+
+    auto get() const -> const Program & { return m_program; }
+
+  private:
+    Program m_program;
+    std::unique_ptr<lazy_verifier> m_verifier; // stays put when the program moves
+  };
+}
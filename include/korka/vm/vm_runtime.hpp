@@ -4,8 +4,461 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "korka/shared/error.hpp"
+#include "korka/utils/string.hpp"
+#include "korka/vm/natives.hpp"
+#include "korka/vm/options.hpp"
+#include "korka/vm/program.hpp"
+#include "korka/vm/verifier.hpp"
+
+namespace korka::vm {
+  struct call_frame {
+    std::size_t return_pc;
+    std::size_t stack_base;
+    std::size_t locals_base;
+    std::size_t function;
+    std::size_t narrow_base{}; // bytes into the narrow locals
+  };
+
+  /**
+   * A reference the host passed for a parameter of the outermost call. The checked loop
+   * reads through nothing else, so a number code made up is never taken for an address.
+   */
+  struct host_reference {
+    stack_value_t value;
+    korka::type type;
+    std::uint32_t object_size{};
+  };
+}
+
 namespace korka {
+  /**
+   * A script invocation that can be suspended by `yield`. While suspended it owns its whole
+   * frame stack, so any number of them can wait on one runtime. The program must outlive it.
+   */
+  class coroutine {
+  public:
+    coroutine() = default;
+
+    /**
+     * True once the function returned, or failed
+     */
+    auto done() const -> bool { return m_done; }
+
+    /**
+     * Last yielded value, the return value once done
+     */
+    auto value() const -> vm::stack_value_t { return m_value; }
+
+    /**
+     * True when the last step stopped because it ran out of fuel rather than at a `yield`
+     */
+    auto preempted() const -> bool { return m_preempted; }
+
+    /**
+     * True while it is suspended in an asynchronous native call, `resume` fails until the
+     * call completed
+     */
+    auto waiting() const -> bool { return m_native != nullptr; }
+
+    auto ready() const -> bool { return not m_native || m_native->ready(); }
+
+    /**
+     * Calls `wake` once the coroutine can be resumed, right away if it already can.
+     * `wake` may run on the thread that completed the native call.
+     */
+    auto on_ready(std::function<void()> wake) -> void;
+
+  private:
+    friend class runtime;
+
+    vm::program_view m_program;
+    std::vector<vm::stack_value_t> m_stack;
+    std::vector<vm::stack_value_t> m_locals;
+    std::vector<std::int8_t> m_narrow;
+    std::vector<vm::call_frame> m_frames;
+    std::vector<vm::host_reference> m_references;
+    std::size_t m_pc{};
+    vm::stack_value_t m_value{};
+    bool m_done{true};
+    bool m_preempted{};
+
+    // Native call it waits for, its value is pushed on resume unless the native is void
+    std::shared_ptr<vm::native_state> m_native;
+    bool m_native_returns{};
+    bool m_native_string{};
+  };
+
+  /**
+   * Bytecode interpreter and the execution context of one thread. It holds the operand stack,
+   * locals, call frames and counters, so one runtime runs one invocation at a time. Programs
+   * are never written to and can be shared by any number of runtimes; see `runtime_pool`
+   * for handing runtimes out to worker threads.
+   */
+  class runtime {
+  public:
+    // Deep enough for sane recursion, shallow enough to stop a runaway one
+    static constexpr std::size_t max_call_depth = 1024;
+
+    using result_t = std::expected<vm::stack_value_t, error_t>;
+
+    struct counters {
+      std::uint64_t invocations{};  // calls from the host
+      std::uint64_t calls{};        // calls between script functions
+      std::uint64_t native_calls{}; // calls from scripts into the host
+    };
+
+    auto stats() const -> const counters & { return m_counters; }
+
+    // --- Fuel ---
+
+    static constexpr std::uint64_t unlimited_fuel = UINT64_MAX;
+
+    /**
+     * Budget of every invocation, and of every coroutine step. A unit is spent per call and
+     * per backward jump, code between them always runs to its end. Out of fuel, calls fail
+     * and coroutines are suspended where they stopped; `resume` refuels them.
+     */
+    auto set_fuel(std::uint64_t fuel) -> void { m_fuel_limit = std::max<std::uint64_t>(fuel, 1); }
+
+    auto fuel() const -> std::uint64_t { return m_fuel_limit; }
+
+    /**
+     * What the last invocation left over
+     */
+    auto fuel_left() const -> std::uint64_t { return m_fuel; }
+
+    /**
+     * Calls the function at `function` in the function table.
+     * Void functions give back 0.
+     */
+    auto call(const vm::program_view &program, std::size_t function,
+              std::span<const vm::stack_value_t> args) -> result_t;
+
+    /**
+     * Looks the function up by name, works with programs, images and anything else `executable`
+     */
+    template<vm::executable Program>
+    auto execute(const Program &program, std::string_view function,
+                 std::span<const vm::stack_value_t> args) -> result_t {
+      auto index = program.find(function);
+      if (not index) {
+        return std::unexpected{error::undefined_symbol{
+          .identifier = function
+        }};
+      }
+      return call(program.view(), *index, args);
+    }
+
+    /**
+     * Verified programs run without bounds and stack checks, only division by zero
+     * and the call depth are still checked
+     */
+    template<class Program>
+    auto call(const vm::verified<Program> &program, std::size_t function,
+              std::span<const vm::stack_value_t> args) -> result_t {
+      return call_verified(program.view(), program.facts(), nullptr, function, args);
+    }
+
+    /**
+     * Same unchecked path, functions are verified when they are first called
+     */
+    template<class Program>
+    auto call(const vm::lazily_verified<Program> &program, std::size_t function,
+              std::span<const vm::stack_value_t> args) -> result_t {
+      auto &verifier = program.verifier();
+      return call_verified(program.view(), verifier.facts(), &verifier, function, args);
+    }
+
+    template<class Program>
+    auto execute(const vm::verified<Program> &program, std::string_view function,
+                 std::span<const vm::stack_value_t> args) -> result_t {
+      auto index = program.find(function);
+      if (not index) {
+        return std::unexpected{error::undefined_symbol{
+          .identifier = function
+        }};
+      }
+      return call(program, *index, args);
+    }
+
+    template<class Program>
+    auto execute(const vm::lazily_verified<Program> &program, std::string_view function,
+                 std::span<const vm::stack_value_t> args) -> result_t {
+      auto index = program.find(function);
+      if (not index) {
+        return std::unexpected{error::undefined_symbol{
+          .identifier = function
+        }};
+      }
+      return call(program, *index, args);
+    }
+
+    template<vm::executable Program>
+    auto execute(const Program &program, std::string_view function,
+                 std::initializer_list<vm::stack_value_t> args = {}) -> result_t {
+      return execute(program, function, std::span{args.begin(), args.size()});
+    }
+
+    // --- Batches ---
+
+    // One argument of the function for every row of the batch
+    using column_t = std::span<const vm::stack_value_t>;
+
+    // Widest lane group of the lane parallel loop, 8 values fill an AVX-512 register
+    static constexpr std::size_t max_lanes = 8;
+
+    /**
+     * Calls the function once per row, `out[i]` gets the result for the i-th element of every
+     * column. The lookup, argument count and column sizes are checked once for the whole batch.
+     * Stops at the first failing row, the rows before it are already written.
+     */
+    auto call_batch(const vm::program_view &program, std::size_t function,
+                    std::span<const column_t> columns, std::span<vm::stack_value_t> out)
+      -> std::expected<void, error_t>;
+
+    /**
+     * Verified programs can run `Lanes` rows at once, every instruction then works on a vector
+     * of values. Rows that branch away from the rest of their group, or fail, are rerun on the
+     * scalar loop, so the results are the same as with one lane.
+     */
+    template<std::size_t Lanes = 1, class Program>
+      requires (Lanes == 1 || Lanes == 4 || Lanes == max_lanes)
+    auto call_batch(const vm::verified<Program> &program, std::size_t function,
+                    std::span<const column_t> columns, std::span<vm::stack_value_t> out)
+      -> std::expected<void, error_t> {
+      return call_batch_verified(program.view(), program.facts(), nullptr, function, columns, out, Lanes);
+    }
+
+    template<std::size_t Lanes = 1, class Program>
+      requires (Lanes == 1 || Lanes == 4 || Lanes == max_lanes)
+    auto call_batch(const vm::lazily_verified<Program> &program, std::size_t function,
+                    std::span<const column_t> columns, std::span<vm::stack_value_t> out)
+      -> std::expected<void, error_t> {
+      auto &verifier = program.verifier();
+      return call_batch_verified(program.view(), verifier.facts(), &verifier, function, columns, out, Lanes);
+    }
+
+    template<std::size_t Lanes = 1, class Program>
+    auto execute_batch(const Program &program, std::string_view function,
+                       std::span<const column_t> columns, std::span<vm::stack_value_t> out)
+      -> std::expected<void, error_t> {
+      auto index = program.find(function);
+      if (not index) {
+        return std::unexpected{error::undefined_symbol{
+          .identifier = function
+        }};
+      }
+      // Verified wrappers have their own overloads, everything else runs through its view
+      if constexpr (requires { call_batch<Lanes>(program, *index, columns, out); }) {
+        return call_batch<Lanes>(program, *index, columns, out);
+      } else {
+        static_assert(Lanes == 1, "Lane parallel batches need a verified program");
+        return call_batch(program.view(), *index, columns, out);
+      }
+    }
+
+    /**
+     * `vm.execute_batch<"score">(program, a, b, out)`, the last span receives the results.
+     * `vm.execute_batch<"score", 8>(...)` runs a verified program 8 rows at a time.
+     */
+    template<const_string Function, std::size_t Lanes = 1, class Program, class... Spans>
+      requires (sizeof...(Spans) >= 1)
+    auto execute_batch(const Program &program, Spans &&... spans) -> std::expected<void, error_t> {
+      constexpr auto inputs = sizeof...(Spans) - 1;
+      auto all = std::forward_as_tuple(spans...);
+      return [&]<std::size_t... I>(std::index_sequence<I...>) {
+        std::array<column_t, inputs> columns{column_t{std::get<I>(all)}...};
+        return execute_batch<Lanes>(program, std::string_view{Function}, columns,
+                             std::span<vm::stack_value_t>{std::get<inputs>(all)});
+      }(std::make_index_sequence<inputs>{});
+    }
+
+    // --- Coroutines ---
+
+    /**
+     * Runs the function until its first `yield` or its return. Functions called without a
+     * coroutine fail at `yield`.
+     */
+    auto start(const vm::program_view &program, std::size_t function,
+               std::span<const vm::stack_value_t> args) -> std::expected<coroutine, error_t>;
+
+    template<vm::executable Program>
+    auto start(const Program &program, std::string_view function,
+               std::span<const vm::stack_value_t> args) -> std::expected<coroutine, error_t> {
+      auto index = program.find(function);
+      if (not index) {
+        return std::unexpected{error::undefined_symbol{
+          .identifier = function
+        }};
+      }
+      return start(program.view(), *index, args);
+    }
+
+    template<vm::executable Program>
+    auto start(const Program &program, std::string_view function,
+               std::initializer_list<vm::stack_value_t> args = {}) -> std::expected<coroutine, error_t> {
+      return start(program, function, std::span{args.begin(), args.size()});
+    }
+
+    /**
+     * Continues after the `yield` or native call the coroutine stopped at, until the next
+     * one or the return. Gives back the same value as `co.value()`.
+     */
+    auto resume(coroutine &co) -> result_t;
+
+    /**
+     * Script call awaited from a C++ coroutine. A script that yields parks the awaiting
+     * coroutine on the runtime, `resume_parked` advances it to the next `yield` and hands
+     * the result over once the script returns.
+     */
+    class awaitable_call {
+    public:
+      awaitable_call(const awaitable_call &) = delete;
+      auto operator=(const awaitable_call &) -> awaitable_call & = delete;
+
+      ~awaitable_call();
+
+      auto await_ready() -> bool;
+
+      auto await_suspend(std::coroutine_handle<> waiting) -> void;
+
+      auto await_resume() -> result_t { return std::move(m_result); }
+
+    private:
+      friend class runtime;
+
+      awaitable_call(runtime &vm, const vm::program_view &program, std::optional<std::size_t> function,
+                     std::string_view name, std::vector<vm::stack_value_t> args)
+        : m_vm(&vm), m_program(program), m_function(function), m_name(name), m_args(std::move(args)) {}
+
+      runtime *m_vm;
+      vm::program_view m_program;
+      std::optional<std::size_t> m_function;
+      std::string_view m_name;
+      std::vector<vm::stack_value_t> m_args;
+
+      coroutine m_coroutine;
+      result_t m_result{};
+      std::coroutine_handle<> m_waiting;
+    };
+
+    /**
+     * `co_await vm.call<"step">(program, entity)`
+     */
+    template<const_string Function, vm::executable Program, std::convertible_to<vm::stack_value_t>... Args>
+    auto call(const Program &program, Args... args) -> awaitable_call {
+      return {*this, program.view(), program.find(Function), Function,
+              {static_cast<vm::stack_value_t>(args)...}};
+    }
+
+    /**
+     * Advances every parked script once, returns how many are still parked. Scripts waiting on
+     * a native call are skipped until it completes. Coroutines whose script finished are
+     * resumed from here, they must not call `resume_parked` themselves.
+     */
+    auto resume_parked() -> std::size_t;
+
+  private:
+    using frame = vm::call_frame;
+
+    std::vector<vm::stack_value_t> m_stack;
+    std::vector<vm::stack_value_t> m_locals;
+    // Locals narrower than a slot, at their own width. Frames index into both
+    std::vector<std::int8_t> m_narrow;
+    std::vector<frame> m_frames;
+    // References of the invocation the checked loop runs, see `host_reference`
+    std::vector<vm::host_reference> m_references;
+    counters m_counters;
+
+    std::uint64_t m_fuel_limit{unlimited_fuel};
+    std::uint64_t m_fuel{unlimited_fuel};
+
+    // Awaited calls whose script is suspended, and the ones `resume_parked` is going through
+    std::vector<awaitable_call *> m_parked;
+    std::vector<awaitable_call *> m_resuming;
+
+    // Arguments of the current batch row
+    std::vector<vm::stack_value_t> m_row;
+
+    // Stack and locals of the lane parallel loop, slot `i` of lane `l` is at `i * Lanes + l`
+    std::vector<vm::stack_value_t> m_lane_stack;
+    std::vector<vm::stack_value_t> m_lane_locals;
+
+    // Fresh stacks and the outermost frame, the checks are left to the callers
+    auto enter(const vm::program_view &program, const vm::function_entry &entry, std::size_t function,
+               std::span<const vm::stack_value_t> args) -> void;
+
+    auto enter_verified(const vm::function_entry &entry, const vm::function_facts &facts,
+                        std::size_t function, std::span<const vm::stack_value_t> args) -> void;
+
+    // Lets the checked loop compare a string a native returned
+    auto keep_string(vm::stack_value_t value) -> void;
+
+    // Where a coroutine stopped, and whether it was a `yield`, the fuel or a native call
+    struct suspension {
+      std::size_t pc;
+      bool preempted;
+      std::shared_ptr<vm::native_state> native{};
+      bool native_returns{};
+      bool native_string{};
+    };
+
+    // Starts at `start` in the innermost frame, only coroutines pass `suspend`
+    template<vm::instruction_encoding Encoding>
+    auto run(const vm::program_view &program, std::size_t start, suspension *suspend = nullptr) -> result_t;
+
+    auto run_coroutine(coroutine &co) -> result_t;
+
+    // `lazy` is null when the whole program was verified up front
+    auto call_verified(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                       vm::lazy_verifier *lazy, std::size_t function,
+                       std::span<const vm::stack_value_t> args) -> result_t;
+
+    auto call_batch_verified(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                             vm::lazy_verifier *lazy, std::size_t function,
+                             std::span<const column_t> columns, std::span<vm::stack_value_t> out,
+                             std::size_t lanes)
+      -> std::expected<void, error_t>;
+
+    // Results of the lanes that ran to the end, `done` has a bit for each of them
+    struct lane_group {
+      std::array<vm::stack_value_t, max_lanes> values;
+      std::uint32_t done;
+    };
+
+    template<std::size_t Lanes>
+    auto call_lanes(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                    vm::lazy_verifier *lazy, std::size_t function,
+                    std::span<const column_t> columns, std::span<vm::stack_value_t> out)
+      -> std::expected<void, error_t>;
 
+    template<std::size_t Lanes, vm::instruction_encoding Encoding>
+    auto run_lanes(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                   vm::lazy_verifier *lazy, std::size_t function) -> lane_group;
 
+    template<class Row>
+    auto for_each_row(std::span<const column_t> columns, std::span<vm::stack_value_t> out, Row &&row)
+      -> std::expected<void, error_t>;
 
-} // korka
\ No newline at end of file
+    template<vm::instruction_encoding Encoding>
+    auto run_verified(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                      vm::lazy_verifier *lazy) -> result_t;
+  };
+} // korka
@@ -0,0 +1,40 @@
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/compiler/parser.hpp"
+#include "korka/compiler/compiler.hpp"
+
+namespace korka {
+  auto compile_runtime(std::string_view source, const compile_options &options)
+  -> std::expected<program, error_t> {
+    auto tokens = lexer{source}.lex();
+    if (not tokens) {
+      return std::unexpected{tokens.error()};
+    }
+
+    auto parsed = parser{std::span<const lex_token>{*tokens}}.parse();
+    if (not parsed) {
+      return std::unexpected{parsed.error()};
+    }
+
+    auto &[nodes, root] = *parsed;
+    auto compiled = compiler{nodes, root, options.encoding, options.structs}.compile();
+    if (not compiled) {
+      return std::unexpected{compiled.error()};
+    }
+
+    std::vector<vm::function_entry> table(compiled->functions.size());
+    std::vector<program::function> functions(compiled->functions.size());
+    for (auto &&[name, info]: compiled->functions) {
+      table[info.index] = function_info_to_entry(info);
+
+      auto &f = functions[info.index];
+      f.name = name;
+      f.return_type = std::get<type>(info.return_type);
+      for (auto &&param: info.params) {
+        f.params.push_back(std::get<type>(param.type));
+      }
+    }
+
+    return program{std::move(compiled->bytes), std::move(table), std::move(functions), std::move(compiled->constants),
+                   options.encoding, std::move(compiled->strings), std::move(compiled->params), true};
+  }
+}
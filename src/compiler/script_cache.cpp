@@ -0,0 +1,115 @@
+#include "korka/compiler/script_cache.hpp"
+#include "korka/compiler/compile_runtime.hpp"
+#include <format>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#ifndef KORKA_VERSION_STRING
+#define KORKA_VERSION_STRING "unknown"
+#endif
+
+namespace korka {
+  namespace {
+    auto fail(std::string_view message) -> std::unexpected<error_t> {
+      return std::unexpected<error_t>{error::other_error{message}};
+    }
+
+    // FNV-1a with a splitmix finalizer, two seeds give a 128-bit key
+    auto hash_bytes(std::string_view data, std::uint64_t seed) -> std::uint64_t {
+      std::uint64_t h = seed;
+      for (auto c: data) {
+        h ^= static_cast<std::uint8_t>(c);
+        h *= 0x100000001b3ull;
+      }
+      h ^= h >> 30;
+      h *= 0xbf58476d1ce4e5b9ull;
+      h ^= h >> 27;
+      h *= 0x94d049bb133111ebull;
+      h ^= h >> 31;
+      return h;
+    }
+
+    template<class T>
+    auto hash_value(const T &value, std::uint64_t seed) -> std::uint64_t {
+      return hash_bytes(std::string_view{reinterpret_cast<const char *>(&value), sizeof(value)}, seed);
+    }
+
+    auto hash_key(std::string_view source, const compile_options &options, std::uint64_t seed) -> std::uint64_t {
+      // Everything that changes the compiled output goes in here
+      auto h = hash_bytes(KORKA_VERSION_STRING, seed);
+      h = hash_value(vm::image_version, h);
+      h = hash_value(options.encoding, h);
+      for (const auto &layout: options.structs) {
+        h = hash_bytes(layout.name, h);
+        h = hash_value(layout.size, h);
+        for (const auto &field: layout.fields) {
+          h = hash_bytes(field.name, h);
+          h = hash_value(field.type, h);
+          h = hash_value(field.offset, h);
+        }
+      }
+      return hash_bytes(source, h);
+    }
+
+    auto temp_suffix() -> std::string {
+      static thread_local std::mt19937_64 rng{
+        std::random_device{}() ^ std::hash<std::thread::id>{}(std::this_thread::get_id())
+      };
+      return std::format(".{:016x}.tmp", rng());
+    }
+  }
+
+  script_cache::script_cache(std::filesystem::path directory, compile_options options)
+    : m_directory(std::move(directory)), m_options(options) {}
+
+  auto script_cache::entry_path(std::string_view source) const -> std::filesystem::path {
+    return m_directory / std::format("{:016x}{:016x}.kimg",
+                                     hash_key(source, m_options, 0xcbf29ce484222325ull),
+                                     hash_key(source, m_options, 0x84222325cbf29ce4ull));
+  }
+
+  auto script_cache::load(std::string_view source) -> std::expected<vm::verified<vm::mapped_image>, error_t> {
+    auto path = entry_path(source);
+
+    // A stale, damaged or unverifiable entry is just a miss, it gets replaced below
+    if (auto cached = vm::mapped_image::open(path)) {
+      if (auto checked = vm::verified<vm::mapped_image>::make(std::move(*cached))) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return checked;
+      }
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+
+    auto compiled = compile_runtime(source, m_options);
+    if (not compiled) {
+      return std::unexpected{compiled.error()};
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+    if (ec) {
+      return fail("Failed to create the script cache directory");
+    }
+
+    auto temp = path;
+    temp += temp_suffix();
+    if (auto saved = vm::save_image(*compiled, temp); not saved) {
+      std::filesystem::remove(temp, ec);
+      return std::unexpected{saved.error()};
+    }
+
+    // Atomic replace, concurrent writers of the same entry produce identical files
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::filesystem::remove(temp, ec);
+      return fail("Failed to store the script cache entry");
+    }
+
+    auto stored = vm::mapped_image::open(path);
+    if (not stored) {
+      return std::unexpected{stored.error()};
+    }
+    return vm::verified<vm::mapped_image>::make(std::move(*stored));
+  }
+}
@@ -0,0 +1,113 @@
+#include "korka/vm/executor.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace korka {
+  namespace {
+    // Worker the current thread runs as, tasks it submits go to its own deque
+    thread_local const executor *current_executor{};
+    thread_local std::size_t current_worker{};
+  }
+
+  executor::executor(std::size_t threads)
+    : m_worker_count(std::max<std::size_t>(threads, 1)),
+      m_workers(std::make_unique<worker[]>(m_worker_count)) {
+    for (std::size_t i = 0; i < m_worker_count; ++i) {
+      m_workers[i].thread = std::thread{[this, i] { work(i); }};
+    }
+  }
+
+  executor::~executor() {
+    {
+      std::lock_guard lock{m_sleep_mutex};
+      m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::size_t i = 0; i < m_worker_count; ++i) {
+      m_workers[i].thread.join();
+    }
+  }
+
+  auto executor::submit(const vm::program_view &program, std::size_t function,
+                        std::span<const vm::stack_value_t> args) -> std::future<runtime::result_t> {
+    std::promise<runtime::result_t> promise;
+    auto future = promise.get_future();
+    push({program, function, {args.begin(), args.end()}, std::move(promise)});
+    return future;
+  }
+
+  auto executor::submit(const vm::program_view &program, std::size_t function,
+                        std::span<const vm::stack_value_t> args, callback_t done) -> void {
+    push({program, function, {args.begin(), args.end()}, std::move(done)});
+  }
+
+  auto executor::push(task t) -> void {
+    auto target = current_executor == this
+                    ? current_worker
+                    : m_next.fetch_add(1, std::memory_order_relaxed) % m_worker_count;
+
+    // Counted before it is queued so the count never drops below zero, a worker that is
+    // about to sleep either sees the task or is woken up for it
+    m_pending.fetch_add(1, std::memory_order_seq_cst);
+    {
+      auto &w = m_workers[target];
+      std::lock_guard lock{w.mutex};
+      w.tasks.push_back(std::move(t));
+    }
+    if (m_sleeping.load(std::memory_order_seq_cst) != 0) {
+      { std::lock_guard lock{m_sleep_mutex}; }
+      m_wake.notify_one();
+    }
+  }
+
+  auto executor::take(std::size_t self) -> std::optional<task> {
+    auto pop = [&](worker &w, bool back) -> std::optional<task> {
+      std::lock_guard lock{w.mutex};
+      if (w.tasks.empty()) {
+        return std::nullopt;
+      }
+      auto t = std::move(back ? w.tasks.back() : w.tasks.front());
+      back ? w.tasks.pop_back() : w.tasks.pop_front();
+      return t;
+    };
+
+    // Newest own work first while it is hot in the cache, oldest work of the others
+    if (auto t = pop(m_workers[self], true)) {
+      return t;
+    }
+    for (std::size_t i = 1; i < m_worker_count; ++i) {
+      if (auto t = pop(m_workers[(self + i) % m_worker_count], false)) {
+        m_steals.fetch_add(1, std::memory_order_relaxed);
+        return t;
+      }
+    }
+    return std::nullopt;
+  }
+
+  auto executor::work(std::size_t self) -> void {
+    current_executor = this;
+    current_worker = self;
+    auto &vm = m_workers[self].vm;
+
+    while (true) {
+      if (auto t = take(self)) {
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+        auto result = vm.call(t->program, t->function, t->args);
+        if (auto *promise = std::get_if<std::promise<runtime::result_t>>(&t->done)) {
+          promise->set_value(std::move(result));
+        } else {
+          std::get<callback_t>(t->done)(std::move(result));
+        }
+        continue;
+      }
+
+      std::unique_lock lock{m_sleep_mutex};
+      m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+      m_wake.wait(lock, [&] { return m_stopping || m_pending.load(std::memory_order_seq_cst) != 0; });
+      m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+      if (m_stopping && m_pending.load(std::memory_order_seq_cst) == 0) {
+        return;
+      }
+    }
+  }
+}
@@ -0,0 +1,148 @@
+#include "korka/vm/fibers.hpp"
+#include <utility>
+
+namespace korka {
+  fiber_scheduler::fiber_scheduler(std::size_t threads, std::uint64_t fuel) : m_fuel(fuel) {
+    m_vm.set_fuel(fuel);
+    m_workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+      m_workers.emplace_back([this] { work(); });
+    }
+  }
+
+  fiber_scheduler::~fiber_scheduler() {
+    {
+      // Completions of pending native calls still push their fibers
+      std::unique_lock lock{m_mutex};
+      m_woken.wait(lock, [&] { return m_waiting == 0; });
+      m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto &w: m_workers) {
+      w.join();
+    }
+  }
+
+  auto fiber_scheduler::spawn(const vm::program_view &program, std::size_t function,
+                              std::span<const vm::stack_value_t> args, callback_t done) -> void {
+    push({
+      .co{},
+      .program = program,
+      .function = function,
+      .args{args.begin(), args.end()},
+      .done = std::move(done),
+      .started = false
+    });
+  }
+
+  auto fiber_scheduler::active() const -> std::size_t {
+    std::lock_guard lock{m_mutex};
+    return m_queue.size() + m_running + m_waiting;
+  }
+
+  auto fiber_scheduler::wait() -> void {
+    std::unique_lock lock{m_mutex};
+    m_woken.wait(lock, [&] { return m_waiting == 0 || not m_queue.empty(); });
+  }
+
+  auto fiber_scheduler::step(runtime &vm, fiber &f) -> step_result {
+    runtime::result_t value;
+    if (not f.started) {
+      f.started = true;
+      auto co = vm.start(f.program, f.function, f.args);
+      f.args = {};
+      if (co) {
+        f.co = std::move(*co);
+        value = f.co.value();
+      } else {
+        value = std::unexpected{co.error()};
+      }
+    } else {
+      value = vm.resume(f.co);
+    }
+
+    if (value && not f.co.done()) {
+      return f.co.ready() ? step_result::runnable : step_result::waiting;
+    }
+    if (f.done) {
+      f.done(std::move(value));
+    }
+    return step_result::finished;
+  }
+
+  auto fiber_scheduler::requeue(fiber f, step_result result) -> void {
+    if (result != step_result::waiting) {
+      std::lock_guard lock{m_mutex};
+      --m_running;
+      if (result == step_result::runnable) {
+        m_queue.push_back(std::move(f));
+      }
+      return;
+    }
+
+    {
+      std::lock_guard lock{m_mutex};
+      --m_running;
+      ++m_waiting;
+    }
+    // The completion may come from any thread, or may already have come
+    auto parked = std::make_shared<fiber>(std::move(f));
+    parked->co.on_ready([this, parked] {
+      std::lock_guard lock{m_mutex};
+      --m_waiting;
+      m_queue.push_back(std::move(*parked));
+      m_wake.notify_one();
+      m_woken.notify_all();
+    });
+  }
+
+  auto fiber_scheduler::push(fiber f) -> void {
+    {
+      std::lock_guard lock{m_mutex};
+      m_queue.push_back(std::move(f));
+    }
+    m_wake.notify_one();
+  }
+
+  auto fiber_scheduler::run(std::size_t max_steps) -> std::size_t {
+    std::size_t steps = 0;
+    while (steps < max_steps) {
+      fiber f;
+      {
+        std::lock_guard lock{m_mutex};
+        if (m_queue.empty()) {
+          break;
+        }
+        f = std::move(m_queue.front());
+        m_queue.pop_front();
+        ++m_running;
+      }
+
+      ++steps;
+      auto result = step(m_vm, f);
+      requeue(std::move(f), result);
+    }
+    return steps;
+  }
+
+  auto fiber_scheduler::work() -> void {
+    runtime vm;
+    vm.set_fuel(m_fuel);
+    while (true) {
+      fiber f;
+      {
+        std::unique_lock lock{m_mutex};
+        m_wake.wait(lock, [&] { return m_stopping || not m_queue.empty(); });
+        if (m_stopping) {
+          return;
+        }
+        f = std::move(m_queue.front());
+        m_queue.pop_front();
+        ++m_running;
+      }
+
+      auto result = step(vm, f);
+      requeue(std::move(f), result);
+    }
+  }
+}
@@ -0,0 +1,276 @@
+#include "korka/vm/image.hpp"
+#include "korka/vm/strings.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#define KORKA_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define KORKA_HAS_MMAP 0
+#endif
+
+namespace korka::vm {
+  static_assert(sizeof(function_entry) == 24 && std::is_trivially_copyable_v<function_entry>);
+  static_assert(sizeof(image_function) == 16 && std::is_trivially_copyable_v<image_function>);
+  static_assert(sizeof(type) == 1);
+  static_assert(sizeof(param_entry) == 8 && std::is_trivially_copyable_v<param_entry>);
+
+  namespace {
+    auto fail(std::string_view message) -> std::unexpected<error_t> {
+      return std::unexpected<error_t>{error::other_error{message}};
+    }
+
+    auto align_up(std::size_t value, std::size_t alignment) -> std::size_t {
+      return (value + alignment - 1) / alignment * alignment;
+    }
+
+    template<class T>
+    auto section_span(std::span<const std::byte> bytes, const image_section &s) -> std::optional<std::span<const T>> {
+      if (s.offset > bytes.size() || s.size > bytes.size() - s.offset || s.size % sizeof(T) != 0) {
+        return std::nullopt;
+      }
+
+      auto begin = bytes.data() + s.offset;
+      if (reinterpret_cast<std::uintptr_t>(begin) % alignof(T) != 0) {
+        return std::nullopt;
+      }
+      return std::span{reinterpret_cast<const T *>(begin), s.size / sizeof(T)};
+    }
+  }
+
+  auto write_image(const program &p) -> std::vector<std::byte> {
+    auto table = p.table();
+    auto functions = p.functions();
+
+    std::vector<image_function> info(functions.size());
+    std::string names;
+    for (std::size_t i = 0; i < functions.size(); ++i) {
+      info[i] = {
+        .name_offset = static_cast<std::uint32_t>(names.size()),
+        .name_size = static_cast<std::uint32_t>(functions[i].name.size()),
+        .params_offset = table[i].params,
+        .reserved = 0
+      };
+      names += functions[i].name;
+    }
+
+    std::vector<std::uint32_t> by_name(functions.size());
+    std::iota(by_name.begin(), by_name.end(), std::uint32_t{});
+    std::ranges::sort(by_name, {}, [&](std::uint32_t i) -> std::string_view { return functions[i].name; });
+
+    image_header header{
+      .magic = image_magic,
+      .version = image_version,
+      .byte_order = image_byte_order,
+      .file_size = 0,
+      .function_count = static_cast<std::uint32_t>(table.size()),
+      .encoding = p.encoding(),
+      .reserved{},
+      .functions{}, .function_info{}, .by_name{}, .params{}, .names{}, .constants{}, .strings{}, .code{}
+    };
+
+    std::size_t pos = sizeof(image_header);
+    auto place = [&](std::size_t size, std::size_t alignment) -> image_section {
+      pos = align_up(pos, alignment);
+      image_section s{pos, size};
+      pos += size;
+      return s;
+    };
+
+    header.functions = place(table.size_bytes(), alignof(function_entry));
+    header.function_info = place(info.size() * sizeof(image_function), alignof(image_function));
+    header.by_name = place(by_name.size() * sizeof(std::uint32_t), alignof(std::uint32_t));
+    header.params = place(p.params().size_bytes(), alignof(param_entry));
+    header.names = place(names.size(), 1);
+    header.constants = place(p.constants().size_bytes(), alignof(stack_value_t));
+    header.strings = place(p.strings().size(), alignof(string_size_t));
+    header.code = place(p.code().size(), image_code_alignment);
+    header.file_size = pos;
+
+    std::vector<std::byte> out(pos);
+    auto put = [&](const image_section &s, const void *data) {
+      if (s.size != 0) std::memcpy(out.data() + s.offset, data, s.size);
+    };
+
+    std::memcpy(out.data(), &header, sizeof(header));
+    put(header.functions, table.data());
+    put(header.function_info, info.data());
+    put(header.by_name, by_name.data());
+    put(header.params, p.params().data());
+    put(header.names, names.data());
+    put(header.constants, p.constants().data());
+    put(header.strings, p.strings().data());
+    put(header.code, p.code().data());
+    return out;
+  }
+
+  auto save_image(const program &p, const std::filesystem::path &path) -> std::expected<void, error_t> {
+    auto bytes = write_image(p);
+
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (not out) {
+      return fail("Failed to write the image file");
+    }
+    return {};
+  }
+
+  auto image_view::from_bytes(std::span<const std::byte> bytes) -> std::expected<image_view, error_t> {
+    if (bytes.size() < sizeof(image_header)) {
+      return fail("Image is too small");
+    }
+
+    image_header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    if (header.magic != image_magic) return fail("Not a korka image");
+    if (header.byte_order != image_byte_order) return fail("Image was written with another byte order");
+    if (header.version != image_version) return fail("Unsupported image version");
+    if (header.file_size > bytes.size()) return fail("Image is truncated");
+    if (header.encoding != instruction_encoding::bytes && header.encoding != instruction_encoding::words) {
+      return fail("Unknown instruction encoding");
+    }
+
+    bytes = bytes.first(header.file_size);
+
+    image_view image;
+    auto functions = section_span<function_entry>(bytes, header.functions);
+    auto info = section_span<image_function>(bytes, header.function_info);
+    auto by_name = section_span<std::uint32_t>(bytes, header.by_name);
+    auto params = section_span<param_entry>(bytes, header.params);
+    auto names = section_span<char>(bytes, header.names);
+    auto constants = section_span<stack_value_t>(bytes, header.constants);
+    auto strings = section_span<std::byte>(bytes, header.strings);
+    auto code = section_span<std::byte>(bytes, header.code);
+
+    if (not functions || not info || not by_name || not params || not names || not constants || not strings || not code) {
+      return fail("Image section is out of bounds or misaligned");
+    }
+    if (functions->size() != header.function_count || info->size() != header.function_count
+        || by_name->size() != header.function_count) {
+      return fail("Image function table is inconsistent");
+    }
+
+    // Table rows are not checked one by one, the interpreter keeps execution inside the code either way
+    image.m_functions = *functions;
+    image.m_info = *info;
+    image.m_by_name = *by_name;
+    image.m_params = *params;
+    image.m_names = {names->data(), names->size()};
+    image.m_constants = *constants;
+    image.m_strings = *strings;
+    image.m_code = *code;
+    image.m_encoding = header.encoding;
+    return image;
+  }
+
+  auto image_view::function_name(std::size_t index) const -> std::string_view {
+    if (index >= m_info.size()) return {};
+
+    const auto &f = m_info[index];
+    if (f.name_offset > m_names.size() || f.name_size > m_names.size() - f.name_offset) return {};
+    return m_names.substr(f.name_offset, f.name_size);
+  }
+
+  auto image_view::param_types(std::size_t index) const -> std::span<const param_entry> {
+    if (index >= m_functions.size()) return {};
+    return params_of(view(), m_functions[index]);
+  }
+
+  auto image_view::find(std::string_view name) const -> std::optional<std::size_t> {
+    auto it = std::ranges::lower_bound(m_by_name, name, {},
+                                       [&](std::uint32_t i) { return function_name(i); });
+    if (it != m_by_name.end() && *it < m_functions.size() && function_name(*it) == name) {
+      return *it;
+    }
+    return std::nullopt;
+  }
+
+  // --- mapped_image ---
+
+  auto mapped_image::open(const std::filesystem::path &path) -> std::expected<mapped_image, error_t> {
+    mapped_image mapped;
+
+#if KORKA_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return fail("Failed to open the image file");
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+      ::close(fd);
+      return fail("Failed to read the image file");
+    }
+
+    auto size = static_cast<std::size_t>(st.st_size);
+    void *data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return fail("Failed to map the image file");
+    }
+
+    mapped.m_data = data;
+    mapped.m_size = size;
+    auto bytes = std::span{static_cast<const std::byte *>(data), size};
+#else
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    std::ifstream in{path, std::ios::binary};
+    if (ec || not in) {
+      return fail("Failed to open the image file");
+    }
+    mapped.m_buffer.resize(size);
+    in.read(reinterpret_cast<char *>(mapped.m_buffer.data()), static_cast<std::streamsize>(size));
+    if (not in) {
+      return fail("Failed to read the image file");
+    }
+    auto bytes = std::span<const std::byte>{mapped.m_buffer};
+#endif
+
+    auto image = image_view::from_bytes(bytes);
+    if (not image) {
+      return std::unexpected{image.error()};
+    }
+    mapped.m_image = *image;
+    return mapped;
+  }
+
+  mapped_image::mapped_image(mapped_image &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_image(std::exchange(other.m_image, {})),
+      m_buffer(std::move(other.m_buffer)) {}
+
+  auto mapped_image::operator=(mapped_image &&other) noexcept -> mapped_image & {
+    if (this != &other) {
+      unmap();
+      m_data = std::exchange(other.m_data, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+      m_image = std::exchange(other.m_image, {});
+      m_buffer = std::move(other.m_buffer);
+    }
+    return *this;
+  }
+
+  mapped_image::~mapped_image() {
+    unmap();
+  }
+
+  auto mapped_image::unmap() -> void {
+#if KORKA_HAS_MMAP
+    if (m_data) {
+      ::munmap(m_data, m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+  }
+}
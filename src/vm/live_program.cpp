@@ -0,0 +1,208 @@
+#include "korka/vm/live_program.hpp"
+#include "korka/vm/decoder.hpp"
+#include "korka/vm/strings.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+
+namespace korka {
+  namespace {
+    auto fail(std::string_view message) -> std::unexpected<error_t> {
+      return std::unexpected<error_t>{error::other_error{message}};
+    }
+
+    // Parameter rows included, an object has to be as large as the struct the code expects
+    auto same_signature(const program &a, std::size_t ia, const program &b, std::size_t ib) -> bool {
+      const auto &fa = a.functions()[ia];
+      const auto &fb = b.functions()[ib];
+      return fa.return_type == fb.return_type && fa.params == fb.params
+             && std::ranges::equal(vm::params_of(a.view(), a.table()[ia]), vm::params_of(b.view(), b.table()[ib]));
+    }
+
+    auto function_code(const program &p, std::size_t index) -> std::span<const std::byte> {
+      const auto &entry = p.table()[index];
+      return p.code().subspan(entry.offset, entry.size);
+    }
+
+    template<class T>
+    auto patch_operand(std::vector<std::byte> &code, std::size_t pc, T value, vm::instruction_encoding encoding)
+    -> void {
+      auto at = code.begin() + static_cast<std::ptrdiff_t>(pc);
+      if (encoding == vm::instruction_encoding::words) {
+        vm::instruction_word word;
+        std::memcpy(&word, &*at, sizeof(word));
+        word = (word & 0xff) | static_cast<vm::instruction_word>(value) << 8;
+        std::ranges::copy(std::bit_cast<std::array<std::byte, sizeof(word)>>(word), at);
+        return;
+      }
+      std::ranges::copy(std::bit_cast<std::array<std::byte, sizeof(T)>>(value), at + vm::op_code_size);
+    }
+
+    // Offset of the record of the text, walking the records one after another
+    auto find_string(std::span<const std::byte> pool, std::string_view text) -> std::optional<std::size_t> {
+      for (std::size_t offset = 0; offset < pool.size();) {
+        auto record = vm::as_string(vm::string_at(pool, static_cast<vm::stack_value_t>(offset)));
+        if (record == text) return offset;
+        offset += vm::string_header_size + record.size() + 1;
+      }
+      return std::nullopt;
+    }
+
+    /**
+     * Copies the function out of `source`, pointing its calls at the functions of `target`,
+     * its pooled constants into `constants` and its strings into `strings`, which start as
+     * the pools of `target`
+     */
+    auto relink(const program &source, std::size_t index, const program &target,
+                std::vector<vm::stack_value_t> &constants, std::vector<std::byte> &strings)
+    -> std::expected<std::vector<std::byte>, error_t> {
+      auto code = function_code(source, index);
+      auto encoding = source.encoding();
+      std::vector<std::byte> out{code.begin(), code.end()};
+
+      for (std::size_t pc = 0; pc < out.size();) {
+        auto instr = vm::decode(out, pc, encoding);
+        if (not instr) {
+          return fail("Malformed bytecode in the replacement function");
+        }
+
+        if (instr->op == vm::op_code::call || instr->op == vm::op_code::call_native) {
+          if (static_cast<std::size_t>(instr->operand) >= source.functions().size()) {
+            return fail("Malformed bytecode in the replacement function");
+          }
+          const auto &callee = source.functions()[static_cast<std::size_t>(instr->operand)];
+          auto target_index = target.find(callee.name);
+          if (not target_index) {
+            return std::unexpected{error::undefined_symbol{
+              .identifier = callee.name
+            }};
+          }
+          if (not same_signature(source, static_cast<std::size_t>(instr->operand), target, *target_index)
+              || vm::is_native(source.table()[static_cast<std::size_t>(instr->operand)])
+                 != vm::is_native(target.table()[*target_index])) {
+            return fail("Replacement calls a function with a different signature");
+          }
+
+          patch_operand(out, pc, static_cast<vm::function_index_t>(*target_index), encoding);
+        }
+
+        if (instr->op == vm::op_code::i64_const_pool || instr->op == vm::op_code::str_const) {
+          if (static_cast<std::size_t>(instr->operand) >= source.constants().size()) {
+            return fail("Malformed bytecode in the replacement function");
+          }
+          auto value = source.constants()[static_cast<std::size_t>(instr->operand)];
+
+          // Strings are pooled by text, the constant is the offset of the record
+          if (instr->op == vm::op_code::str_const) {
+            if (not vm::string_in_pool(source.strings(), value)) {
+              return fail("Malformed bytecode in the replacement function");
+            }
+            auto text = vm::as_string(vm::string_at(source.strings(), value));
+            auto offset = find_string(strings, text);
+            value = static_cast<vm::stack_value_t>(offset ? *offset : vm::append_string(strings, text));
+          }
+          auto it = std::ranges::find(constants, value);
+          if (it == constants.end()) {
+            if (not std::in_range<vm::constant_index_t>(constants.size())) {
+              return fail("Constant pool is full");
+            }
+            it = constants.insert(it, value);
+          }
+          patch_operand(out, pc, static_cast<vm::constant_index_t>(it - constants.begin()), encoding);
+        }
+        pc += instr->size;
+      }
+      return out;
+    }
+  }
+
+  live_program::live_program(program initial)
+    : m_current(new program(std::move(initial))) {}
+
+  live_program::~live_program() {
+    delete m_current.load();
+  }
+
+  auto live_program::acquire() const -> pinned {
+    auto guard = m_epochs.pin();
+    return {std::move(guard), m_current.load(std::memory_order_seq_cst)};
+  }
+
+  auto live_program::publish(program next) -> void {
+    const program *old;
+    {
+      std::lock_guard lock{m_writer_mutex};
+      old = m_current.exchange(new program(std::move(next)), std::memory_order_seq_cst);
+    }
+    m_epochs.retire([old] { delete old; });
+    m_epochs.collect();
+  }
+
+  auto live_program::replace_function(std::string_view name, const program &source) -> std::expected<void, error_t> {
+    std::unique_lock lock{m_writer_mutex};
+    const auto &current = *m_current.load(std::memory_order_acquire);
+
+    auto index = current.find(name);
+    auto source_index = source.find(name);
+    if (not index || not source_index) {
+      return std::unexpected{error::undefined_symbol{
+        .identifier = name
+      }};
+    }
+    if (not same_signature(current, *index, source, *source_index)) {
+      return fail("Replacement changes the function signature");
+    }
+    if (vm::is_native(current.table()[*index]) || vm::is_native(source.table()[*source_index])) {
+      return fail("Native functions cannot be replaced");
+    }
+    if (source.encoding() != current.encoding()) {
+      return fail("Replacement uses another instruction encoding");
+    }
+
+    std::vector<vm::stack_value_t> constants{current.constants().begin(), current.constants().end()};
+    std::vector<std::byte> strings{current.strings().begin(), current.strings().end()};
+    auto replacement = relink(source, *source_index, current, constants, strings);
+    if (not replacement) {
+      return std::unexpected{replacement.error()};
+    }
+
+    // Functions are position independent, so the new code is the old one with one function swapped
+    std::vector<std::byte> code;
+    std::vector<vm::function_entry> table{current.table().begin(), current.table().end()};
+    for (std::size_t i = 0; i < table.size(); ++i) {
+      auto bytes = i == *index ? std::span<const std::byte>{*replacement} : function_code(current, i);
+      table[i].offset = static_cast<std::uint32_t>(code.size());
+      table[i].size = static_cast<std::uint32_t>(bytes.size());
+      code.insert(code.end(), bytes.begin(), bytes.end());
+    }
+    // Frame sizes and flags come with the new body, the placement and parameter rows stay ours
+    auto replaced = source.table()[*source_index];
+    replaced.offset = table[*index].offset;
+    replaced.size = table[*index].size;
+    replaced.params = table[*index].params;
+    table[*index] = replaced;
+
+    auto next = new program(
+      std::move(code),
+      std::move(table),
+      {current.functions().begin(), current.functions().end()},
+      std::move(constants),
+      current.encoding(),
+      std::move(strings),
+      {current.params().begin(), current.params().end()},
+      current.compiled() && source.compiled()
+    );
+
+    auto old = m_current.exchange(next, std::memory_order_seq_cst);
+    lock.unlock();
+
+    m_epochs.retire([old] { delete old; });
+    m_epochs.collect();
+    return {};
+  }
+
+  auto live_program::collect() -> std::size_t {
+    return m_epochs.collect();
+  }
+}
@@ -0,0 +1,42 @@
+#include "korka/vm/natives.hpp"
+
+namespace korka::vm {
+  auto native_state::complete(stack_value_t value) -> void {
+    std::function<void()> wake;
+    {
+      std::lock_guard lock{m_mutex};
+      if (m_ready) {
+        return;
+      }
+      m_value = value;
+      m_ready = true;
+      wake = std::move(m_wake);
+    }
+    m_done.notify_all();
+    if (wake) {
+      wake();
+    }
+  }
+
+  auto native_state::ready() const -> bool {
+    std::lock_guard lock{m_mutex};
+    return m_ready;
+  }
+
+  auto native_state::wait() -> stack_value_t {
+    std::unique_lock lock{m_mutex};
+    m_done.wait(lock, [&] { return m_ready; });
+    return m_value;
+  }
+
+  auto native_state::on_ready(std::function<void()> wake) -> void {
+    {
+      std::lock_guard lock{m_mutex};
+      if (not m_ready) {
+        m_wake = std::move(wake);
+        return;
+      }
+    }
+    wake();
+  }
+}
@@ -0,0 +1,94 @@
+#include "korka/vm/runtime_pool.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace korka {
+  namespace {
+    constexpr auto pack(std::uint64_t tag, std::uint32_t index) -> std::uint64_t {
+      return tag << 32 | index;
+    }
+
+    constexpr auto index_of(std::uint64_t head) -> std::uint32_t {
+      return static_cast<std::uint32_t>(head);
+    }
+
+    constexpr auto tag_of(std::uint64_t head) -> std::uint64_t {
+      return head >> 32;
+    }
+  }
+
+  runtime_pool::runtime_pool(std::size_t capacity)
+    : m_capacity(std::clamp<std::size_t>(capacity, 1, no_slot - 1)),
+      m_slots(std::make_unique<slot[]>(m_capacity)) {
+    for (auto i = static_cast<std::uint32_t>(m_capacity); i-- > 0;) {
+      push(i);
+    }
+  }
+
+  auto runtime_pool::acquire() -> lease {
+    auto index = pop();
+    if (index == no_slot) {
+      m_overflows.fetch_add(1, std::memory_order_relaxed);
+      return {this, no_slot, new runtime{}};
+    }
+    return {this, index, &m_slots[index].vm};
+  }
+
+  auto runtime_pool::pop() -> std::uint32_t {
+    auto head = m_head.load(std::memory_order_acquire);
+    while (true) {
+      auto index = index_of(head);
+      if (index == no_slot) {
+        return no_slot;
+      }
+
+      // The slot may be taken and returned meanwhile, the tag makes the CAS notice
+      auto next = m_slots[index].next.load(std::memory_order_relaxed);
+      if (m_head.compare_exchange_weak(head, pack(tag_of(head) + 1, next),
+                                       std::memory_order_acquire, std::memory_order_acquire)) {
+        return index;
+      }
+    }
+  }
+
+  auto runtime_pool::push(std::uint32_t index) -> void {
+    auto head = m_head.load(std::memory_order_relaxed);
+    do {
+      m_slots[index].next.store(index_of(head), std::memory_order_relaxed);
+    } while (not m_head.compare_exchange_weak(head, pack(tag_of(head) + 1, index),
+                                              std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  // --- lease ---
+
+  runtime_pool::lease::lease(lease &&other) noexcept
+    : m_pool(std::exchange(other.m_pool, nullptr)),
+      m_slot(other.m_slot),
+      m_runtime(std::exchange(other.m_runtime, nullptr)) {}
+
+  auto runtime_pool::lease::operator=(lease &&other) noexcept -> lease & {
+    if (this != &other) {
+      release();
+      m_pool = std::exchange(other.m_pool, nullptr);
+      m_slot = other.m_slot;
+      m_runtime = std::exchange(other.m_runtime, nullptr);
+    }
+    return *this;
+  }
+
+  runtime_pool::lease::~lease() {
+    release();
+  }
+
+  auto runtime_pool::lease::release() -> void {
+    if (not m_pool) return;
+
+    if (m_slot == no_slot) {
+      delete m_runtime;
+    } else {
+      m_pool->push(m_slot);
+    }
+    m_pool = nullptr;
+    m_runtime = nullptr;
+  }
+}
@@ -0,0 +1,67 @@
+#include "korka/vm/size_report.hpp"
+#include "korka/vm/decoder.hpp"
+#include <format>
+
+namespace korka::vm {
+  auto report_size(const program_view &program) -> std::expected<size_report, error_t> {
+    size_report report{
+      .code_bytes = program.code.size(),
+      .constant_pool_bytes = program.constants.size_bytes()
+    };
+
+    for (const auto &entry: program.functions) {
+      if (entry.offset > program.code.size() || entry.size > program.code.size() - entry.offset) {
+        return std::unexpected{error::other_error{"Function code is out of bounds"}};
+      }
+
+      auto code = program.code.subspan(entry.offset, entry.size);
+      for (std::size_t pc = 0; pc < code.size();) {
+        auto instr = decode(code, pc, program.encoding);
+        if (not instr) {
+          return std::unexpected{error::other_error{"Unknown or truncated instruction"}};
+        }
+
+        ++report.instructions;
+        report.operand_bytes += instr->size - op_code_size;
+        switch (instr->op) {
+          case op_code::jmp_s:
+          case op_code::jmpz_s:
+            ++report.short_jumps;
+            break;
+          case op_code::jmp:
+          case op_code::jmpz:
+            ++report.long_jumps;
+            break;
+          case op_code::i64_const_0:
+          case op_code::i64_const_1:
+          case op_code::i64_const_i8:
+          case op_code::i64_const_i16:
+            ++report.compact_constants;
+            break;
+          case op_code::i64_const_pool:
+            ++report.pooled_constants;
+            break;
+          case op_code::i64_const:
+            ++report.inline_constants;
+            break;
+          default:
+            break;
+        }
+        pc += instr->size;
+      }
+    }
+    return report;
+  }
+
+  auto to_string(const size_report &r) -> std::string {
+    return std::format(
+      "code: {} bytes, {} instructions, {} operand bytes\n"
+      "constant pool: {} bytes\n"
+      "jumps: {} short, {} long\n"
+      "constants: {} compact, {} pooled, {} inline",
+      r.code_bytes, r.instructions, r.operand_bytes,
+      r.constant_pool_bytes,
+      r.short_jumps, r.long_jumps,
+      r.compact_constants, r.pooled_constants, r.inline_constants);
+  }
+}
@@ -0,0 +1,486 @@
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/decoder.hpp"
+#include "korka/vm/strings.hpp"
+#include <algorithm>
+#include <optional>
+
+namespace korka::vm {
+  namespace {
+    auto fail(std::string_view message) -> std::unexpected<error_t> {
+      return std::unexpected<error_t>{error::other_error{message}};
+    }
+
+    /**
+     * What a slot is known to hold on every path to an instruction. References only come in
+     * as parameters, so code cannot make one out of a number.
+     */
+    enum class kind : std::uint8_t {
+      number, // a constant or a zeroed local, fine as an int and as a double
+      i64,
+      f64,
+      i64_array,
+      f64_array,
+      str, // never null: a pool string, or a record the caller or a native handed in
+      object,
+      mixed // differs between paths, it can only be dropped or overwritten
+    };
+
+    struct slot_kind {
+      kind what;
+      std::uint32_t object_size{}; // bytes the fields of an object may reach
+
+      constexpr slot_kind(kind k = kind::number, std::uint32_t size = 0) : what(k), object_size(size) {}
+
+      friend auto operator==(const slot_kind &, const slot_kind &) -> bool = default;
+    };
+
+    struct slot_state {
+      std::vector<slot_kind> stack;
+      std::vector<slot_kind> locals;
+    };
+
+    // Kind of a value of the type, parameters and results of calls
+    auto kind_of(type t) -> slot_kind {
+      switch (t) {
+        case type::i64:
+        case type::i8:
+          return kind::i64;
+        case type::f64:
+          return kind::f64;
+        case type::str:
+          return kind::str;
+        default:
+          return kind::number;
+      }
+    }
+
+    auto kind_of(const param_entry &param) -> slot_kind {
+      switch (param.type) {
+        case type::i64_array:
+          return kind::i64_array;
+        case type::f64_array:
+          return kind::f64_array;
+        case type::object:
+          return {kind::object, param.object_size};
+        default:
+          return kind_of(param.type);
+      }
+    }
+
+    // Whether a slot of the kind may be used as a number of the wanted kind
+    auto fits(slot_kind k, kind want) -> bool {
+      return k == want || k == kind::number;
+    }
+
+    // Whether an argument of the kind may be passed for the parameter
+    auto accepts(const param_entry &param, slot_kind k) -> bool {
+      if (param.type == type::object) return k.what == kind::object && k.object_size >= param.object_size;
+      if (is_array(param.type) || param.type == type::str) return k == kind_of(param);
+      return fits(k, kind_of(param).what);
+    }
+
+    auto is_array_kind(slot_kind k) -> bool {
+      return k == kind::i64_array || k == kind::f64_array;
+    }
+
+    // Objects seen through the same slot on different paths only reach the smaller one
+    auto join(slot_kind a, slot_kind b) -> slot_kind {
+      if (a.what == kind::object && b.what == kind::object) return {kind::object, std::min(a.object_size, b.object_size)};
+      if (a == kind::number && (b == kind::i64 || b == kind::f64)) return b;
+      if (b == kind::number && (a == kind::i64 || a == kind::f64)) return a;
+      return a == b ? a : kind::mixed;
+    }
+
+    // Widens `into` to also cover `other`, true if anything changed
+    auto join(slot_state &into, const slot_state &other) -> bool {
+      bool changed = false;
+      auto widen = [&](std::vector<slot_kind> &a, const std::vector<slot_kind> &b) {
+        for (std::size_t i = 0; i < a.size(); ++i) {
+          auto k = join(a[i], b[i]);
+          changed |= k != a[i];
+          a[i] = k;
+        }
+      };
+      widen(into.stack, other.stack);
+      widen(into.locals, other.locals);
+      return changed;
+    }
+
+    auto verify_entry(const program_view &program, const function_entry &entry)
+    -> std::expected<function_facts, error_t> {
+      auto params = params_of(program, entry);
+      if (params.size() != entry.param_count) {
+        return fail("Parameter rows are out of range");
+      }
+      if (is_array(entry.return_type) || entry.return_type == type::object) {
+        return fail("Functions return numbers or strings");
+      }
+      // Host functions have no code to check, callers go through `call_native`
+      if (is_native(entry)) {
+        return function_facts{.max_stack = 0};
+      }
+      if (entry.offset > program.code.size() || entry.size > program.code.size() - entry.offset) {
+        return fail("Function code is out of bounds");
+      }
+      if (entry.size == 0) {
+        return fail("Function has no code");
+      }
+      if (entry.param_count > entry.locals_count) {
+        return fail("Function has fewer locals than parameters");
+      }
+      if (program.encoding == instruction_encoding::words
+          && (entry.offset % sizeof(instruction_word) != 0 || entry.size % sizeof(instruction_word) != 0)) {
+        return fail("Function code is not word aligned");
+      }
+
+      auto code = program.code.subspan(entry.offset, entry.size);
+
+      // Linear pass: instruction boundaries and operands that do not depend on the path
+      std::vector<bool> boundary(code.size(), false);
+      for (std::size_t pc = 0; pc < code.size();) {
+        auto instr = decode(code, pc, program.encoding);
+        if (not instr) {
+          return fail("Unknown or truncated instruction");
+        }
+
+        boundary[pc] = true;
+        switch (instr->op) {
+          case op_code::lload:
+          case op_code::lsave:
+          case op_code::aload:
+          case op_code::asave:
+          case op_code::aload_u:
+          case op_code::asave_u:
+          case op_code::alen:
+            if (instr->operand >= entry.locals_count) return fail("Local index out of range");
+            break;
+          case op_code::pload:
+            if (instr->operand > entry.locals_count) return fail("Local index out of range");
+            break;
+          case op_code::lload_i8:
+          case op_code::lsave_i8:
+            if (instr->operand >= entry.narrow_size) return fail("Local index out of range");
+            break;
+          case op_code::call:
+          case op_code::call_native: {
+            if (static_cast<std::size_t>(instr->operand) >= program.functions.size()) {
+              return fail("Function index out of range");
+            }
+            const auto &callee = program.functions[static_cast<std::size_t>(instr->operand)];
+            if (is_native(callee) != (instr->op == op_code::call_native)) {
+              return fail("Call does not match the kind of the function");
+            }
+            // Checked here too, a lazy verifier may not have seen the callee yet
+            if (params_of(program, callee).size() != callee.param_count) {
+              return fail("Parameter rows are out of range");
+            }
+            break;
+          }
+          case op_code::i64_const_pool:
+            if (static_cast<std::size_t>(instr->operand) >= program.constants.size()) {
+              return fail("Constant index out of range");
+            }
+            break;
+          case op_code::str_const:
+            if (static_cast<std::size_t>(instr->operand) >= program.constants.size()) {
+              return fail("Constant index out of range");
+            }
+            if (not string_in_pool(program.strings, program.constants[static_cast<std::size_t>(instr->operand)])) {
+              return fail("String constant is out of the string pool");
+            }
+            break;
+          case op_code::ret:
+            if (entry.return_type == type::void_) return fail("Void function returns a value");
+            break;
+          case op_code::ret_void:
+            if (entry.return_type != type::void_) return fail("Function returns without a value");
+            break;
+          default:
+            break;
+        }
+        pc += instr->size;
+      }
+
+      // Path pass: stack depth and slot kinds on entry to every reachable instruction, joined
+      // over the paths until nothing changes
+      std::uint32_t max_stack = entry.param_count;
+      std::vector<std::optional<slot_state>> states(code.size());
+      std::vector<std::size_t> pending{0};
+      states[0] = slot_state{{}, std::vector<slot_kind>(entry.locals_count, kind::number)};
+      for (const auto &param: params) states[0]->stack.push_back(kind_of(param));
+
+      auto flow_to = [&](std::int64_t target, const slot_state &s) -> std::expected<void, error_t> {
+        if (target < 0 || static_cast<std::size_t>(target) >= code.size()) {
+          return fail("Execution leaves the function");
+        }
+        auto t = static_cast<std::size_t>(target);
+        if (not boundary[t]) {
+          return fail("Jump into the middle of an instruction");
+        }
+        if (not states[t]) {
+          states[t] = s;
+          pending.push_back(t);
+        } else if (states[t]->stack.size() != s.stack.size()) {
+          return fail("Stack depth differs between paths");
+        } else if (join(*states[t], s)) {
+          pending.push_back(t);
+        }
+        return {};
+      };
+
+      while (not pending.empty()) {
+        auto pc = pending.back();
+        pending.pop_back();
+
+        auto instr = *decode(code, pc, program.encoding);
+        auto [pops, pushes] = effect_of(instr, program.functions);
+        auto s = *states[pc];
+        if (pops > static_cast<std::int64_t>(s.stack.size())) {
+          return fail("Stack underflow");
+        }
+
+        auto pop = [&] {
+          auto k = s.stack.back();
+          s.stack.pop_back();
+          return k;
+        };
+        auto local = [&]() -> slot_kind & { return s.locals[static_cast<std::size_t>(instr.operand)]; };
+        switch (instr.op) {
+          case op_code::lload:
+            s.stack.push_back(local());
+            break;
+          case op_code::lsave:
+            if (is_array_kind(local())) return fail("Array parameter is overwritten");
+            local() = pop();
+            break;
+          case op_code::pload:
+            for (auto i = static_cast<std::size_t>(instr.operand); i-- > 0;) {
+              auto k = pop();
+              if (is_array_kind(s.locals[i]) && k != s.locals[i]) return fail("Array parameter is overwritten");
+              s.locals[i] = k;
+            }
+            break;
+          case op_code::aload:
+          case op_code::aload_u:
+          case op_code::asave:
+          case op_code::asave_u:
+          case op_code::alen: {
+            if (not is_array_kind(local())) {
+              return fail("Array op on a slot that is not an array");
+            }
+            auto element = local() == kind::f64_array ? kind::f64 : kind::i64;
+            if (instr.op == op_code::alen) {
+              s.stack.push_back(kind::i64);
+              break;
+            }
+            bool save = instr.op == op_code::asave || instr.op == op_code::asave_u;
+            if (save && not fits(pop(), element)) return fail("Operand kind does not match the op");
+            if (not fits(pop(), kind::i64)) return fail("Operand kind does not match the op");
+            if (not save) s.stack.push_back(element);
+            break;
+          }
+          case op_code::call:
+          case op_code::call_native: {
+            const auto &callee = program.functions[static_cast<std::size_t>(instr.operand)];
+            auto callee_params = params_of(program, callee);
+            auto args = std::span{s.stack}.last(callee.param_count);
+            for (std::size_t i = 0; i < args.size(); ++i) {
+              if (not accepts(callee_params[i], args[i])) return fail("Argument kind does not match the parameter");
+            }
+            s.stack.resize(s.stack.size() - callee.param_count);
+            if (pushes) s.stack.push_back(kind_of(callee.return_type));
+            break;
+          }
+          case op_code::fload:
+          case op_code::fload_i8:
+          case op_code::fsave:
+          case op_code::fsave_i8: {
+            bool narrow = instr.op == op_code::fload_i8 || instr.op == op_code::fsave_i8;
+            bool save = instr.op == op_code::fsave || instr.op == op_code::fsave_i8;
+            // The field type is not in the code, a full field takes an int or a double
+            if (save) {
+              auto value = pop();
+              if (not (narrow ? fits(value, kind::i64) : fits(value, kind::i64) || fits(value, kind::f64))) {
+                return fail("Operand kind does not match the op");
+              }
+            }
+            auto object = pop();
+            auto end = static_cast<std::uint64_t>(instr.operand) + (narrow ? sizeof(std::int8_t) : sizeof(std::int64_t));
+            if (object.what != kind::object) return fail("Field op on a slot that is not an object");
+            if (end > object.object_size) return fail("Field lies outside of the object");
+            if (not save) s.stack.push_back(narrow ? kind::i64 : kind::number);
+            break;
+          }
+          case op_code::str_const:
+            s.stack.push_back(kind::str);
+            break;
+          case op_code::str_eq:
+          case op_code::str_ne:
+            if (pop() != kind::str || pop() != kind::str) return fail("String op on a slot that is not a string");
+            s.stack.push_back(kind::i64);
+            break;
+
+          case op_code::i64_add:
+          case op_code::i64_sub:
+          case op_code::i64_mul:
+          case op_code::i64_div:
+          case op_code::i64_eq:
+          case op_code::i64_ne:
+          case op_code::i64_lt:
+          case op_code::i64_le:
+          case op_code::i64_gt:
+          case op_code::i64_ge:
+            if (not fits(pop(), kind::i64) || not fits(pop(), kind::i64)) return fail("Operand kind does not match the op");
+            s.stack.push_back(kind::i64);
+            break;
+          case op_code::f64_add:
+          case op_code::f64_sub:
+          case op_code::f64_mul:
+          case op_code::f64_div:
+            if (not fits(pop(), kind::f64) || not fits(pop(), kind::f64)) return fail("Operand kind does not match the op");
+            s.stack.push_back(kind::f64);
+            break;
+          case op_code::f64_eq:
+          case op_code::f64_ne:
+          case op_code::f64_lt:
+          case op_code::f64_le:
+          case op_code::f64_gt:
+          case op_code::f64_ge:
+            if (not fits(pop(), kind::f64) || not fits(pop(), kind::f64)) return fail("Operand kind does not match the op");
+            s.stack.push_back(kind::i64);
+            break;
+          case op_code::i64_to_f64:
+            if (not fits(pop(), kind::i64)) return fail("Operand kind does not match the op");
+            s.stack.push_back(kind::f64);
+            break;
+          case op_code::f64_to_i64:
+            if (not fits(pop(), kind::f64)) return fail("Operand kind does not match the op");
+            s.stack.push_back(kind::i64);
+            break;
+          case op_code::lload_i8:
+            s.stack.push_back(kind::i64);
+            break;
+          case op_code::lsave_i8:
+          case op_code::jmpz:
+          case op_code::jmpz_s:
+          case op_code::yield:
+            if (not fits(pop(), kind::i64)) return fail("Operand kind does not match the op");
+            break;
+
+          case op_code::ret: {
+            // Strings have to be strings, numbers only have to be of the declared kind
+            auto value = s.stack.back();
+            bool ok = entry.return_type == type::str ? value == kind::str : fits(value, kind_of(entry.return_type).what);
+            if (not ok) return fail("Returned value does not match the return type");
+            break;
+          }
+          default:
+            // Constants, pop, jumps and ret_void
+            s.stack.resize(s.stack.size() - static_cast<std::size_t>(pops));
+            for (std::int64_t i = 0; i < pushes; ++i) s.stack.push_back(kind::number);
+            break;
+        }
+        max_stack = std::max(max_stack, static_cast<std::uint32_t>(s.stack.size()));
+
+        auto next = static_cast<std::int64_t>(pc + instr.size);
+        auto target = static_cast<std::int64_t>(pc) + instr.operand;
+        std::expected<void, error_t> ok{};
+        switch (instr.op) {
+          case op_code::ret:
+          case op_code::ret_void:
+            break;
+          case op_code::jmp:
+          case op_code::jmp_s:
+            ok = flow_to(target, s);
+            break;
+          case op_code::jmpz:
+          case op_code::jmpz_s:
+            ok = flow_to(target, s);
+            if (ok) ok = flow_to(next, s);
+            break;
+          default:
+            ok = flow_to(next, s);
+            break;
+        }
+        if (not ok) {
+          return std::unexpected{ok.error()};
+        }
+      }
+
+      auto first = *decode(code, 0, program.encoding);
+      bool in_place = first.op == op_code::pload && first.operand == entry.param_count;
+      return function_facts{
+        .max_stack = max_stack,
+        .body_offset = in_place ? static_cast<std::uint32_t>(first.size) : 0
+      };
+    }
+  }
+
+  auto verify(const program_view &program) -> std::expected<std::vector<function_facts>, error_t> {
+    std::vector<function_facts> facts;
+    facts.reserve(program.functions.size());
+
+    for (const auto &entry: program.functions) {
+      auto f = verify_entry(program, entry);
+      if (not f) {
+        return std::unexpected{f.error()};
+      }
+      facts.push_back(*f);
+    }
+    return facts;
+  }
+
+  auto verify_function(const program_view &program, std::size_t function) -> std::expected<function_facts, error_t> {
+    if (function >= program.functions.size()) {
+      return fail("Function index out of range");
+    }
+    return verify_entry(program, program.functions[function]);
+  }
+
+  // --- lazy_verifier ---
+
+  lazy_verifier::lazy_verifier(std::size_t function_count)
+    : m_count(function_count),
+      m_state(std::make_unique<std::atomic<std::uint32_t>[]>(function_count)),
+      m_facts(std::make_unique<function_facts[]>(function_count)),
+      m_errors(std::make_unique<std::optional<error_t>[]>(function_count)) {}
+
+  auto lazy_verifier::verified_count() const -> std::size_t {
+    std::size_t n{};
+    for (std::size_t i = 0; i < m_count; ++i) {
+      if (m_state[i].load(std::memory_order_relaxed) == ready) ++n;
+    }
+    return n;
+  }
+
+  auto lazy_verifier::prepare(const program_view &program, std::size_t function) -> std::expected<void, error_t> {
+    if (function >= m_count) {
+      return fail("Function index out of range");
+    }
+
+    auto &state = m_state[function];
+    auto current = state.load(std::memory_order_acquire);
+    if (current == unverified && state.compare_exchange_strong(current, verifying, std::memory_order_acquire)) {
+      auto facts = verify_function(program, function);
+      if (facts) {
+        m_facts[function] = *facts;
+        state.store(ready, std::memory_order_release);
+      } else {
+        m_errors[function] = facts.error();
+        state.store(failed, std::memory_order_release);
+      }
+      state.notify_all();
+      current = state.load(std::memory_order_acquire);
+    }
+
+    while (current == verifying) {
+      state.wait(verifying, std::memory_order_acquire);
+      current = state.load(std::memory_order_acquire);
+    }
+
+    if (current == failed) {
+      return std::unexpected{*m_errors[function]};
+    }
+    return {};
+  }
+}
@@ -3,6 +3,1603 @@
 //
 
 #include "korka/vm/vm_runtime.hpp"
+#include "korka/vm/arrays.hpp"
+#include "korka/vm/decoder.hpp"
+#include "korka/vm/f64.hpp"
+#include "korka/vm/op_codes.hpp"
+#include "korka/vm/strings.hpp"
+#include "korka/vm/structs.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
 
 namespace korka {
-} // korka
\ No newline at end of file
+  namespace {
+    auto fail(std::string_view message) -> std::unexpected<error_t> {
+      return std::unexpected<error_t>{error::other_runtime_error{message}};
+    }
+
+    template<class T>
+    auto read(std::span<const std::byte> code, std::size_t &pc) -> T {
+      T value;
+      std::memcpy(&value, code.data() + pc, sizeof(T));
+      pc += sizeof(T);
+      return value;
+    }
+
+    using vm::instruction_encoding;
+
+    /**
+     * Op code at `pc`. Moves `pc` to the operand in the byte encoding and past the whole
+     * instruction in the word encoding, where the operand stays in `word`.
+     */
+    template<instruction_encoding Encoding>
+    auto fetch(std::span<const std::byte> code, std::size_t &pc, vm::instruction_word &word) -> vm::op_code {
+      if constexpr (Encoding == instruction_encoding::words) {
+        word = read<vm::instruction_word>(code, pc);
+        return static_cast<vm::op_code>(word & 0xff);
+      } else {
+        return static_cast<vm::op_code>(read<std::uint8_t>(code, pc));
+      }
+    }
+
+    template<class T, instruction_encoding Encoding>
+    auto operand(std::span<const std::byte> code, std::size_t &pc, vm::instruction_word word) -> T {
+      if constexpr (Encoding == instruction_encoding::words) {
+        return vm::word_operand<T>(word);
+      } else {
+        return read<T>(code, pc);
+      }
+    }
+
+    template<instruction_encoding Encoding>
+    auto pool_index(std::span<const std::byte> code, std::size_t &pc, vm::instruction_word word) -> std::size_t {
+      if constexpr (Encoding == instruction_encoding::words) {
+        return word >> 8;
+      } else {
+        return read<vm::constant_index_t>(code, pc);
+      }
+    }
+
+    // Wrapping arithmetic, overflow in a script must not be UB in the host
+    auto wrap(std::uint64_t v) -> vm::stack_value_t {
+      return static_cast<vm::stack_value_t>(v);
+    }
+
+    // The verified loop reads through references unchecked, so they have to be there
+    auto check_references(const vm::program_view &program, const vm::function_entry &entry,
+                          std::span<const vm::stack_value_t> args) -> std::expected<void, error_t> {
+      auto params = vm::params_of(program, entry);
+      for (std::size_t i = 0; i < params.size() && i < args.size(); ++i) {
+        if (args[i] != 0) continue;
+        if (is_array(params[i].type)) return fail("Array argument is missing");
+        if (params[i].type == type::str) return fail("String argument is missing");
+        if (params[i].type == type::object) return fail("Object argument is missing");
+      }
+      return {};
+    }
+
+    // The reference the host passed as `value` that `accepts`, null if there is none
+    auto host_reference_of(std::span<const vm::host_reference> references, vm::stack_value_t value, auto accepts)
+      -> const vm::host_reference * {
+      auto it = std::ranges::find_if(references, [&](const vm::host_reference &r) {
+        return r.value == value && accepts(r);
+      });
+      return it == references.end() ? nullptr : &*it;
+    }
+
+    // Whether `object` is an object argument the field of `width` bytes at `offset` lies in
+    auto object_holds(std::span<const vm::host_reference> references, vm::stack_value_t object,
+                      std::size_t offset, std::size_t width) -> bool {
+      return host_reference_of(references, object, [&](const vm::host_reference &r) {
+        return r.type == type::object && offset + width <= r.object_size;
+      }) != nullptr;
+    }
+
+    // Whether `value` is a pool record or a string the host handed in, as an argument or a native result
+    auto string_known(const vm::program_view &program, std::span<const vm::host_reference> references,
+                      vm::stack_value_t value) -> bool {
+      auto address = static_cast<std::uintptr_t>(value);
+      auto pool = reinterpret_cast<std::uintptr_t>(program.strings.data());
+      if (address >= pool && address - pool < program.strings.size()) {
+        return vm::string_in_pool(program.strings, static_cast<vm::stack_value_t>(address - pool));
+      }
+      return host_reference_of(references, value, [](const vm::host_reference &r) {
+        return r.type == type::str;
+      }) != nullptr;
+    }
+
+    // Binding of a native row, null when the program is not linked or leaves it unbound
+    auto native_of(const vm::program_view &program, std::size_t index) -> const vm::native_function * {
+      if (not program.natives || not program.natives[index].bound()) {
+        return nullptr;
+      }
+      return &program.natives[index];
+    }
+
+    // Outside of coroutines an asynchronous native blocks the calling thread
+    auto call_blocking(const vm::native_function &native, std::span<const vm::stack_value_t> args)
+      -> vm::stack_value_t {
+      if (native.sync) {
+        return native.sync(args);
+      }
+      auto state = std::make_shared<vm::native_state>();
+      native.async(args, vm::native_call{state});
+      return state->wait();
+    }
+  }
+
+  auto runtime::call(const vm::program_view &program, std::size_t function,
+                     std::span<const vm::stack_value_t> args) -> result_t {
+    if (function >= program.functions.size()) {
+      return fail("Function index out of range");
+    }
+
+    const auto &entry = program.functions[function];
+    if (vm::is_native(entry)) {
+      return fail("Native functions are called by scripts");
+    }
+    if (args.size() != entry.param_count) {
+      return fail("Argument count mismatch");
+    }
+
+    enter(program, entry, function, args);
+    if (program.encoding == instruction_encoding::words) {
+      return run<instruction_encoding::words>(program, entry.offset);
+    }
+    return run<instruction_encoding::bytes>(program, entry.offset);
+  }
+
+  auto runtime::enter(const vm::program_view &program, const vm::function_entry &entry, std::size_t function,
+                      std::span<const vm::stack_value_t> args) -> void {
+    // The compiler knows how deep the outermost frame gets, deeper calls grow the stack
+    m_stack.reserve(entry.max_stack);
+    m_stack.assign(args.begin(), args.end());
+    m_locals.assign(entry.locals_count, 0);
+    m_narrow.assign(entry.narrow_size, 0);
+    m_frames.clear();
+    m_references.clear();
+    auto params = vm::params_of(program, entry);
+    for (std::size_t i = 0; i < params.size() && i < args.size(); ++i) {
+      if (is_reference(params[i].type) && args[i] != 0) {
+        m_references.push_back({args[i], params[i].type, params[i].object_size});
+      }
+    }
+    m_fuel = m_fuel_limit;
+    ++m_counters.invocations;
+    m_frames.push_back({
+      .return_pc = 0,
+      .stack_base = 0,
+      .locals_base = 0,
+      .function = function
+    });
+  }
+
+  auto runtime::keep_string(vm::stack_value_t value) -> void {
+    if (value == 0 || std::ranges::find(m_references, value, &vm::host_reference::value) != m_references.end()) {
+      return;
+    }
+    m_references.push_back({value, type::str});
+  }
+
+  template<vm::instruction_encoding Encoding>
+  auto runtime::run(const vm::program_view &program, std::size_t start, suspension *suspend) -> result_t {
+    using vm::op_code;
+    constexpr bool words = Encoding == instruction_encoding::words;
+
+    const auto code = program.code;
+
+    // State of the innermost frame, reloaded on every call and return
+    std::size_t begin{}, end{}, pc{};
+    std::size_t locals_base{}, locals_count{};
+    std::size_t narrow_base{}, narrow_size{};
+
+    auto load_frame = [&](const frame &f) {
+      const auto &entry = program.functions[f.function];
+      begin = entry.offset;
+      end = std::min<std::size_t>(entry.offset + entry.size, code.size());
+      locals_base = f.locals_base;
+      locals_count = entry.locals_count;
+      narrow_base = f.narrow_base;
+      narrow_size = entry.narrow_size;
+    };
+
+    load_frame(m_frames.back());
+    pc = start;
+
+    auto can_read = [&](std::size_t bytes) {
+      return pc >= begin && pc + bytes <= end;
+    };
+
+    // Operands of word encoded instructions were read with the op code
+    auto truncated = [&](std::size_t bytes) {
+      return not words && not can_read(bytes);
+    };
+
+    auto pop = [&] {
+      auto value = m_stack.back();
+      m_stack.pop_back();
+      return value;
+    };
+
+    auto stack_size = [&] {
+      return m_stack.size() - m_frames.back().stack_base;
+    };
+
+    // Leaves the current frame, true if it was the outermost one
+    auto leave = [&] {
+      auto f = m_frames.back();
+      m_frames.pop_back();
+      m_stack.resize(f.stack_base);
+      m_locals.resize(f.locals_base);
+      m_narrow.resize(f.narrow_base);
+      if (m_frames.empty()) {
+        return true;
+      }
+      load_frame(m_frames.back());
+      pc = f.return_pc;
+      return false;
+    };
+
+    // The instruction that spent the last unit is complete, a coroutine continues at `pc`
+    auto out_of_fuel = [&]() -> result_t {
+      if (suspend) {
+        *suspend = {.pc = pc, .preempted = true};
+        return 0;
+      }
+      return fail("Out of fuel");
+    };
+
+    while (true) {
+      auto instr_pc = pc;
+      if (not can_read(words ? sizeof(vm::instruction_word) : vm::op_code_size)) {
+        return fail("Execution left the function code");
+      }
+
+      vm::instruction_word word{};
+      auto op = fetch<Encoding>(code, pc, word);
+      switch (op) {
+        case op_code::lload: {
+          if (truncated(sizeof(vm::local_index_t))) return fail("Truncated instruction");
+          auto index = operand<vm::local_index_t, Encoding>(code, pc, word);
+          if (index >= locals_count) return fail("Local index out of range");
+          m_stack.push_back(m_locals[locals_base + index]);
+          break;
+        }
+        case op_code::lsave: {
+          if (truncated(sizeof(vm::local_index_t))) return fail("Truncated instruction");
+          auto index = operand<vm::local_index_t, Encoding>(code, pc, word);
+          if (index >= locals_count) return fail("Local index out of range");
+          if (stack_size() < 1) return fail("Stack underflow");
+          m_locals[locals_base + index] = pop();
+          break;
+        }
+        case op_code::pload: {
+          if (truncated(sizeof(std::uint8_t))) return fail("Truncated instruction");
+          auto count = operand<std::uint8_t, Encoding>(code, pc, word);
+          if (count > locals_count) return fail("Local index out of range");
+          if (stack_size() < count) return fail("Stack underflow");
+          for (std::size_t i = count; i-- > 0;) {
+            m_locals[locals_base + i] = pop();
+          }
+          break;
+        }
+        case op_code::lload_i8: {
+          if (truncated(sizeof(vm::local_index_t))) return fail("Truncated instruction");
+          auto index = operand<vm::local_index_t, Encoding>(code, pc, word);
+          if (index >= narrow_size) return fail("Local index out of range");
+          m_stack.push_back(m_narrow[narrow_base + index]);
+          break;
+        }
+        case op_code::lsave_i8: {
+          if (truncated(sizeof(vm::local_index_t))) return fail("Truncated instruction");
+          auto index = operand<vm::local_index_t, Encoding>(code, pc, word);
+          if (index >= narrow_size) return fail("Local index out of range");
+          if (stack_size() < 1) return fail("Stack underflow");
+          m_narrow[narrow_base + index] = static_cast<std::int8_t>(pop());
+          break;
+        }
+        case op_code::i64_const: {
+          // Has no word form, wide values live in the constant pool there
+          if (words) return fail("Unknown op code");
+          if (truncated(sizeof(std::int64_t))) return fail("Truncated instruction");
+          m_stack.push_back(read<std::int64_t>(code, pc));
+          break;
+        }
+        case op_code::i64_const_0:
+          m_stack.push_back(0);
+          break;
+        case op_code::i64_const_1:
+          m_stack.push_back(1);
+          break;
+        case op_code::i64_const_i8: {
+          if (truncated(sizeof(std::int8_t))) return fail("Truncated instruction");
+          m_stack.push_back(operand<std::int8_t, Encoding>(code, pc, word));
+          break;
+        }
+        case op_code::i64_const_i16: {
+          if (truncated(sizeof(std::int16_t))) return fail("Truncated instruction");
+          m_stack.push_back(operand<std::int16_t, Encoding>(code, pc, word));
+          break;
+        }
+        case op_code::i64_const_pool: {
+          if (truncated(sizeof(vm::constant_index_t))) return fail("Truncated instruction");
+          auto index = pool_index<Encoding>(code, pc, word);
+          if (index >= program.constants.size()) return fail("Constant index out of range");
+          m_stack.push_back(program.constants[index]);
+          break;
+        }
+        case op_code::str_const: {
+          if (truncated(sizeof(vm::constant_index_t))) return fail("Truncated instruction");
+          auto index = pool_index<Encoding>(code, pc, word);
+          if (index >= program.constants.size()) return fail("Constant index out of range");
+          if (not vm::string_in_pool(program.strings, program.constants[index])) {
+            return fail("String constant is out of the string pool");
+          }
+          m_stack.push_back(vm::string_at(program.strings, program.constants[index]));
+          break;
+        }
+        case op_code::pop: {
+          if (stack_size() < 1) return fail("Stack underflow");
+          m_stack.pop_back();
+          break;
+        }
+
+        case op_code::i64_add:
+        case op_code::i64_sub:
+        case op_code::i64_mul:
+        case op_code::i64_div: {
+          if (stack_size() < 2) return fail("Stack underflow");
+          auto a = pop();
+          auto b = pop();
+          auto ua = static_cast<std::uint64_t>(a), ub = static_cast<std::uint64_t>(b);
+
+          vm::stack_value_t c{};
+          if (op == op_code::i64_add) c = wrap(ub + ua);
+          else if (op == op_code::i64_sub) c = wrap(ub - ua);
+          else if (op == op_code::i64_mul) c = wrap(ub * ua);
+          else {
+            if (a == 0) return fail("Division by zero");
+            c = (a == -1) ? wrap(0 - ub) : b / a;
+          }
+          m_stack.push_back(c);
+          break;
+        }
+
+        case op_code::f64_add:
+        case op_code::f64_sub:
+        case op_code::f64_mul:
+        case op_code::f64_div:
+        case op_code::f64_eq:
+        case op_code::f64_ne:
+        case op_code::f64_lt:
+        case op_code::f64_le:
+        case op_code::f64_gt:
+        case op_code::f64_ge: {
+          if (stack_size() < 2) return fail("Stack underflow");
+          auto a = vm::as_f64(pop());
+          auto b = vm::as_f64(pop());
+          m_stack.push_back(vm::f64_binary(op, b, a));
+          break;
+        }
+        case op_code::i64_to_f64:
+          if (stack_size() < 1) return fail("Stack underflow");
+          m_stack.back() = vm::from_f64(static_cast<double>(m_stack.back()));
+          break;
+        case op_code::f64_to_i64:
+          if (stack_size() < 1) return fail("Stack underflow");
+          m_stack.back() = vm::f64_to_i64(vm::as_f64(m_stack.back()));
+          break;
+
+        case op_code::i64_eq:
+        case op_code::i64_ne:
+        case op_code::i64_lt:
+        case op_code::i64_le:
+        case op_code::i64_gt:
+        case op_code::i64_ge: {
+          if (stack_size() < 2) return fail("Stack underflow");
+          auto a = pop();
+          auto b = pop();
+          m_stack.push_back(vm::i64_compare(op, b, a));
+          break;
+        }
+
+        case op_code::str_eq:
+        case op_code::str_ne: {
+          if (stack_size() < 2) return fail("Stack underflow");
+          auto a = pop();
+          auto b = pop();
+          if (a == 0 || b == 0) return fail("String argument is missing");
+          if (not string_known(program, m_references, a) || not string_known(program, m_references, b)) {
+            return fail("Value is not a string");
+          }
+          m_stack.push_back(vm::strings_equal(program.strings, b, a) == (op == op_code::str_eq));
+          break;
+        }
+
+        case op_code::aload:
+        case op_code::asave:
+        case op_code::aload_u:
+        case op_code::asave_u:
+        case op_code::alen: {
+          if (truncated(sizeof(vm::local_index_t))) return fail("Truncated instruction");
+          auto index = operand<vm::local_index_t, Encoding>(code, pc, word);
+          if (index >= locals_count) return fail("Local index out of range");
+          auto slot = m_locals[locals_base + index];
+          if (slot == 0) return fail("Array argument is missing");
+          if (not host_reference_of(m_references, slot, [](const vm::host_reference &r) { return is_array(r.type); })) {
+            return fail("Local does not hold an array argument");
+          }
+          const auto &array = vm::as_array(slot);
+          if (op == op_code::alen) {
+            m_stack.push_back(static_cast<vm::stack_value_t>(array.size));
+            break;
+          }
+
+          // Indices the compiler proved are checked here all the same
+          bool save = op == op_code::asave || op == op_code::asave_u;
+          if (stack_size() < (save ? 2u : 1u)) return fail("Stack underflow");
+          auto value = save ? pop() : 0;
+          auto i = pop();
+          if (not vm::array_in_bounds(array, i)) return fail("Array index out of range");
+          if (save) {
+            vm::array_store(array, i, value);
+          } else {
+            m_stack.push_back(vm::array_load(array, i));
+          }
+          break;
+        }
+
+        case op_code::fload:
+        case op_code::fload_i8: {
+          if (truncated(sizeof(vm::field_offset_t))) return fail("Truncated instruction");
+          auto offset = operand<vm::field_offset_t, Encoding>(code, pc, word);
+          if (stack_size() < 1) return fail("Stack underflow");
+          auto object = pop();
+          if (object == 0) return fail("Object argument is missing");
+          if (not object_holds(m_references, object, offset, op == op_code::fload ? sizeof(std::int64_t) : sizeof(std::int8_t))) {
+            return fail("Field is not inside an object argument");
+          }
+          m_stack.push_back(op == op_code::fload ? vm::field_load(object, offset) : vm::field_load_i8(object, offset));
+          break;
+        }
+        case op_code::fsave:
+        case op_code::fsave_i8: {
+          if (truncated(sizeof(vm::field_offset_t))) return fail("Truncated instruction");
+          auto offset = operand<vm::field_offset_t, Encoding>(code, pc, word);
+          if (stack_size() < 2) return fail("Stack underflow");
+          auto value = pop();
+          auto object = pop();
+          if (object == 0) return fail("Object argument is missing");
+          if (not object_holds(m_references, object, offset, op == op_code::fsave ? sizeof(std::int64_t) : sizeof(std::int8_t))) {
+            return fail("Field is not inside an object argument");
+          }
+          if (op == op_code::fsave) {
+            vm::field_store(object, offset, value);
+          } else {
+            vm::field_store_i8(object, offset, value);
+          }
+          break;
+        }
+
+        case op_code::jmp:
+        case op_code::jmpz:
+        case op_code::jmp_s:
+        case op_code::jmpz_s: {
+          bool is_short = op == op_code::jmp_s || op == op_code::jmpz_s;
+          auto operand_size = is_short ? sizeof(vm::short_jump_offset) : sizeof(vm::jump_offset);
+          if (truncated(operand_size)) return fail("Truncated instruction");
+          auto offset = is_short ? operand<vm::short_jump_offset, Encoding>(code, pc, word)
+                                 : operand<vm::jump_offset, Encoding>(code, pc, word);
+          bool taken = true;
+          if (op == op_code::jmpz || op == op_code::jmpz_s) {
+            if (stack_size() < 1) return fail("Stack underflow");
+            taken = pop() == 0;
+          }
+          if (taken) {
+            // Landing outside of the function is caught by the next fetch
+            pc = instr_pc + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(offset));
+            if (offset <= 0 && --m_fuel == 0) return out_of_fuel();
+          }
+          break;
+        }
+
+        case op_code::call: {
+          ++m_counters.calls;
+          if (truncated(sizeof(vm::function_index_t))) return fail("Truncated instruction");
+          auto index = operand<vm::function_index_t, Encoding>(code, pc, word);
+          if (index >= program.functions.size()) return fail("Function index out of range");
+          if (m_frames.size() >= max_call_depth) return fail("Call stack overflow");
+
+          const auto &callee = program.functions[index];
+          if (stack_size() < callee.param_count) return fail("Stack underflow");
+
+          frame f{
+            .return_pc = pc,
+            .stack_base = m_stack.size() - callee.param_count,
+            .locals_base = m_locals.size(),
+            .function = index,
+            .narrow_base = m_narrow.size()
+          };
+          m_frames.push_back(f);
+          m_locals.resize(m_locals.size() + callee.locals_count);
+          m_narrow.resize(m_narrow.size() + callee.narrow_size);
+          load_frame(f);
+          pc = begin;
+          if (--m_fuel == 0) return out_of_fuel();
+          break;
+        }
+
+        case op_code::call_native: {
+          ++m_counters.native_calls;
+          if (truncated(sizeof(vm::function_index_t))) return fail("Truncated instruction");
+          auto index = operand<vm::function_index_t, Encoding>(code, pc, word);
+          if (index >= program.functions.size()) return fail("Function index out of range");
+          const auto &callee = program.functions[index];
+          if (not vm::is_native(callee)) return fail("Not a native function");
+          if (stack_size() < callee.param_count) return fail("Stack underflow");
+          const auto *native = native_of(program, index);
+          if (not native) return fail("Unbound native function");
+
+          auto args = std::span<const vm::stack_value_t>{m_stack}.last(callee.param_count);
+          bool returns = callee.return_type != type::void_;
+          bool string = callee.return_type == type::str;
+          if (native->async && suspend) {
+            // A coroutine is suspended unless the native completed right away
+            auto state = std::make_shared<vm::native_state>();
+            native->async(args, vm::native_call{state});
+            m_stack.resize(m_stack.size() - callee.param_count);
+            if (not state->ready()) {
+              *suspend = {.pc = pc, .preempted = false, .native = std::move(state), .native_returns = returns,
+                          .native_string = string};
+              return 0;
+            }
+            if (returns) m_stack.push_back(state->value());
+            if (string) keep_string(state->value());
+            break;
+          }
+
+          auto value = call_blocking(*native, args);
+          m_stack.resize(m_stack.size() - callee.param_count);
+          if (returns) m_stack.push_back(value);
+          if (string) keep_string(value);
+          break;
+        }
+
+        case op_code::ret: {
+          if (stack_size() < 1) return fail("Stack underflow");
+          auto value = pop();
+          if (leave()) {
+            return value;
+          }
+          m_stack.push_back(value);
+          break;
+        }
+        case op_code::ret_void: {
+          if (leave()) {
+            return 0;
+          }
+          break;
+        }
+
+        case op_code::yield: {
+          if (not suspend) return fail("Yield outside of a coroutine");
+          if (stack_size() < 1) return fail("Stack underflow");
+          *suspend = {.pc = pc, .preempted = false};
+          return pop();
+        }
+
+        default:
+          return fail("Unknown op code");
+      }
+    }
+  }
+
+  // --- VERIFIED PATH ---
+
+  auto runtime::call_verified(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                              vm::lazy_verifier *lazy, std::size_t function,
+                              std::span<const vm::stack_value_t> args) -> result_t {
+    if (function >= program.functions.size() || facts.size() != program.functions.size()) {
+      return fail("Function index out of range");
+    }
+    if (lazy) {
+      if (auto ok = lazy->ensure(program, function); not ok) {
+        return std::unexpected{ok.error()};
+      }
+    }
+
+    const auto &entry = program.functions[function];
+    if (vm::is_native(entry)) {
+      return fail("Native functions are called by scripts");
+    }
+    if (args.size() != entry.param_count) {
+      return fail("Argument count mismatch");
+    }
+    if (auto ok = check_references(program, entry, args); not ok) {
+      return std::unexpected{ok.error()};
+    }
+
+    enter_verified(entry, facts[function], function, args);
+    if (program.encoding == instruction_encoding::words) {
+      return run_verified<instruction_encoding::words>(program, facts, lazy);
+    }
+    return run_verified<instruction_encoding::bytes>(program, facts, lazy);
+  }
+
+  auto runtime::enter_verified(const vm::function_entry &entry, const vm::function_facts &facts,
+                               std::size_t function, std::span<const vm::stack_value_t> args) -> void {
+    // The stack is sized up front and only grows on calls, the loop indexes it directly.
+    // Slot 0 is where the cached top spills while the stack is empty, see run_verified
+    m_stack.resize(std::max<std::size_t>(m_stack.size(), entry.locals_count + facts.max_stack + 2));
+    std::ranges::copy(args, m_stack.begin() + 1);
+    m_narrow.resize(std::max<std::size_t>(m_narrow.size(), entry.narrow_size));
+    m_frames.clear();
+    m_fuel = m_fuel_limit;
+    ++m_counters.invocations;
+    m_frames.push_back({
+      .return_pc = 0,
+      .stack_base = 0,
+      .locals_base = 1,
+      .function = function
+    });
+  }
+
+  template<vm::instruction_encoding Encoding>
+  auto runtime::run_verified(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                             vm::lazy_verifier *lazy) -> result_t {
+    using vm::op_code;
+
+    const auto code = program.code;
+
+    // Frames overlap on the one stack: a frame's locals start where the caller pushed its
+    // arguments, so they become the first locals without a copy, and its operands follow.
+    //
+    // The top operand lives in `tos`, value k below it in m_stack[sp - k]. A push spills the
+    // old top to m_stack[sp] first, on an empty operand stack that is the junk slot under it,
+    // so no handler has to care whether the stack is empty. Return values come back in `tos`.
+    std::size_t pc{};
+    std::size_t sp = 0;
+    vm::stack_value_t tos{};
+    std::size_t locals_base = 1;
+    std::size_t narrow_base = 0, narrow_top = 0;
+
+    // The arguments are spilled at locals_base, the operand stack starts above the locals
+    auto open = [&](std::size_t function) {
+      const auto &entry = program.functions[function];
+      const auto &f = facts[function];
+      auto locals = m_stack.begin() + static_cast<std::ptrdiff_t>(locals_base);
+      auto params = static_cast<std::ptrdiff_t>(entry.param_count);
+      pc = entry.offset + f.body_offset;
+      sp = locals_base + entry.locals_count;
+      if (f.body_offset == 0 && params > 0) {
+        // Code that works on its arguments as operands, they move above the locals
+        tos = locals[params - 1];
+        std::copy_backward(locals, locals + (params - 1), locals + (entry.locals_count + params));
+        sp += entry.param_count;
+        std::fill_n(locals, entry.locals_count, 0);
+      } else {
+        std::fill_n(locals + params, entry.locals_count - entry.param_count, 0);
+      }
+      std::fill_n(m_narrow.begin() + static_cast<std::ptrdiff_t>(narrow_base), entry.narrow_size, 0);
+      narrow_top = narrow_base + entry.narrow_size;
+    };
+    open(m_frames.back().function);
+
+    auto push = [&](vm::stack_value_t value) {
+      m_stack[sp++] = tos;
+      tos = value;
+    };
+    auto pop = [&] {
+      auto value = tos;
+      tos = m_stack[--sp];
+      return value;
+    };
+
+    while (true) {
+      auto instr_pc = pc;
+      vm::instruction_word word{};
+      auto op = fetch<Encoding>(code, pc, word);
+      switch (op) {
+        case op_code::lload:
+          push(m_stack[locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)]);
+          break;
+        case op_code::lsave:
+          m_stack[locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)] = pop();
+          break;
+        case op_code::pload: {
+          // Only left in the code when it does not open the function
+          auto count = operand<std::uint8_t, Encoding>(code, pc, word);
+          if (count == 0) break;
+          m_stack[sp] = tos;
+          sp -= count;
+          std::copy_n(m_stack.begin() + static_cast<std::ptrdiff_t>(sp + 1), count,
+                      m_stack.begin() + static_cast<std::ptrdiff_t>(locals_base));
+          tos = m_stack[sp];
+          break;
+        }
+        case op_code::lload_i8:
+          push(m_narrow[narrow_base + operand<vm::local_index_t, Encoding>(code, pc, word)]);
+          break;
+        case op_code::lsave_i8:
+          m_narrow[narrow_base + operand<vm::local_index_t, Encoding>(code, pc, word)] = static_cast<std::int8_t>(pop());
+          break;
+        case op_code::i64_const:
+          // The verifier does not let it into word encoded code
+          push(read<std::int64_t>(code, pc));
+          break;
+        case op_code::i64_const_0:
+          push(0);
+          break;
+        case op_code::i64_const_1:
+          push(1);
+          break;
+        case op_code::i64_const_i8:
+          push(operand<std::int8_t, Encoding>(code, pc, word));
+          break;
+        case op_code::i64_const_i16:
+          push(operand<std::int16_t, Encoding>(code, pc, word));
+          break;
+        case op_code::i64_const_pool:
+          push(program.constants[pool_index<Encoding>(code, pc, word)]);
+          break;
+        case op_code::str_const:
+          push(vm::string_at(program.strings, program.constants[pool_index<Encoding>(code, pc, word)]));
+          break;
+        case op_code::pop:
+          pop();
+          break;
+
+        case op_code::i64_add:
+          tos = wrap(static_cast<std::uint64_t>(m_stack[--sp]) + static_cast<std::uint64_t>(tos));
+          break;
+        case op_code::i64_sub:
+          tos = wrap(static_cast<std::uint64_t>(m_stack[--sp]) - static_cast<std::uint64_t>(tos));
+          break;
+        case op_code::i64_mul:
+          tos = wrap(static_cast<std::uint64_t>(m_stack[--sp]) * static_cast<std::uint64_t>(tos));
+          break;
+        case op_code::i64_div: {
+          auto a = tos;
+          auto b = m_stack[--sp];
+          if (a == 0) return fail("Division by zero");
+          tos = (a == -1) ? wrap(0 - static_cast<std::uint64_t>(b)) : b / a;
+          break;
+        }
+
+        case op_code::f64_add:
+          tos = vm::from_f64(vm::as_f64(m_stack[--sp]) + vm::as_f64(tos));
+          break;
+        case op_code::f64_sub:
+          tos = vm::from_f64(vm::as_f64(m_stack[--sp]) - vm::as_f64(tos));
+          break;
+        case op_code::f64_mul:
+          tos = vm::from_f64(vm::as_f64(m_stack[--sp]) * vm::as_f64(tos));
+          break;
+        case op_code::f64_div:
+          tos = vm::from_f64(vm::as_f64(m_stack[--sp]) / vm::as_f64(tos));
+          break;
+        case op_code::f64_eq:
+        case op_code::f64_ne:
+        case op_code::f64_lt:
+        case op_code::f64_le:
+        case op_code::f64_gt:
+        case op_code::f64_ge:
+          tos = vm::f64_binary(op, vm::as_f64(m_stack[--sp]), vm::as_f64(tos));
+          break;
+        case op_code::i64_to_f64:
+          tos = vm::from_f64(static_cast<double>(tos));
+          break;
+        case op_code::f64_to_i64:
+          tos = vm::f64_to_i64(vm::as_f64(tos));
+          break;
+
+        case op_code::i64_eq:
+          tos = m_stack[--sp] == tos;
+          break;
+        case op_code::i64_ne:
+          tos = m_stack[--sp] != tos;
+          break;
+        case op_code::i64_lt:
+          tos = m_stack[--sp] < tos;
+          break;
+        case op_code::i64_le:
+          tos = m_stack[--sp] <= tos;
+          break;
+        case op_code::i64_gt:
+          tos = m_stack[--sp] > tos;
+          break;
+        case op_code::i64_ge:
+          tos = m_stack[--sp] >= tos;
+          break;
+
+        case op_code::str_eq:
+          tos = vm::strings_equal(program.strings, m_stack[--sp], tos);
+          break;
+        case op_code::str_ne:
+          tos = not vm::strings_equal(program.strings, m_stack[--sp], tos);
+          break;
+
+        case op_code::aload: {
+          const auto &array = vm::as_array(m_stack[locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)]);
+          if (not vm::array_in_bounds(array, tos)) return fail("Array index out of range");
+          tos = vm::array_load(array, tos);
+          break;
+        }
+        case op_code::aload_u: {
+          const auto &array = vm::as_array(m_stack[locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)]);
+          // Only the compiler's own proofs are trusted, other code keeps the check
+          if (not program.proven_bounds && not vm::array_in_bounds(array, tos)) return fail("Array index out of range");
+          tos = vm::array_load(array, tos);
+          break;
+        }
+        case op_code::asave: {
+          const auto &array = vm::as_array(m_stack[locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)]);
+          auto value = pop();
+          auto i = pop();
+          if (not vm::array_in_bounds(array, i)) return fail("Array index out of range");
+          vm::array_store(array, i, value);
+          break;
+        }
+        case op_code::asave_u: {
+          const auto &array = vm::as_array(m_stack[locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)]);
+          auto value = pop();
+          auto i = pop();
+          if (not program.proven_bounds && not vm::array_in_bounds(array, i)) return fail("Array index out of range");
+          vm::array_store(array, i, value);
+          break;
+        }
+        case op_code::alen:
+          push(static_cast<vm::stack_value_t>(
+            vm::as_array(m_stack[locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)]).size));
+          break;
+
+        case op_code::fload:
+          tos = vm::field_load(tos, operand<vm::field_offset_t, Encoding>(code, pc, word));
+          break;
+        case op_code::fload_i8:
+          tos = vm::field_load_i8(tos, operand<vm::field_offset_t, Encoding>(code, pc, word));
+          break;
+        case op_code::fsave: {
+          auto offset = operand<vm::field_offset_t, Encoding>(code, pc, word);
+          auto value = pop();
+          vm::field_store(pop(), offset, value);
+          break;
+        }
+        case op_code::fsave_i8: {
+          auto offset = operand<vm::field_offset_t, Encoding>(code, pc, word);
+          auto value = pop();
+          vm::field_store_i8(pop(), offset, value);
+          break;
+        }
+
+        case op_code::jmp:
+        case op_code::jmpz: {
+          auto offset = operand<vm::jump_offset, Encoding>(code, pc, word);
+          if (op == op_code::jmp || pop() == 0) {
+            pc = instr_pc + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(offset));
+            if (offset <= 0 && --m_fuel == 0) return fail("Out of fuel");
+          }
+          break;
+        }
+        case op_code::jmp_s:
+        case op_code::jmpz_s: {
+          auto offset = operand<vm::short_jump_offset, Encoding>(code, pc, word);
+          if (op == op_code::jmp_s || pop() == 0) {
+            pc = instr_pc + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(offset));
+            if (offset <= 0 && --m_fuel == 0) return fail("Out of fuel");
+          }
+          break;
+        }
+
+        case op_code::call: {
+          ++m_counters.calls;
+          auto index = operand<vm::function_index_t, Encoding>(code, pc, word);
+          if (m_frames.size() >= max_call_depth) return fail("Call stack overflow");
+          if (lazy) {
+            if (auto ok = lazy->ensure(program, index); not ok) {
+              return std::unexpected{ok.error()};
+            }
+          }
+
+          const auto &callee = program.functions[index];
+          m_stack[sp] = tos;
+          sp -= callee.param_count;
+          m_frames.push_back({
+            .return_pc = pc,
+            .stack_base = sp,
+            .locals_base = sp + 1,
+            .function = index,
+            .narrow_base = narrow_top
+          });
+
+          auto needed = sp + 1 + callee.locals_count + facts[index].max_stack + 1;
+          if (needed > m_stack.size()) {
+            m_stack.resize(needed * 2);
+          }
+          if (narrow_top + callee.narrow_size > m_narrow.size()) {
+            m_narrow.resize((narrow_top + callee.narrow_size) * 2);
+          }
+
+          locals_base = sp + 1;
+          narrow_base = narrow_top;
+          open(index);
+          if (--m_fuel == 0) return fail("Out of fuel");
+          break;
+        }
+
+        case op_code::ret:
+        case op_code::ret_void: {
+          auto f = m_frames.back();
+          m_frames.pop_back();
+          if (m_frames.empty()) {
+            return op == op_code::ret ? tos : 0;
+          }
+
+          // The caller's operands under the arguments were spilled when they were pushed
+          sp = f.stack_base;
+          if (op == op_code::ret) {
+            ++sp;
+          } else {
+            tos = m_stack[sp];
+          }
+          locals_base = m_frames.back().locals_base;
+          narrow_top = f.narrow_base;
+          narrow_base = m_frames.back().narrow_base;
+          pc = f.return_pc;
+          break;
+        }
+
+        case op_code::call_native: {
+          ++m_counters.native_calls;
+          auto index = operand<vm::function_index_t, Encoding>(code, pc, word);
+          const auto &callee = program.functions[index];
+          const auto *native = native_of(program, index);
+          if (not native) return fail("Unbound native function");
+
+          m_stack[sp] = tos;
+          sp -= callee.param_count;
+          auto value = call_blocking(*native, std::span<const vm::stack_value_t>{m_stack}.subspan(sp + 1, callee.param_count));
+          // The verifier takes a string from a native for a real one
+          if (callee.return_type == type::str && value == 0) return fail("Native returned no string");
+          if (callee.return_type != type::void_) {
+            ++sp;
+            tos = value;
+          } else {
+            tos = m_stack[sp];
+          }
+          break;
+        }
+
+        case op_code::yield:
+          return fail("Yield outside of a coroutine");
+
+        default:
+          // Unreachable for verified code
+          return fail("Unknown op code");
+      }
+    }
+  }
+
+  // --- Coroutines ---
+
+  namespace {
+    constexpr auto not_suspended = std::numeric_limits<std::size_t>::max();
+  }
+
+  auto runtime::start(const vm::program_view &program, std::size_t function,
+                      std::span<const vm::stack_value_t> args) -> std::expected<coroutine, error_t> {
+    if (function >= program.functions.size()) {
+      return fail("Function index out of range");
+    }
+    const auto &entry = program.functions[function];
+    if (vm::is_native(entry)) {
+      return fail("Native functions are called by scripts");
+    }
+    if (args.size() != entry.param_count) {
+      return fail("Argument count mismatch");
+    }
+
+    // The coroutine gets stacks of its own, sized to what it holds and grown when it needs more
+    enter(program, entry, function, args);
+    coroutine co;
+    co.m_program = program;
+    co.m_stack.reserve(entry.max_stack);
+    co.m_stack = m_stack;
+    co.m_locals = m_locals;
+    co.m_narrow = m_narrow;
+    co.m_frames = m_frames;
+    co.m_references = m_references;
+    co.m_pc = entry.offset;
+    co.m_done = false;
+    if (auto value = resume(co); not value) {
+      return std::unexpected{value.error()};
+    }
+    return co;
+  }
+
+  auto coroutine::on_ready(std::function<void()> wake) -> void {
+    if (m_native) {
+      m_native->on_ready(std::move(wake));
+    } else {
+      wake();
+    }
+  }
+
+  auto runtime::resume(coroutine &co) -> result_t {
+    if (co.m_done) {
+      return fail("Coroutine has already finished");
+    }
+    if (not co.ready()) {
+      return fail("Native call is still pending");
+    }
+    std::swap(m_stack, co.m_stack);
+    std::swap(m_locals, co.m_locals);
+    std::swap(m_narrow, co.m_narrow);
+    std::swap(m_frames, co.m_frames);
+    std::swap(m_references, co.m_references);
+    if (auto native = std::exchange(co.m_native, nullptr); native && co.m_native_returns) {
+      m_stack.push_back(native->value());
+      if (co.m_native_string) keep_string(native->value());
+    }
+    m_fuel = m_fuel_limit;
+    return run_coroutine(co);
+  }
+
+  auto runtime::run_coroutine(coroutine &co) -> result_t {
+    suspension suspend{.pc = not_suspended, .preempted = false};
+    auto value = co.m_program.encoding == instruction_encoding::words
+                   ? run<instruction_encoding::words>(co.m_program, co.m_pc, &suspend)
+                   : run<instruction_encoding::bytes>(co.m_program, co.m_pc, &suspend);
+    co.m_preempted = suspend.preempted;
+    co.m_native = std::move(suspend.native);
+    co.m_native_returns = suspend.native_returns;
+    co.m_native_string = suspend.native_string;
+    if (suspend.preempted || co.m_native) {
+      // Keeps the last yielded value
+      value = co.m_value;
+    } else if (value) {
+      co.m_value = *value;
+    }
+
+    // The runtime gets its own stacks back
+    std::swap(m_stack, co.m_stack);
+    std::swap(m_locals, co.m_locals);
+    std::swap(m_narrow, co.m_narrow);
+    std::swap(m_frames, co.m_frames);
+    std::swap(m_references, co.m_references);
+
+    if (not value || suspend.pc == not_suspended) {
+      co.m_done = true;
+      co.m_stack = {};
+      co.m_locals = {};
+      co.m_narrow = {};
+      co.m_frames = {};
+      co.m_references = {};
+    } else {
+      co.m_pc = suspend.pc;
+    }
+    return value;
+  }
+
+  runtime::awaitable_call::~awaitable_call() {
+    // The awaiting coroutine was destroyed while parked
+    if (m_waiting) {
+      std::erase(m_vm->m_parked, this);
+      std::ranges::replace(m_vm->m_resuming, this, nullptr);
+    }
+  }
+
+  auto runtime::awaitable_call::await_ready() -> bool {
+    if (not m_function) {
+      m_result = std::unexpected{error::undefined_symbol{
+        .identifier = m_name
+      }};
+      return true;
+    }
+
+    auto co = m_vm->start(m_program, *m_function, m_args);
+    if (not co) {
+      m_result = std::unexpected{co.error()};
+      return true;
+    }
+    m_coroutine = std::move(*co);
+    m_result = m_coroutine.value();
+    return m_coroutine.done();
+  }
+
+  auto runtime::awaitable_call::await_suspend(std::coroutine_handle<> waiting) -> void {
+    m_waiting = waiting;
+    m_vm->m_parked.push_back(this);
+  }
+
+  auto runtime::resume_parked() -> std::size_t {
+    m_resuming = std::exchange(m_parked, {});
+    for (std::size_t i = 0; i < m_resuming.size(); ++i) {
+      auto *call = m_resuming[i];
+      if (not call) {
+        continue;
+      }
+      if (not call->m_coroutine.ready()) {
+        m_parked.push_back(call);
+        continue;
+      }
+
+      call->m_result = resume(call->m_coroutine);
+      if (call->m_coroutine.done()) {
+        // Continues the awaiting coroutine, it may await again or destroy other parked calls
+        std::exchange(call->m_waiting, nullptr).resume();
+      } else {
+        m_parked.push_back(call);
+      }
+    }
+    m_resuming.clear();
+    return m_parked.size();
+  }
+
+  // --- Batches ---
+
+  namespace {
+    auto check_batch(const vm::function_entry &entry, std::span<const runtime::column_t> columns,
+                     std::span<vm::stack_value_t> out) -> std::expected<void, error_t> {
+      if (vm::is_native(entry)) {
+        return fail("Native functions are called by scripts");
+      }
+      if (columns.size() != entry.param_count) {
+        return fail("Argument count mismatch");
+      }
+      for (auto &column: columns) {
+        if (column.size() != out.size()) return fail("Batch columns differ in length");
+      }
+      return {};
+    }
+  }
+
+  template<class Row>
+  auto runtime::for_each_row(std::span<const column_t> columns, std::span<vm::stack_value_t> out, Row &&row)
+    -> std::expected<void, error_t> {
+    m_row.resize(columns.size());
+    for (std::size_t r = 0; r < out.size(); ++r) {
+      // Read the whole row first, `out` may be one of the columns
+      for (std::size_t c = 0; c < columns.size(); ++c) {
+        m_row[c] = columns[c][r];
+      }
+      auto value = row(std::span<const vm::stack_value_t>{m_row});
+      if (not value) {
+        return std::unexpected{value.error()};
+      }
+      out[r] = *value;
+    }
+    return {};
+  }
+
+  auto runtime::call_batch(const vm::program_view &program, std::size_t function,
+                           std::span<const column_t> columns, std::span<vm::stack_value_t> out)
+    -> std::expected<void, error_t> {
+    if (function >= program.functions.size()) {
+      return fail("Function index out of range");
+    }
+    const auto &entry = program.functions[function];
+    if (auto ok = check_batch(entry, columns, out); not ok) {
+      return ok;
+    }
+
+    auto rows = [&]<instruction_encoding Encoding>() {
+      return for_each_row(columns, out, [&](std::span<const vm::stack_value_t> args) {
+        enter(program, entry, function, args);
+        return run<Encoding>(program, entry.offset);
+      });
+    };
+    if (program.encoding == instruction_encoding::words) {
+      return rows.template operator()<instruction_encoding::words>();
+    }
+    return rows.template operator()<instruction_encoding::bytes>();
+  }
+
+  auto runtime::call_batch_verified(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                                    vm::lazy_verifier *lazy, std::size_t function,
+                                    std::span<const column_t> columns, std::span<vm::stack_value_t> out,
+                                    std::size_t lanes)
+    -> std::expected<void, error_t> {
+    if (function >= program.functions.size() || facts.size() != program.functions.size()) {
+      return fail("Function index out of range");
+    }
+    if (lazy) {
+      if (auto ok = lazy->ensure(program, function); not ok) {
+        return std::unexpected{ok.error()};
+      }
+    }
+    const auto &entry = program.functions[function];
+    if (auto ok = check_batch(entry, columns, out); not ok) {
+      return ok;
+    }
+
+    if (lanes == max_lanes) return call_lanes<max_lanes>(program, facts, lazy, function, columns, out);
+    if (lanes == 4) return call_lanes<4>(program, facts, lazy, function, columns, out);
+
+    auto rows = [&]<instruction_encoding Encoding>() {
+      return for_each_row(columns, out, [&](std::span<const vm::stack_value_t> args) -> result_t {
+        if (auto ok = check_references(program, entry, args); not ok) {
+          return std::unexpected{ok.error()};
+        }
+        enter_verified(entry, facts[function], function, args);
+        return run_verified<Encoding>(program, facts, lazy);
+      });
+    };
+    if (program.encoding == instruction_encoding::words) {
+      return rows.template operator()<instruction_encoding::words>();
+    }
+    return rows.template operator()<instruction_encoding::bytes>();
+  }
+
+  template<std::size_t Lanes>
+  auto runtime::call_lanes(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                           vm::lazy_verifier *lazy, std::size_t function,
+                           std::span<const column_t> columns, std::span<vm::stack_value_t> out)
+    -> std::expected<void, error_t> {
+    const auto &entry = program.functions[function];
+    bool words = program.encoding == instruction_encoding::words;
+
+    auto scalar_row = [&](std::size_t row) -> std::expected<void, error_t> {
+      m_row.resize(columns.size());
+      for (std::size_t c = 0; c < columns.size(); ++c) {
+        m_row[c] = columns[c][row];
+      }
+      if (auto ok = check_references(program, entry, m_row); not ok) {
+        return ok;
+      }
+      enter_verified(entry, facts[function], function, m_row);
+      auto value = words ? run_verified<instruction_encoding::words>(program, facts, lazy)
+                         : run_verified<instruction_encoding::bytes>(program, facts, lazy);
+      if (not value) {
+        return std::unexpected{value.error()};
+      }
+      out[row] = *value;
+      return {};
+    };
+
+    std::size_t row = 0;
+    for (; row + Lanes <= out.size(); row += Lanes) {
+      m_lane_stack.resize(std::max<std::size_t>(m_lane_stack.size(), facts[function].max_stack * Lanes));
+      for (std::size_t c = 0; c < columns.size(); ++c) {
+        std::copy_n(columns[c].begin() + static_cast<std::ptrdiff_t>(row), Lanes,
+                    m_lane_stack.begin() + static_cast<std::ptrdiff_t>(c * Lanes));
+      }
+
+      auto group = words ? run_lanes<Lanes, instruction_encoding::words>(program, facts, lazy, function)
+                         : run_lanes<Lanes, instruction_encoding::bytes>(program, facts, lazy, function);
+      m_counters.invocations += static_cast<std::uint64_t>(std::popcount(group.done));
+
+      // Written in row order, a failing row leaves the rows after it untouched
+      for (std::size_t l = 0; l < Lanes; ++l) {
+        if (group.done >> l & 1) {
+          out[row + l] = group.values[l];
+        } else if (auto ok = scalar_row(row + l); not ok) {
+          return ok;
+        }
+      }
+    }
+
+    for (; row < out.size(); ++row) {
+      if (auto ok = scalar_row(row); not ok) {
+        return ok;
+      }
+    }
+    return {};
+  }
+
+  template<std::size_t Lanes, vm::instruction_encoding Encoding>
+  auto runtime::run_lanes(const vm::program_view &program, std::span<const vm::function_facts> facts,
+                          vm::lazy_verifier *lazy, std::size_t function) -> lane_group {
+    using vm::op_code;
+    using lane_mask = std::uint32_t;
+    static_assert(Lanes <= max_lanes);
+
+    constexpr lane_mask all_lanes = (lane_mask{1} << Lanes) - 1;
+    // Fewer lanes than this and the rest of the group is cheaper on the scalar loop
+    constexpr int min_active = Lanes / 2;
+
+    const auto code = program.code;
+    const auto &first = program.functions[function];
+
+    // Lanes are dropped when they take the minority side of a branch or fail, the scalar
+    // loop reruns them from the start and reports their errors
+    lane_mask active = all_lanes;
+    lane_group group{.values{}, .done = 0};
+
+    auto drop = [&](lane_mask lanes) {
+      active &= ~lanes;
+      return std::popcount(active) >= min_active;
+    };
+
+    auto stack = [&](std::size_t slot) { return m_lane_stack.data() + slot * Lanes; };
+    auto local = [&](std::size_t slot) { return m_lane_locals.data() + slot * Lanes; };
+    auto fill = [&](std::size_t slot, vm::stack_value_t value) { std::fill_n(stack(slot), Lanes, value); };
+
+    std::size_t pc = first.offset;
+    std::size_t sp = first.param_count;
+    std::size_t locals_base = 0;
+    std::size_t locals_top = first.locals_count;
+    m_lane_locals.resize(std::max<std::size_t>(m_lane_locals.size(), first.locals_count * Lanes));
+    std::fill_n(m_lane_locals.begin(), first.locals_count * Lanes, 0);
+
+    m_frames.clear();
+    m_frames.push_back({
+      .return_pc = 0,
+      .stack_base = 0,
+      .locals_base = 0,
+      .function = function
+    });
+    m_fuel = m_fuel_limit;
+
+    // Plain loops over contiguous lanes, the compiler turns them into vector instructions
+    auto binary = [&](auto f) {
+      --sp;
+      auto a = stack(sp), b = stack(sp - 1);
+      for (std::size_t l = 0; l < Lanes; ++l) {
+        b[l] = wrap(f(static_cast<std::uint64_t>(b[l]), static_cast<std::uint64_t>(a[l])));
+      }
+    };
+    auto binary_f64 = [&](auto f) {
+      --sp;
+      auto a = stack(sp), b = stack(sp - 1);
+      for (std::size_t l = 0; l < Lanes; ++l) {
+        b[l] = f(vm::as_f64(b[l]), vm::as_f64(a[l]));
+      }
+    };
+    // Signed, for the int comparisons
+    auto compare = [&](auto f) {
+      --sp;
+      auto a = stack(sp), b = stack(sp - 1);
+      for (std::size_t l = 0; l < Lanes; ++l) {
+        b[l] = f(b[l], a[l]);
+      }
+    };
+    auto unary = [&](auto f) {
+      auto a = stack(sp - 1);
+      for (std::size_t l = 0; l < Lanes; ++l) {
+        a[l] = f(a[l]);
+      }
+    };
+
+    // Splits the group on a conditional jump, false once too few lanes are left
+    auto branch = [&](lane_mask zero, bool &taken) {
+      zero &= active;
+      if (zero == active || zero == 0) {
+        taken = zero != 0;
+        return true;
+      }
+      auto rest = active & ~zero;
+      taken = std::popcount(zero) >= std::popcount(rest);
+      return drop(taken ? rest : zero);
+    };
+
+    auto zero_lanes = [&](std::size_t slot) {
+      auto v = stack(slot);
+      lane_mask zero = 0;
+      for (std::size_t l = 0; l < Lanes; ++l) {
+        zero |= lane_mask{v[l] == 0} << l;
+      }
+      return zero;
+    };
+
+    while (true) {
+      auto instr_pc = pc;
+      vm::instruction_word word{};
+      auto op = fetch<Encoding>(code, pc, word);
+      switch (op) {
+        case op_code::lload:
+          std::copy_n(local(locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)), Lanes, stack(sp++));
+          break;
+        case op_code::lsave:
+          --sp;
+          std::copy_n(stack(sp), Lanes, local(locals_base + operand<vm::local_index_t, Encoding>(code, pc, word)));
+          break;
+        case op_code::pload: {
+          auto count = operand<std::uint8_t, Encoding>(code, pc, word);
+          sp -= count;
+          std::copy_n(stack(sp), count * Lanes, local(locals_base));
+          break;
+        }
+        case op_code::i64_const:
+          fill(sp++, read<std::int64_t>(code, pc));
+          break;
+        case op_code::i64_const_0:
+          fill(sp++, 0);
+          break;
+        case op_code::i64_const_1:
+          fill(sp++, 1);
+          break;
+        case op_code::i64_const_i8:
+          fill(sp++, operand<std::int8_t, Encoding>(code, pc, word));
+          break;
+        case op_code::i64_const_i16:
+          fill(sp++, operand<std::int16_t, Encoding>(code, pc, word));
+          break;
+        case op_code::i64_const_pool:
+          fill(sp++, program.constants[pool_index<Encoding>(code, pc, word)]);
+          break;
+        case op_code::pop:
+          --sp;
+          break;
+
+        case op_code::i64_add:
+          binary([](std::uint64_t b, std::uint64_t a) { return b + a; });
+          break;
+        case op_code::i64_sub:
+          binary([](std::uint64_t b, std::uint64_t a) { return b - a; });
+          break;
+        case op_code::i64_mul:
+          binary([](std::uint64_t b, std::uint64_t a) { return b * a; });
+          break;
+        case op_code::i64_div: {
+          // Lanes dividing by zero fail on the scalar loop, the others divide by anything safe
+          if (auto zero = zero_lanes(sp - 1) & active; zero != 0 && not drop(zero)) {
+            return group;
+          }
+          --sp;
+          auto a = stack(sp), b = stack(sp - 1);
+          for (std::size_t l = 0; l < Lanes; ++l) {
+            auto divisor = a[l] == 0 ? 1 : a[l];
+            b[l] = divisor == -1 ? wrap(0 - static_cast<std::uint64_t>(b[l])) : b[l] / divisor;
+          }
+          break;
+        }
+
+        case op_code::f64_add:
+          binary_f64([](double b, double a) { return vm::from_f64(b + a); });
+          break;
+        case op_code::f64_sub:
+          binary_f64([](double b, double a) { return vm::from_f64(b - a); });
+          break;
+        case op_code::f64_mul:
+          binary_f64([](double b, double a) { return vm::from_f64(b * a); });
+          break;
+        case op_code::f64_div:
+          binary_f64([](double b, double a) { return vm::from_f64(b / a); });
+          break;
+        case op_code::f64_eq:
+          binary_f64([](double b, double a) -> vm::stack_value_t { return b == a; });
+          break;
+        case op_code::f64_ne:
+          binary_f64([](double b, double a) -> vm::stack_value_t { return b != a; });
+          break;
+        case op_code::f64_lt:
+          binary_f64([](double b, double a) -> vm::stack_value_t { return b < a; });
+          break;
+        case op_code::f64_le:
+          binary_f64([](double b, double a) -> vm::stack_value_t { return b <= a; });
+          break;
+        case op_code::f64_gt:
+          binary_f64([](double b, double a) -> vm::stack_value_t { return b > a; });
+          break;
+        case op_code::f64_ge:
+          binary_f64([](double b, double a) -> vm::stack_value_t { return b >= a; });
+          break;
+        case op_code::i64_to_f64:
+          unary([](vm::stack_value_t a) { return vm::from_f64(static_cast<double>(a)); });
+          break;
+        case op_code::f64_to_i64:
+          unary([](vm::stack_value_t a) { return vm::f64_to_i64(vm::as_f64(a)); });
+          break;
+        case op_code::i64_eq:
+          compare([](vm::stack_value_t b, vm::stack_value_t a) -> vm::stack_value_t { return b == a; });
+          break;
+        case op_code::i64_ne:
+          compare([](vm::stack_value_t b, vm::stack_value_t a) -> vm::stack_value_t { return b != a; });
+          break;
+        case op_code::i64_lt:
+          compare([](vm::stack_value_t b, vm::stack_value_t a) -> vm::stack_value_t { return b < a; });
+          break;
+        case op_code::i64_le:
+          compare([](vm::stack_value_t b, vm::stack_value_t a) -> vm::stack_value_t { return b <= a; });
+          break;
+        case op_code::i64_gt:
+          compare([](vm::stack_value_t b, vm::stack_value_t a) -> vm::stack_value_t { return b > a; });
+          break;
+        case op_code::i64_ge:
+          compare([](vm::stack_value_t b, vm::stack_value_t a) -> vm::stack_value_t { return b >= a; });
+          break;
+
+        case op_code::jmp:
+        case op_code::jmp_s: {
+          auto offset = op == op_code::jmp ? operand<vm::jump_offset, Encoding>(code, pc, word)
+                                           : operand<vm::short_jump_offset, Encoding>(code, pc, word);
+          pc = instr_pc + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(offset));
+          // The rows trap on the scalar loop, the budget is the same for every lane
+          if (offset <= 0 && --m_fuel == 0) return group;
+          break;
+        }
+        case op_code::jmpz:
+        case op_code::jmpz_s: {
+          auto offset = op == op_code::jmpz ? operand<vm::jump_offset, Encoding>(code, pc, word)
+                                            : operand<vm::short_jump_offset, Encoding>(code, pc, word);
+          bool taken{};
+          if (not branch(zero_lanes(--sp), taken)) {
+            return group;
+          }
+          if (taken) {
+            pc = instr_pc + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(offset));
+            if (offset <= 0 && --m_fuel == 0) return group;
+          }
+          break;
+        }
+
+        case op_code::call: {
+          auto index = operand<vm::function_index_t, Encoding>(code, pc, word);
+          // The scalar loop reports both failures for each row
+          if (m_frames.size() >= max_call_depth) return group;
+          if (lazy && not lazy->ensure(program, index)) return group;
+          m_counters.calls += static_cast<std::uint64_t>(std::popcount(active));
+
+          const auto &callee = program.functions[index];
+          frame f{
+            .return_pc = pc,
+            .stack_base = sp - callee.param_count,
+            .locals_base = locals_top,
+            .function = index
+          };
+          m_frames.push_back(f);
+
+          if ((f.stack_base + facts[index].max_stack) * Lanes > m_lane_stack.size()) {
+            m_lane_stack.resize((f.stack_base + facts[index].max_stack) * Lanes * 2);
+          }
+          if ((locals_top + callee.locals_count) * Lanes > m_lane_locals.size()) {
+            m_lane_locals.resize((locals_top + callee.locals_count) * Lanes * 2);
+          }
+
+          locals_base = locals_top;
+          locals_top += callee.locals_count;
+          std::fill_n(local(locals_base), callee.locals_count * Lanes, 0);
+          pc = callee.offset;
+          if (--m_fuel == 0) return group;
+          break;
+        }
+
+        case op_code::ret:
+        case op_code::ret_void: {
+          auto f = m_frames.back();
+          m_frames.pop_back();
+          if (m_frames.empty()) {
+            if (op == op_code::ret) std::copy_n(stack(sp - 1), Lanes, group.values.begin());
+            group.done = active;
+            return group;
+          }
+
+          if (op == op_code::ret) std::copy_n(stack(sp - 1), Lanes, stack(f.stack_base));
+          sp = f.stack_base + (op == op_code::ret ? 1 : 0);
+          locals_top = f.locals_base;
+          locals_base = m_frames.back().locals_base;
+          pc = f.return_pc;
+          break;
+        }
+
+        case op_code::yield:
+        case op_code::call_native:
+        case op_code::lload_i8:
+        case op_code::lsave_i8:
+        case op_code::aload:
+        case op_code::asave:
+        case op_code::aload_u:
+        case op_code::asave_u:
+        case op_code::alen:
+        case op_code::str_const:
+        case op_code::str_eq:
+        case op_code::str_ne:
+        case op_code::fload:
+        case op_code::fsave:
+        case op_code::fload_i8:
+        case op_code::fsave_i8:
+          // Natives are called row by row on the scalar loop, yield fails there, narrow
+          // locals have no lane layout, every row indexes arrays of its own, strings are
+          // compared through memory and fields are read from objects of their own
+          return group;
+
+        default:
+          // Unreachable for verified code
+          return group;
+      }
+    }
+  }
+} // korka
@@ -0,0 +1,239 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/arrays.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/decoder.hpp"
+#include "korka/vm/embed.hpp"
+#include "korka/vm/f64.hpp"
+#include "korka/vm/natives.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <array>
+#include <span>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto arrays_source = R"(
+  int sum(int xs[]) {
+    int total = 0;
+    int i = 0;
+    while (i < size(xs)) {
+      total = total + xs[i];
+      i = i + 1;
+    }
+    return total;
+  }
+  void scale(double xs[], double k) {
+    int i = 0;
+    while (i < size(xs)) {
+      xs[i] = xs[i] * k;
+      i = i + 1;
+    }
+  }
+  int at(int xs[], int i) { return xs[i]; }
+  int shifted(int xs[]) {
+    int total = 0;
+    int i = 0;
+    while (i < size(xs)) {
+      i = i + 1;
+      total = total + xs[i];
+    }
+    return total;
+  }
+  int first(int xs[]) { return xs[0]; }
+  int relay(int xs[]) { return first(xs) + size(xs); }
+  int triangle(int n) {
+    int i = 0;
+    int total = 0;
+    while (i <= n) {
+      total = total + i;
+      i = i + 1;
+    }
+    return total;
+  }
+)";
+
+namespace {
+  // Array op codes in the code of a function
+  auto array_ops(const program &p, std::string_view name) -> std::vector<op_code> {
+    const auto &entry = p.table()[*p.find(name)];
+    auto view = p.view();
+    std::vector<op_code> ops;
+    for (auto pc = entry.offset; pc < entry.offset + entry.size;) {
+      auto instr = decode(view.code, pc, view.encoding);
+      REQUIRE(instr);
+      if (instr->op >= op_code::aload && instr->op <= op_code::asave_u) ops.push_back(instr->op);
+      pc += instr->size;
+    }
+    return ops;
+  }
+}
+
+TEST_CASE("Scripts index host memory in place", "[arrays]") {
+  auto p = compile_runtime(arrays_source);
+  REQUIRE(p);
+
+  runtime vm;
+  std::vector<std::int64_t> values{3, 1, 4, 1, 5, 9, 2, 6};
+  array_view view{std::span{values}};
+  CHECK(vm.execute(*p, "sum", {array_arg(view)}) == 31);
+  CHECK(vm.execute(*p, "at", {array_arg(view), 5}) == 9);
+  CHECK(vm.execute(*p, "relay", {array_arg(view)}) == 3 + 8);
+  CHECK(vm.execute(*p, "triangle", {10}) == 55);
+
+  std::vector<double> prices{1.5, 2.0, -4.0};
+  array_view price_view{std::span{prices}};
+  CHECK(vm.execute(*p, "scale", {array_arg(price_view), from_f64(2.0)}));
+  CHECK(prices == std::vector<double>{3.0, 4.0, -8.0});
+
+  SECTION("Indices out of range are reported") {
+    CHECK_FALSE(vm.execute(*p, "at", {array_arg(view), 8}));
+    CHECK_FALSE(vm.execute(*p, "at", {array_arg(view), -1}));
+    CHECK_FALSE(vm.execute(*p, "shifted", {array_arg(view)}));
+
+    array_view empty;
+    CHECK(vm.execute(*p, "sum", {array_arg(empty)}) == 0);
+    CHECK_FALSE(vm.execute(*p, "first", {array_arg(empty)}));
+    CHECK_FALSE(vm.execute(*p, "first", {0}));
+  }
+
+  SECTION("Natives get the arrays the script got") {
+    auto with_native = compile_runtime(R"(
+      int peek(int xs[], int i);
+      int twice(int xs[]) { return peek(xs, 1) * 2; }
+    )");
+    REQUIRE(with_native);
+    linked<program> app{std::move(*with_native)};
+    REQUIRE(app.bind("peek", [](std::span<const stack_value_t> args) {
+      return array_load(as_array(args[0]), args[1]);
+    }));
+    CHECK(vm.execute(app, "twice", {array_arg(view)}) == 2);
+  }
+}
+
+TEST_CASE("Bounds checks are left out where the loop proves them", "[arrays]") {
+  auto p = compile_runtime(arrays_source);
+  REQUIRE(p);
+
+  CHECK(array_ops(*p, "sum") == std::vector<op_code>{op_code::aload_u});
+  CHECK(array_ops(*p, "scale") == std::vector<op_code>{op_code::aload_u, op_code::asave_u});
+  CHECK(array_ops(*p, "at") == std::vector<op_code>{op_code::aload});
+  // The index moves before it is used
+  CHECK(array_ops(*p, "shifted") == std::vector<op_code>{op_code::aload});
+
+  auto checked = [&](std::string_view source) {
+    auto compiled = compile_runtime(source);
+    REQUIRE(compiled);
+    return array_ops(*compiled, "f");
+  };
+  // Counters that may go down, start below zero or are parameters prove nothing
+  CHECK(checked(R"(int f(int xs[]) {
+    int i = 0; int t = 0;
+    while (i < size(xs)) { t = t + xs[i]; i = i + 1; i = i - 1; i = i + 2; }
+    return t;
+  })") == std::vector<op_code>{op_code::aload});
+  CHECK(checked(R"(int f(int xs[], int i) {
+    int t = 0;
+    while (i < size(xs)) { t = t + xs[i]; i = i + 1; }
+    return t;
+  })") == std::vector<op_code>{op_code::aload});
+  CHECK(checked(R"(int f(int xs[], int ys[]) {
+    int i = 0; int t = 0;
+    while (i < size(ys)) { t = t + xs[i]; i = i + 1; }
+    return t;
+  })") == std::vector<op_code>{op_code::aload});
+  // An inner loop that moves the index spoils the outer guard for its whole body
+  CHECK(checked(R"(int f(int xs[]) {
+    int i = 0; int t = 0;
+    while (i < size(xs)) {
+      int j = 0;
+      while (j < 2) { t = t + xs[i]; i = i + 1; j = j + 1; }
+    }
+    return t;
+  })") == std::vector<op_code>{op_code::aload});
+}
+
+TEST_CASE("Every loop agrees on arrays", "[arrays]") {
+  auto p = compile_runtime(arrays_source);
+  REQUIRE(p);
+  auto words = compile_runtime(arrays_source, {.encoding = instruction_encoding::words});
+  REQUIRE(words);
+
+  auto checked = *p;
+  auto v = verified<program>::make(std::move(*p));
+  auto vw = verified<program>::make(std::move(*words));
+  REQUIRE(v);
+  REQUIRE(vw);
+
+  runtime vm;
+  std::vector<std::int64_t> values{7, -2, 11, 40, 3};
+  array_view view{std::span{values}};
+  for (auto name: {"sum", "relay", "first"}) {
+    auto expected = vm.execute(checked, name, {array_arg(view)});
+    REQUIRE(expected);
+    CHECK(vm.execute(*v, name, {array_arg(view)}) == *expected);
+    CHECK(vm.execute(*vw, name, {array_arg(view)}) == *expected);
+
+    std::array<stack_value_t, 1> args{array_arg(view)};
+    CHECK(run_embed<embed_bounds{8, 8, 4}>(v->view(), *v->find(name), args) == *expected);
+  }
+  CHECK_FALSE(vm.execute(*v, "at", {array_arg(view), 5}));
+  CHECK_FALSE(vm.execute(*vw, "shifted", {array_arg(view)}));
+  std::array<stack_value_t, 2> out_of_range{array_arg(view), -3};
+  CHECK_FALSE(run_embed<embed_bounds{8, 8, 4}>(v->view(), *v->find("at"), out_of_range));
+
+  std::vector<double> prices{1.0, 2.5};
+  array_view price_view{std::span{prices}};
+  CHECK(vm.execute(*v, "scale", {array_arg(price_view), from_f64(4.0)}));
+  CHECK(vm.execute(*vw, "scale", {array_arg(price_view), from_f64(0.5)}));
+  CHECK(prices == std::vector<double>{2.0, 5.0});
+
+  // Rows with arrays leave the lanes for the scalar loop
+  std::vector<std::int64_t> other{1, 2};
+  array_view other_view{std::span{other}};
+  std::vector<stack_value_t> column{array_arg(view), array_arg(other_view), array_arg(view)}, results(3);
+  std::array<runtime::column_t, 1> columns{column};
+  REQUIRE(vm.execute_batch<4>(*v, "sum", columns, results));
+  CHECK(results == std::vector<stack_value_t>{59, 3, 59});
+}
+
+TEST_CASE("Array types are checked", "[arrays]") {
+  CHECK_FALSE(compile_runtime("int f(int x) { return x[0]; }"));
+  CHECK_FALSE(compile_runtime("int f(int xs[]) { return xs; }"));
+  CHECK_FALSE(compile_runtime("int f(int xs[]) { return xs + 1; }"));
+  CHECK_FALSE(compile_runtime("int f(int xs[], int ys[]) { xs = ys; return 0; }"));
+  CHECK_FALSE(compile_runtime("int f(char xs[]) { return 0; }"));
+  CHECK_FALSE(compile_runtime("int f(int xs[]) { return xs[0.5]; }"));
+  CHECK_FALSE(compile_runtime("int g(int xs[]) { return 0; } int f(int x) { return g(x); }"));
+  CHECK(compile_runtime("double f(double xs[], int i) { xs[i] = i; return xs[i] + 1; }"));
+}
+
+TEST_CASE("The checked loop only reads through array arguments", "[arrays]") {
+  std::vector<std::int64_t> values{5, 6};
+  array_view view{std::span{values}};
+
+  // An address made up by the code, in place of the array or next to it
+  auto forged = [&](bool keep_parameter) {
+    bytecode_builder b;
+    b.emit_param_load(2);
+    if (not keep_parameter) {
+      b.emit_const<type::i64>(array_arg(view));
+      b.emit_save_local(1);
+    }
+    b.emit_const<type::i64>(0);
+    b.emit_array_load(1, true);
+    b.emit_op(op_code::ret);
+    auto code = b.build();
+    function_entry entry{.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 2,
+                         .locals_count = 2, .return_type = type::i64};
+    return program{std::move(code), {entry}, {{"f", {type::i64, type::i64_array}, type::i64}}, b.constants()};
+  };
+
+  runtime vm;
+  CHECK(vm.execute(forged(true), "f", {0, array_arg(view)}) == 5);
+  CHECK_FALSE(vm.execute(forged(false), "f", {0, 0}));
+  CHECK_FALSE(vm.execute(forged(false), "f", {array_arg(view), 0}));
+  CHECK_FALSE(vm.execute(forged(true), "f", {array_arg(view), 0}));
+}
@@ -0,0 +1,141 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto score_source = R"(
+  int score(int a, int b) {
+    if (b) { return a * 3 - b; }
+    return a;
+  }
+  int ratio(int a, int b) { return a / b; }
+)";
+
+TEST_CASE("Batches match one call per row", "[batch]") {
+  auto p = compile_runtime(score_source);
+  REQUIRE(p);
+
+  std::vector<stack_value_t> a{1, 2, 3, 4, 5};
+  std::vector<stack_value_t> b{0, 1, 0, 2, -7};
+  std::vector<stack_value_t> out(a.size());
+
+  runtime vm;
+  REQUIRE(vm.execute_batch<"score">(*p, a, b, out));
+
+  std::vector<stack_value_t> expected;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    expected.push_back(*vm.execute(*p, "score", {a[i], b[i]}));
+  }
+  CHECK(std::ranges::equal(out, expected));
+  CHECK(vm.stats().invocations == 2 * a.size());
+
+  SECTION("Verified programs and the word encoding take the same path") {
+    auto words = compile_runtime(score_source, {.encoding = instruction_encoding::words});
+    REQUIRE(words);
+    auto checked = verified<program>::make(std::move(*words));
+    REQUIRE(checked);
+
+    std::vector<stack_value_t> verified_out(a.size());
+    REQUIRE(vm.execute_batch<"score">(*checked, a, b, verified_out));
+    CHECK(std::ranges::equal(verified_out, expected));
+
+    lazily_verified<program> lazy{*p};
+    std::vector<stack_value_t> lazy_out(a.size());
+    REQUIRE(vm.execute_batch<"score">(lazy, a, b, lazy_out));
+    CHECK(std::ranges::equal(lazy_out, expected));
+  }
+
+  SECTION("Results can overwrite an input column") {
+    REQUIRE(vm.execute_batch<"score">(*p, a, b, a));
+    CHECK(std::ranges::equal(a, expected));
+  }
+}
+
+TEST_CASE("Batches are checked before the first row", "[batch]") {
+  auto p = compile_runtime(score_source);
+  REQUIRE(p);
+  runtime vm;
+
+  std::array<stack_value_t, 3> a{1, 2, 3};
+  std::array<stack_value_t, 2> short_column{1, 2};
+  std::array<stack_value_t, 3> out{-1, -1, -1};
+
+  CHECK_FALSE(vm.execute_batch<"score">(*p, a, short_column, out));
+  CHECK_FALSE(vm.execute_batch<"score">(*p, a, out));
+  CHECK_FALSE(vm.execute_batch<"missing">(*p, a, a, out));
+  CHECK(vm.stats().invocations == 0);
+  CHECK(std::ranges::equal(out, std::array<stack_value_t, 3>{-1, -1, -1}));
+
+  SECTION("A failing row stops the batch") {
+    std::array<stack_value_t, 3> divisors{1, 0, 1};
+    auto result = vm.execute_batch<"ratio">(*p, a, divisors, out);
+    REQUIRE_FALSE(result);
+    CHECK(out[0] == 1);
+    CHECK(out[2] == -1);
+  }
+
+  SECTION("Empty batches do nothing") {
+    std::span<stack_value_t> none;
+    CHECK(vm.execute_batch<"score">(*p, none, none, none));
+  }
+}
+
+TEST_CASE("Lane groups give the same results as single rows", "[batch]") {
+  auto source = R"(
+    int sum_to(int n) {
+      if (n) { return n + sum_to(n - 1); }
+      return 0;
+    }
+    int score(int a, int b) {
+      if (b) { return a * 3 - b + sum_to(b - b + 3); }
+      return a / (a - 5);
+    }
+  )";
+  auto bytes = verified<program>::make(std::move(*compile_runtime(source)));
+  auto words = verified<program>::make(std::move(*compile_runtime(source, {.encoding = instruction_encoding::words})));
+  REQUIRE(bytes);
+  REQUIRE(words);
+
+  // Mixed branches in every group and a tail shorter than a group
+  std::vector<stack_value_t> a, b;
+  for (stack_value_t i = 0; i < 37; ++i) {
+    a.push_back(i * 7 - 40);
+    b.push_back(i % 3 == 0 ? 0 : i);
+  }
+
+  runtime vm;
+  std::vector<stack_value_t> expected(a.size());
+  REQUIRE(vm.execute_batch<"score">(*bytes, a, b, expected));
+
+  std::vector<stack_value_t> out4(a.size()), out8(a.size()), words8(a.size());
+  REQUIRE(vm.execute_batch<"score", 4>(*bytes, a, b, out4));
+  REQUIRE(vm.execute_batch<"score", 8>(*bytes, a, b, out8));
+  REQUIRE(vm.execute_batch<"score", 8>(*words, a, b, words8));
+  CHECK(std::ranges::equal(out4, expected));
+  CHECK(std::ranges::equal(out8, expected));
+  CHECK(std::ranges::equal(words8, expected));
+
+  SECTION("Uniform groups never leave the lane loop") {
+    runtime fresh;
+    std::vector<stack_value_t> head(a.begin(), a.begin() + 16), ones(16, 1), out(16);
+    REQUIRE(fresh.execute_batch<"score", 8>(*bytes, head, ones, out));
+    CHECK(fresh.stats().invocations == 16);
+    CHECK(fresh.stats().calls == 16 * 4);
+  }
+
+  SECTION("A lane dividing by zero fails at its row") {
+    // a - 5 is zero in the row where a == 5 and b == 0
+    std::vector<stack_value_t> fa(8, 1), fb(8, 0), out(8, -1);
+    fa[3] = 5;
+    REQUIRE_FALSE(vm.execute_batch<"score", 8>(*bytes, fa, fb, out));
+    CHECK(out[2] == 1 / (1 - 5));
+    CHECK(out[3] == -1);
+    CHECK(out[7] == -1);
+  }
+}
@@ -10,13 +10,12 @@ using namespace korka::vm;
 TEST_CASE("Building byte codes", "[bytecode_builder]") {
   korka::vm::bytecode_builder builder{};
 
-  builder.emit_add(0, 1, 2);
+  builder.emit_op(op_code::i64_add);
 
   auto bytes = builder.build();
 
   korka::byte_writer expected_builder{};
-  expected_builder.write<korka::vm::op_code_size>(static_cast<int>(korka::vm::op_code::add));
-  expected_builder.write_many(korka::vm::reg_id_t{0}, korka::vm::reg_id_t{1}, korka::vm::reg_id_t{2});
+  expected_builder.write<korka::vm::op_code_size>(static_cast<int>(korka::vm::op_code::i64_add));
   auto &expected_bytes = expected_builder.data();
 
   REQUIRE(bytes == expected_bytes);
@@ -25,62 +24,56 @@ TEST_CASE("Building byte codes", "[bytecode_builder]") {
 TEST_CASE("Arithmetic instructions", "[bytecode_builder]") {
   korka::vm::bytecode_builder b{};
 
-  b.emit_add(0, 1, 2);
-  b.emit_sub(3, 4, 5);
-  b.emit_mul(6, 7, 8);
-  b.emit_div(9, 10, 11);
+  b.emit_op(op_code::i64_add);
+  b.emit_op(op_code::i64_sub);
+  b.emit_op(op_code::i64_mul);
+  b.emit_op(op_code::i64_div);
 
   auto bytes = b.build();
 
   korka::byte_writer expected{};
-  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::add));
-  expected.write_many(reg_id_t{0}, reg_id_t{1}, reg_id_t{2});
-
-  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::sub));
-  expected.write_many(reg_id_t{3}, reg_id_t{4}, reg_id_t{5});
-
-  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::mul));
-  expected.write_many(reg_id_t{6}, reg_id_t{7}, reg_id_t{8});
-
-  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::div));
-  expected.write_many(reg_id_t{9}, reg_id_t{10}, reg_id_t{11});
+  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::i64_add));
+  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::i64_sub));
+  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::i64_mul));
+  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::i64_div));
 
   REQUIRE(bytes == expected.data());
 }
 
-TEST_CASE("Load immediate", "[bytecode_builder]") {
+TEST_CASE("Locals", "[bytecode_builder]") {
   korka::vm::bytecode_builder b{};
 
-  b.emit_load_imm(3, stack_value_t{42});
+  b.emit_param_load(2);
+  b.emit_load_local(3);
+  b.emit_save_local(4);
   auto bytes = b.build();
 
   korka::byte_writer expected{};
-  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::load_imm));
-  expected.write_many(reg_id_t{3}, stack_value_t{42});
+  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::pload));
+  expected.write_many(std::uint8_t{2});
+  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::lload));
+  expected.write_many(local_index_t{3});
+  expected.write<korka::vm::op_code_size>(int(korka::vm::op_code::lsave));
+  expected.write_many(local_index_t{4});
 
   REQUIRE(bytes == expected.data());
 }
 
-TEST_CASE("Compare instructions", "[bytecode_builder]") {
+TEST_CASE("Constants", "[bytecode_builder]") {
   korka::vm::bytecode_builder b{};
 
-  b.emit_cmp_lt(0, 1, 2);
-  b.emit_cmp_gt(3, 4, 5);
-  b.emit_cmp_eq(6, 7, 8);
-
+  b.emit_const<type::i64>(42);
+  b.emit_const<type::i64>(1'000'000'007);
   auto bytes = b.build();
 
   korka::byte_writer expected{};
-  expected.write<op_code_size>(int(op_code::cmp_lt));
-  expected.write_many(reg_id_t{0}, reg_id_t{1}, reg_id_t{2});
-
-  expected.write<op_code_size>(int(op_code::cmp_gt));
-  expected.write_many(reg_id_t{3}, reg_id_t{4}, reg_id_t{5});
-
-  expected.write<op_code_size>(int(op_code::cmp_eq));
-  expected.write_many(reg_id_t{6}, reg_id_t{7}, reg_id_t{8});
+  expected.write<op_code_size>(int(op_code::i64_const_i8));
+  expected.write_many(std::int8_t{42});
+  expected.write<op_code_size>(int(op_code::i64_const_pool));
+  expected.write_many(constant_index_t{0});
 
   REQUIRE(bytes == expected.data());
+  REQUIRE(b.constants() == std::vector<stack_value_t>{1'000'000'007});
 }
 
 TEST_CASE("Unconditional jump forward", "[bytecode_builder]") {
@@ -90,27 +83,26 @@ TEST_CASE("Unconditional jump forward", "[bytecode_builder]") {
   auto target = b.make_label();
 
   b.emit_jmp(target);
-  b.emit_add(0, 1, 2);
-  b.bind(target);
-  b.emit_add(3, 4, 5);
+  b.emit_op(op_code::i64_add);
+  b.bind_label(target);
+  b.emit_op(op_code::i64_sub);
 
   auto bytes = b.build();
 
   byte_writer expected{};
 
-  expected.write<op_code_size>(int(op_code::jmp));
-  std::int64_t offset =
-    op_code_size + sizeof(std::int64_t) + // jmp size
-    op_code_size + sizeof(reg_id_t) * 3;  // add size
+  // Relaxed to the short form, the offset is from the jump itself
+  expected.write<op_code_size>(int(op_code::jmp_s));
+  short_jump_offset offset =
+    op_code_size + sizeof(short_jump_offset) + // jmp size
+    op_code_size;                             // add size
   expected.write_many(offset);
 
-  expected.write<op_code_size>(int(op_code::add));
-  expected.write_many(reg_id_t{0}, reg_id_t{1}, reg_id_t{2});
-
-  expected.write<op_code_size>(int(op_code::add));
-  expected.write_many(reg_id_t{3}, reg_id_t{4}, reg_id_t{5});
+  expected.write<op_code_size>(int(op_code::i64_add));
+  expected.write<op_code_size>(int(op_code::i64_sub));
 
   REQUIRE(bytes == expected.data());
+  REQUIRE(b.resolve_label(target) == offset);
 }
 
 TEST_CASE("Conditional jump", "[bytecode_builder]") {
@@ -120,27 +112,23 @@ TEST_CASE("Conditional jump", "[bytecode_builder]") {
 
   auto target = b.make_label();
 
-  b.emit_jmp_if(target, reg_id_t{7});
-  b.emit_add(0, 1, 2);
-  b.bind(target);
-  b.emit_add(3, 4, 5);
+  b.emit_jmp_if_zero(target);
+  b.emit_op(op_code::i64_add);
+  b.bind_label(target);
+  b.emit_op(op_code::i64_sub);
 
   auto bytes = b.build();
 
   byte_writer expected{};
 
-  expected.write<op_code_size>(int(op_code::jmp_if));
-  std::int64_t offset =
-    op_code_size + sizeof(std::int64_t) + sizeof(reg_id_t) + // jmp size
-    op_code_size + sizeof(reg_id_t) * 3; // add size
+  expected.write<op_code_size>(int(op_code::jmpz_s));
+  short_jump_offset offset =
+    op_code_size + sizeof(short_jump_offset) + // jmp size
+    op_code_size;                             // add size
   expected.write_many(offset);
-  expected.write_many(reg_id_t{7});
-
-  expected.write<op_code_size>(int(op_code::add));
-  expected.write_many(reg_id_t{0}, reg_id_t{1}, reg_id_t{2});
 
-  expected.write<op_code_size>(int(op_code::add));
-  expected.write_many(reg_id_t{3}, reg_id_t{4}, reg_id_t{5});
+  expected.write<op_code_size>(int(op_code::i64_add));
+  expected.write<op_code_size>(int(op_code::i64_sub));
 
   REQUIRE(bytes == expected.data());
 }
@@ -151,23 +139,46 @@ TEST_CASE("Backward jump (loop)", "[bytecode_builder]") {
   bytecode_builder b{};
 
   auto loop = b.make_label();
-  b.bind(loop);
+  b.bind_label(loop);
 
-  b.emit_add(0, 1, 2);
+  b.emit_op(op_code::i64_add);
   b.emit_jmp(loop);
 
   auto bytes = b.build();
 
   byte_writer expected{};
 
-  expected.write<op_code_size>(int(op_code::add));
-  expected.write_many(reg_id_t{0}, reg_id_t{1}, reg_id_t{2});
+  expected.write<op_code_size>(int(op_code::i64_add));
+
+  expected.write<op_code_size>(int(op_code::jmp_s));
+  short_jump_offset offset = -static_cast<short_jump_offset>(op_code_size);
+  expected.write_many(offset);
+
+  REQUIRE(bytes == expected.data());
+}
+
+TEST_CASE("Far jumps keep the long form", "[bytecode_builder]") {
+  using namespace korka::vm;
+
+  bytecode_builder b{};
+
+  auto target = b.make_label();
+  b.emit_jmp(target);
+  for (int i = 0; i < 200; ++i) {
+    b.emit_op(op_code::pop);
+  }
+  b.bind_label(target);
+
+  auto bytes = b.build();
+
+  byte_writer expected{};
 
   expected.write<op_code_size>(int(op_code::jmp));
-  std::int64_t offset =
-    -static_cast<std::int64_t>(
-      op_code_size + sizeof(reg_id_t) * 3);
+  jump_offset offset = op_code_size + sizeof(jump_offset) + 200 * op_code_size;
   expected.write_many(offset);
+  for (int i = 0; i < 200; ++i) {
+    expected.write<op_code_size>(int(op_code::pop));
+  }
 
   REQUIRE(bytes == expected.data());
 }
@@ -0,0 +1,197 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/decoder.hpp"
+#include "korka/vm/size_report.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <algorithm>
+#include <string>
+
+using namespace korka;
+using namespace korka::vm;
+
+static auto ops_of(std::span<const std::byte> code) -> std::vector<op_code> {
+  std::vector<op_code> ops;
+  for (std::size_t pc = 0; pc < code.size();) {
+    auto instr = decode(code, pc);
+    REQUIRE(instr);
+    ops.push_back(instr->op);
+    pc += instr->size;
+  }
+  return ops;
+}
+
+TEST_CASE("Constants use the shortest encoding", "[compact_encoding]") {
+  bytecode_builder b;
+  b.emit_const<type::i64>(0);
+  b.emit_const<type::i64>(1);
+  b.emit_const<type::i64>(-100);
+  b.emit_const<type::i64>(30000);
+  b.emit_const<type::i64>(1'000'000'007);
+  b.emit_const<type::i64>(1'000'000'007);
+  auto code = b.build();
+
+  CHECK(ops_of(code) == std::vector{
+    op_code::i64_const_0, op_code::i64_const_1, op_code::i64_const_i8,
+    op_code::i64_const_i16, op_code::i64_const_pool, op_code::i64_const_pool
+  });
+  CHECK(b.constants() == std::vector<stack_value_t>{1'000'000'007});
+  CHECK(code.size() == 1 + 1 + 2 + 3 + 3 + 3);
+}
+
+TEST_CASE("Jumps are relaxed to the short form when they fit", "[compact_encoding]") {
+  bytecode_builder b;
+  auto near = b.make_label();
+  auto far = b.make_label();
+  b.emit_jmp(near);
+  b.bind_label(near);
+  b.emit_jmp(far);
+  for (int i = 0; i < 200; ++i) {
+    b.emit_op(op_code::pop);
+  }
+  b.bind_label(far);
+  b.emit_op(op_code::ret_void);
+  auto code = b.build();
+
+  auto first = decode(code, 0);
+  REQUIRE(first);
+  CHECK(first->op == op_code::jmp_s);
+  CHECK(first->operand == 2);
+  CHECK(b.resolve_label(near) == 2);
+
+  auto second = decode(code, 2);
+  REQUIRE(second);
+  CHECK(second->op == op_code::jmp);
+  CHECK(second->operand == 5 + 200);
+  CHECK(b.resolve_label(far) == 2 + 5 + 200);
+}
+
+TEST_CASE("Compact programs run the same", "[compact_encoding]") {
+  std::string body;
+  for (int i = 0; i < 40; ++i) body += "int v" + std::to_string(i) + " = c + " + std::to_string(i) + ";\n";
+
+  auto p = compile_runtime(R"(
+    int big() { return 5000000000 + 5000000000 - 1; }
+    int small() { return 0 + 1 + 100 + 1000; }
+    int far(int c) {
+      if (c) {
+        )" + body + R"(
+        return v39;
+      }
+      return 0;
+    }
+  )");
+  REQUIRE(p);
+  CHECK(p->constants().size() == 1);
+
+  runtime vm;
+  CHECK(vm.execute(*p, "big") == 9'999'999'999);
+  CHECK(vm.execute(*p, "small") == 1101);
+  CHECK(vm.execute(*p, "far", {3}) == 42);
+  CHECK(vm.execute(*p, "far", {0}) == 0);
+
+  auto report = report_size(p->view());
+  REQUIRE(report);
+  CHECK(report->code_bytes == p->code().size());
+  CHECK(report->pooled_constants == 2);
+  CHECK(report->inline_constants == 0);
+  CHECK(report->long_jumps == 1);
+  CHECK_FALSE(to_string(*report).empty());
+}
+
+TEST_CASE("Word encoding runs the same programs", "[compact_encoding]") {
+  constexpr std::string_view source = R"(
+    int fib(int n) {
+      if (n) {
+        if (n - 1) { return fib(n - 1) + fib(n - 2); }
+        return 1;
+      }
+      return 0;
+    }
+    int big(int x) { return x * 5000000000 - 300 + 7; }
+  )";
+
+  auto bytes = compile_runtime(source);
+  auto words = compile_runtime(source, {.encoding = instruction_encoding::words});
+  REQUIRE(bytes);
+  REQUIRE(words);
+  CHECK(words->encoding() == instruction_encoding::words);
+  CHECK(words->code().size() % sizeof(instruction_word) == 0);
+  CHECK(std::ranges::equal(words->constants(), bytes->constants()));
+
+  for (const auto &entry: words->table()) {
+    for (std::size_t pc = 0; pc < entry.size; pc += sizeof(instruction_word)) {
+      auto instr = decode(words->code().subspan(entry.offset, entry.size), pc, instruction_encoding::words);
+      REQUIRE(instr);
+      CHECK(instr->size == sizeof(instruction_word));
+    }
+  }
+
+  runtime vm;
+  CHECK(vm.execute(*words, "fib", {15}) == 610);
+  CHECK(vm.execute(*words, "big", {2}) == vm.execute(*bytes, "big", {2}).value());
+
+  auto verified_words = verified<program>::make(std::move(*words));
+  REQUIRE(verified_words);
+  CHECK(vm.execute(*verified_words, "fib", {15}) == 610);
+  CHECK(vm.execute(*verified_words, "big", {-1}) == -5'000'000'293);
+}
+
+TEST_CASE("A backward jump can end a word encoded function", "[compact_encoding]") {
+  // Counts the parameter down, the loop's closing jump is the last word of the function
+  bytecode_builder b{instruction_encoding::words};
+  auto top = b.make_label();
+  auto out = b.make_label();
+  b.emit_param_load(1);
+  b.emit_jmp(top);
+  b.bind_label(out);
+  b.emit_const<type::i64>(42);
+  b.emit_op(op_code::ret);
+  b.bind_label(top);
+  b.emit_load_local(0);
+  b.emit_jmp_if_zero(out);
+  b.emit_load_local(0);
+  b.emit_const<type::i64>(1);
+  b.emit_op(op_code::i64_sub);
+  b.emit_save_local(0);
+  b.emit_jmp(top);
+  auto code = b.build();
+  REQUIRE_FALSE(b.failure());
+  function_entry entry{.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 1,
+                       .locals_count = 1, .return_type = type::i64};
+  program p{std::move(code), {entry}, {{"f", {type::i64}, type::i64}}, b.constants(), instruction_encoding::words};
+
+  runtime vm;
+  CHECK(vm.execute(p, "f", {3}) == 42);
+  CHECK(vm.execute(p, "f", {0}) == 42);
+}
+
+TEST_CASE("Code the encoding cannot hold is reported", "[compact_encoding]") {
+  SECTION("a jump past the word operand") {
+    bytecode_builder b{instruction_encoding::words};
+    auto far = b.make_label();
+    b.emit_jmp(far);
+    for (int i = 0; i < 1 << (word_operand_bits - 2); ++i) {
+      b.emit_op(op_code::pop);
+    }
+    b.bind_label(far);
+    b.emit_op(op_code::ret_void);
+    b.build();
+    CHECK(b.failure());
+  }
+
+  SECTION("a jump to an unbound label") {
+    for (auto encoding: {instruction_encoding::bytes, instruction_encoding::words}) {
+      bytecode_builder b{encoding};
+      b.emit_jmp(b.make_label());
+      CHECK(b.build().empty());
+      CHECK(b.failure());
+    }
+  }
+
+  bytecode_builder fine{instruction_encoding::words};
+  fine.emit_const<type::i64>(1'000'000'007);
+  fine.build();
+  CHECK_FALSE(fine.failure());
+}
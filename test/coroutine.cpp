@@ -0,0 +1,123 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <coroutine>
+#include <exception>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto behaviour_source = R"(
+  int wander(int x) {
+    yield x * 2;
+    return x + 100;
+  }
+  int patrol(int start) {
+    yield start;
+    yield start + 1;
+    int back = wander(start);
+    yield;
+    return back * 10;
+  }
+  int plain(int x) { return x - 1; }
+)";
+
+TEST_CASE("Coroutines keep their frames between yields", "[coroutine]") {
+  auto p = compile_runtime(behaviour_source);
+  REQUIRE(p);
+
+  runtime vm;
+  auto co = vm.start(*p, "patrol", {5});
+  REQUIRE(co);
+  CHECK_FALSE(co->done());
+  CHECK(co->value() == 5);
+
+  std::vector<stack_value_t> seen;
+  while (not co->done()) {
+    auto value = vm.resume(*co);
+    REQUIRE(value);
+    seen.push_back(*value);
+  }
+  // The yield inside `wander` suspends both frames
+  CHECK(seen == std::vector<stack_value_t>{6, 10, 0, 1050});
+  CHECK(co->value() == 1050);
+  CHECK_FALSE(vm.resume(*co));
+
+  SECTION("Functions that never yield finish right away") {
+    auto done = vm.start(*p, "plain", {3});
+    REQUIRE(done);
+    CHECK(done->done());
+    CHECK(done->value() == 2);
+  }
+
+  SECTION("Many coroutines wait on one runtime") {
+    std::vector<coroutine> entities;
+    for (stack_value_t i = 0; i < 3; ++i) {
+      entities.push_back(*vm.start(*p, "patrol", {i * 100}));
+    }
+    // Plain calls in between do not disturb the suspended ones
+    CHECK(vm.execute(*p, "plain", {1}) == 0);
+
+    for (auto &e: entities) REQUIRE(vm.resume(e));
+    for (stack_value_t i = 0; i < 3; ++i) {
+      CHECK(entities[static_cast<std::size_t>(i)].value() == i * 100 + 1);
+    }
+  }
+
+  SECTION("Yield needs a coroutine") {
+    CHECK_FALSE(vm.execute(*p, "patrol", {1}));
+
+    auto checked = verified<program>::make(*p);
+    REQUIRE(checked);
+    CHECK_FALSE(vm.execute(*checked, "patrol", {1}));
+  }
+
+  SECTION("Word encoded coroutines") {
+    auto words = compile_runtime(behaviour_source, {.encoding = instruction_encoding::words});
+    REQUIRE(words);
+    auto wco = vm.start(*words, "patrol", {5});
+    REQUIRE(wco);
+    while (not wco->done()) REQUIRE(vm.resume(*wco));
+    CHECK(wco->value() == 1050);
+  }
+}
+
+namespace {
+  // Starts eagerly and runs detached, enough to drive awaited script calls
+  struct fire_and_forget {
+    struct promise_type {
+      auto get_return_object() -> fire_and_forget { return {}; }
+      auto initial_suspend() noexcept -> std::suspend_never { return {}; }
+      auto final_suspend() noexcept -> std::suspend_never { return {}; }
+      auto return_void() -> void {}
+      auto unhandled_exception() -> void { std::terminate(); }
+    };
+  };
+
+  auto behaviour(runtime &vm, const program &p, stack_value_t start, std::vector<stack_value_t> &log)
+    -> fire_and_forget {
+    auto first = co_await vm.call<"patrol">(p, start);
+    log.push_back(first ? *first : -1);
+    auto second = co_await vm.call<"plain">(p, start);
+    log.push_back(second ? *second : -1);
+    auto missing = co_await vm.call<"missing">(p);
+    log.push_back(missing ? *missing : -1);
+  }
+}
+
+TEST_CASE("Script calls can be awaited from C++ coroutines", "[coroutine]") {
+  auto p = compile_runtime(behaviour_source);
+  REQUIRE(p);
+
+  runtime vm;
+  std::vector<stack_value_t> log;
+  behaviour(vm, *p, 5, log);
+
+  // patrol yields four times before it returns
+  std::size_t ticks = 0;
+  while (vm.resume_parked() != 0) ++ticks;
+  CHECK(ticks == 3);
+  CHECK(log == std::vector<stack_value_t>{1050, 4, -1});
+}
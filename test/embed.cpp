@@ -0,0 +1,110 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/compiler/compiler.hpp"
+#include "korka/compiler/lexer.hpp"
+#include "korka/compiler/parser.hpp"
+#include "korka/vm/embed.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <array>
+#include <span>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto bounds_source = R"(
+  int add3(int a, int b, int c) { return a + b + c; }
+  int mix(int x) {
+    int y = add3(x, x * 2, 7);
+    return y * add3(1, 2, x) - x / 2;
+  }
+  int inner(int a) { return a + (a + (a + a)); }
+  int outer(int x) { return x + inner(x); }
+  int fact(int n) {
+    if (n) { return n * fact(n - 1); }
+    return 1;
+  }
+  int uses_fact(int n) { return fact(n) + 1; }
+  int fetch(int id);
+  int with_native(int id) { return fetch(id) + 1; }
+  int ratio(int a, int b) { return a / b; }
+)";
+
+namespace {
+  auto compile_infos(std::string_view source) -> compilation_result {
+    auto tokens = lexer{source}.lex();
+    REQUIRE(tokens);
+    auto parsed = parser{std::span<const lex_token>{*tokens}}.parse();
+    REQUIRE(parsed);
+    auto &[nodes, root] = *parsed;
+    auto compiled = compiler{nodes, root}.compile();
+    REQUIRE(compiled);
+    return std::move(*compiled);
+  }
+}
+
+TEST_CASE("The compiler knows how deep functions go", "[embed]") {
+  auto result = compile_infos(bounds_source);
+  auto &f = result.functions;
+
+  CHECK(f["add3"].max_stack == 3);
+  CHECK(f["add3"].bounded);
+  CHECK(f["add3"].total_stack == 3);
+  CHECK(f["add3"].total_frames == 1);
+
+  CHECK(f["mix"].max_stack == 4);
+  CHECK(f["mix"].total_stack == 4);
+  CHECK(f["mix"].total_locals == 5);
+  CHECK(f["mix"].total_frames == 2);
+
+  // The callee goes deeper than the caller ever does
+  CHECK(f["inner"].max_stack == 4);
+  CHECK(f["outer"].max_stack == 2);
+  CHECK(f["outer"].total_stack == 5);
+
+  CHECK_FALSE(f["fact"].bounded);
+  CHECK_FALSE(f["uses_fact"].bounded);
+  CHECK(f["uses_fact"].max_stack == 2);
+
+  CHECK(f["with_native"].bounded);
+  CHECK(f["with_native"].total_frames == 1);
+
+  SECTION("The function table agrees with the verifier") {
+    auto p = compile_runtime(bounds_source);
+    REQUIRE(p);
+    auto facts = verify(p->view());
+    REQUIRE(facts);
+    for (std::size_t i = 0; i < p->table().size(); ++i) {
+      if (is_native(p->table()[i])) continue;
+      CHECK(p->table()[i].max_stack == (*facts)[i].max_stack);
+    }
+  }
+}
+
+TEST_CASE("Embedded runs use fixed stacks", "[embed]") {
+  auto result = compile_infos(bounds_source);
+  auto p = compile_runtime(bounds_source);
+  REQUIRE(p);
+  auto words = compile_runtime(bounds_source, {.encoding = instruction_encoding::words});
+  REQUIRE(words);
+
+  const auto &mix = result.functions["mix"];
+  REQUIRE(mix.total_stack <= 8);
+  REQUIRE(mix.total_locals <= 8);
+  REQUIRE(mix.total_frames <= 2);
+  constexpr embed_bounds bounds{8, 8, 2};
+
+  runtime vm;
+  for (stack_value_t x: {0, 1, 5, -9, 1000}) {
+    std::array<stack_value_t, 1> args{x};
+    auto expected = vm.execute(*p, "mix", {x});
+    REQUIRE(expected);
+    CHECK(run_embed<bounds>(p->view(), *p->find("mix"), args) == *expected);
+    CHECK(run_embed<bounds>(words->view(), *words->find("mix"), args) == *expected);
+  }
+
+  std::array<stack_value_t, 2> pair{7, 0};
+  CHECK_FALSE(run_embed<bounds>(p->view(), *p->find("ratio"), pair));
+  CHECK_FALSE(run_embed<bounds>(p->view(), *p->find("mix"), pair));
+  CHECK_FALSE(run_embed<bounds>(p->view(), *p->find("fetch"), std::span{pair}.first(1)));
+}
@@ -0,0 +1,81 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/executor.hpp"
+#include <atomic>
+#include <future>
+#include <latch>
+#include <vector>
+
+using namespace korka;
+
+static constexpr auto score_source = R"(
+  int twice(int x) { return x * 2; }
+  int score(int a, int b) { return twice(a) - b; }
+  int ratio(int a, int b) { return a / b; }
+)";
+
+TEST_CASE("Executor futures carry the results", "[executor]") {
+  auto p = compile_runtime(score_source);
+  REQUIRE(p);
+
+  executor pool{4};
+  std::vector<std::future<runtime::result_t>> results;
+  for (int i = 0; i < 2000; ++i) {
+    results.push_back(pool.submit(*p, "score", {i, 3}));
+  }
+
+  int bad = 0;
+  for (int i = 0; i < 2000; ++i) {
+    if (results[i].get() != 2 * i - 3) ++bad;
+  }
+  CHECK(bad == 0);
+
+  CHECK_FALSE(pool.submit(*p, "ratio", {1, 0}).get());
+  CHECK_FALSE(pool.submit(*p, "missing", {1}).get());
+}
+
+TEST_CASE("Executor callbacks run on the workers", "[executor]") {
+  auto p = compile_runtime(score_source);
+  REQUIRE(p);
+
+  std::atomic<long> sum{0};
+  std::atomic<int> failed{0};
+  {
+    executor pool{3};
+    for (int i = 0; i < 1000; ++i) {
+      pool.submit(*p, "score", {i, 0}, [&](runtime::result_t r) {
+        if (r) sum += *r;
+        else ++failed;
+      });
+    }
+    // The destructor runs whatever is still queued
+  }
+  CHECK(sum == 999 * 1000);
+  CHECK(failed == 0);
+}
+
+TEST_CASE("Idle workers steal queued tasks", "[executor]") {
+  auto p = compile_runtime(score_source);
+  REQUIRE(p);
+
+  executor pool{2};
+  std::latch started{1};
+  std::latch release{1};
+  std::atomic<int> done{0};
+
+  // Occupies one worker, the tasks it fans out land on its own deque
+  pool.submit(*p, "score", {1, 1}, [&](runtime::result_t) {
+    for (int i = 0; i < 64; ++i) {
+      pool.submit(*p, "score", {i, 0}, [&](runtime::result_t r) {
+        if (r) ++done;
+      });
+    }
+    started.count_down();
+    release.wait();
+  });
+
+  started.wait();
+  while (done < 64) std::this_thread::yield();
+  release.count_down();
+  CHECK(pool.steals() > 0);
+}
@@ -0,0 +1,154 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/embed.hpp"
+#include "korka/vm/f64.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <array>
+#include <limits>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto pricing_source = R"(
+  double price(double base, int quantity, double discount) {
+    double gross = base * quantity;
+    if (gross > 100.0) {
+      return gross - gross * discount;
+    }
+    return gross;
+  }
+  double half(int x) { return x / 2.0; }
+  int whole(double x) { return x; }
+  int ratio(double a, double b) {
+    char c = a / b;
+    return c;
+  }
+  int positive(double x) {
+    if (x) {
+      if (x >= 0.0) {
+        return 1;
+      }
+      return 0 - 1;
+    }
+    return 0;
+  }
+  double twice(double x) { return x * 2; }
+  double quad(int x) { return twice(twice(x)); }
+  double per(double total, int count) { return total / count; }
+)";
+
+TEST_CASE("Scripts compute with doubles", "[f64]") {
+  auto p = compile_runtime(pricing_source);
+  REQUIRE(p);
+
+  runtime vm;
+  auto price = vm.execute(*p, "price", {from_f64(12.5), 10, from_f64(0.25)});
+  REQUIRE(price);
+  CHECK(as_f64(*price) == 125.0 - 125.0 * 0.25);
+  CHECK(as_f64(*vm.execute(*p, "price", {from_f64(9.5), 2, from_f64(0.25)})) == 19.0);
+
+  // Ints meeting doubles are promoted, doubles stored into ints are truncated
+  CHECK(as_f64(*vm.execute(*p, "half", {7})) == 3.5);
+  CHECK(as_f64(*vm.execute(*p, "quad", {3})) == 12.0);
+  CHECK(vm.execute(*p, "whole", {from_f64(-2.75)}) == -2);
+  CHECK(vm.execute(*p, "whole", {from_f64(1e300)}) == std::numeric_limits<stack_value_t>::max());
+  CHECK(vm.execute(*p, "whole", {from_f64(std::numeric_limits<double>::quiet_NaN())}) == 0);
+  CHECK(vm.execute(*p, "ratio", {from_f64(1000.0), from_f64(2.0)}) == -12);
+
+  CHECK(vm.execute(*p, "positive", {from_f64(0.5)}) == 1);
+  CHECK(vm.execute(*p, "positive", {from_f64(-0.5)}) == -1);
+  CHECK(vm.execute(*p, "positive", {from_f64(0.0)}) == 0);
+
+  // Division by zero is IEEE 754, not a trap
+  CHECK(as_f64(*vm.execute(*p, "per", {from_f64(3.0), 0})) == std::numeric_limits<double>::infinity());
+  CHECK(as_f64(*vm.execute(*p, "per", {from_f64(-3.0), 0})) == -std::numeric_limits<double>::infinity());
+  CHECK_FALSE(compile_runtime("int f(double x) { yield x; return 0; }"));
+}
+
+TEST_CASE("Every loop agrees on doubles", "[f64]") {
+  auto p = compile_runtime(pricing_source);
+  REQUIRE(p);
+  auto words = compile_runtime(pricing_source, {.encoding = instruction_encoding::words});
+  REQUIRE(words);
+
+  auto checked = *p;
+  auto v = verified<program>::make(std::move(*p));
+  auto vw = verified<program>::make(std::move(*words));
+  REQUIRE(v);
+  REQUIRE(vw);
+
+  runtime vm;
+  for (double base: {0.0, 1.5, 12.5, -40.0, 1e18}) {
+    for (stack_value_t quantity: {0, 3, 100}) {
+      auto expected = vm.execute(checked, "price", {from_f64(base), quantity, from_f64(0.1)});
+      REQUIRE(expected);
+      CHECK(vm.execute(*v, "price", {from_f64(base), quantity, from_f64(0.1)}) == *expected);
+      CHECK(vm.execute(*vw, "price", {from_f64(base), quantity, from_f64(0.1)}) == *expected);
+
+      std::array<stack_value_t, 3> args{from_f64(base), quantity, from_f64(0.1)};
+      CHECK(run_embed<embed_bounds{8, 8, 4}>(v->view(), *v->find("price"), args) == *expected);
+    }
+    auto expected = vm.execute(checked, "ratio", {from_f64(base), from_f64(0.3)});
+    CHECK(vm.execute(*v, "ratio", {from_f64(base), from_f64(0.3)}) == *expected);
+    CHECK(vm.execute(*vw, "whole", {from_f64(base)}) == *vm.execute(checked, "whole", {from_f64(base)}));
+  }
+
+  std::vector<stack_value_t> bases{from_f64(10.0), from_f64(50.0), from_f64(0.5), from_f64(-3.0), from_f64(99.0)};
+  std::vector<stack_value_t> quantities{1, 5, 7, 2, 3};
+  std::vector<stack_value_t> discounts(5, from_f64(0.5));
+  std::vector<stack_value_t> out(5);
+  std::array<runtime::column_t, 3> columns{bases, quantities, discounts};
+  REQUIRE(vm.execute_batch<4>(*v, "price", columns, out));
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    CHECK(out[i] == *vm.execute(checked, "price", {bases[i], quantities[i], discounts[i]}));
+  }
+}
+
+TEST_CASE("The verifier keeps ints and doubles apart", "[f64]") {
+  auto function = [](bytecode_builder &b, std::vector<type> params, type return_type) {
+    auto code = b.build();
+    function_entry entry{
+      .offset = 0,
+      .size = static_cast<std::uint32_t>(code.size()),
+      .param_count = static_cast<std::uint16_t>(params.size()),
+      .locals_count = static_cast<std::uint16_t>(params.size()),
+      .return_type = return_type
+    };
+    return program{std::move(code), {entry}, {{"f", std::move(params), return_type}}, b.constants()};
+  };
+
+  SECTION("a double returned as an int") {
+    bytecode_builder b;
+    b.emit_op(op_code::ret);
+    CHECK(verify(function(b, {type::f64}, type::f64).view()));
+    CHECK_FALSE(verify(function(b, {type::f64}, type::i64).view()));
+  }
+
+  SECTION("an int used as a double") {
+    bytecode_builder b;
+    b.emit_const<type::f64>(1.5);
+    b.emit_op(op_code::f64_add);
+    b.emit_op(op_code::ret);
+    CHECK(verify(function(b, {type::f64}, type::f64).view()));
+    CHECK_FALSE(verify(function(b, {type::i64}, type::f64).view()));
+  }
+
+  SECTION("a comparison is an int") {
+    bytecode_builder b;
+    b.emit_const<type::f64>(1.5);
+    b.emit_op(op_code::f64_lt);
+    b.emit_op(op_code::ret);
+    CHECK(verify(function(b, {type::f64}, type::i64).view()));
+    CHECK_FALSE(verify(function(b, {type::f64}, type::f64).view()));
+  }
+
+  SECTION("arrays and objects are not returned") {
+    bytecode_builder b;
+    b.emit_op(op_code::ret);
+    CHECK_FALSE(verify(function(b, {type::i64_array}, type::i64_array).view()));
+    CHECK_FALSE(verify(function(b, {type::object}, type::object).view()));
+  }
+}
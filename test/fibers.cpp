@@ -0,0 +1,83 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/fibers.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto session_source = R"(
+  int countdown(int n) {
+    yield n;
+    if (n) { return countdown(n - 1) + 1; }
+    return 0;
+  }
+  int session(int id) {
+    yield id;
+    yield id + 1;
+    return id * 2;
+  }
+)";
+
+TEST_CASE("Fibers take turns on the run queue", "[fibers]") {
+  auto p = compile_runtime(session_source);
+  REQUIRE(p);
+
+  fiber_scheduler fibers;
+  std::vector<stack_value_t> finished;
+  auto record = [&](runtime::result_t r) { finished.push_back(r ? *r : -1); };
+
+  fibers.spawn(*p, "countdown", {3}, record);
+  fibers.spawn(*p, "session", {10}, record);
+  fibers.spawn(*p, "missing", {1}, record);
+  CHECK(fibers.active() == 2);
+
+  // One step each per round, the short session finishes first
+  CHECK(fibers.run(2) == 2);
+  CHECK(finished == std::vector<stack_value_t>{-1});
+  CHECK(fibers.run() == 6);
+  CHECK(finished == std::vector<stack_value_t>{-1, 20, 3});
+  CHECK(fibers.active() == 0);
+}
+
+TEST_CASE("A hundred thousand sessions on one runtime", "[fibers]") {
+  auto p = compile_runtime(session_source);
+  REQUIRE(p);
+
+  fiber_scheduler fibers;
+  std::int64_t sum = 0;
+  constexpr int count = 100000;
+  for (int i = 0; i < count; ++i) {
+    fibers.spawn(*p, "session", {i}, [&](runtime::result_t r) { sum += *r; });
+  }
+
+  // Every session is suspended at its first yield
+  CHECK(fibers.run(count) == count);
+  CHECK(fibers.active() == count);
+
+  fibers.run();
+  CHECK(fibers.active() == 0);
+  CHECK(sum == std::int64_t{count} * (count - 1));
+}
+
+TEST_CASE("Worker threads drive the fibers", "[fibers]") {
+  auto p = compile_runtime(session_source);
+  REQUIRE(p);
+
+  std::atomic<std::int64_t> sum{0};
+  std::atomic<int> finished{0};
+  {
+    fiber_scheduler fibers{4};
+    for (int i = 0; i < 2000; ++i) {
+      fibers.spawn(*p, "countdown", {i % 8}, [&](runtime::result_t r) {
+        sum += *r;
+        ++finished;
+      });
+    }
+    while (finished < 2000) std::this_thread::yield();
+    CHECK(fibers.active() == 0);
+  }
+  CHECK(sum == 250 * (0 + 1 + 2 + 3 + 4 + 5 + 6 + 7));
+}
@@ -0,0 +1,99 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/fibers.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto sum_source = R"(
+  int sum_to(int n) {
+    if (n) { return n + sum_to(n - 1); }
+    return 0;
+  }
+)";
+
+TEST_CASE("Backward jumps spend fuel", "[fuel]") {
+  // for (;;) {}
+  bytecode_builder b;
+  auto top = b.make_label();
+  b.bind_label(top);
+  b.emit_jmp(top);
+  auto code = b.build();
+  function_entry entry{
+    .offset = 0,
+    .size = static_cast<std::uint32_t>(code.size()),
+    .param_count = 0,
+    .locals_count = 0,
+    .return_type = type::void_
+  };
+  program spin{std::move(code), {entry}, {{"spin", {}, type::void_}}};
+
+  runtime vm;
+  vm.set_fuel(1000);
+  CHECK_FALSE(vm.execute(spin, "spin"));
+  CHECK(vm.fuel_left() == 0);
+
+  auto checked = verified<program>::make(spin);
+  REQUIRE(checked);
+  CHECK_FALSE(vm.execute(*checked, "spin"));
+
+  SECTION("Coroutines are preempted and can go on") {
+    auto co = vm.start(spin, "spin");
+    REQUIRE(co);
+    CHECK_FALSE(co->done());
+    CHECK(co->preempted());
+    REQUIRE(vm.resume(*co));
+    CHECK(co->preempted());
+  }
+}
+
+TEST_CASE("Calls spend fuel", "[fuel]") {
+  auto p = compile_runtime(sum_source);
+  REQUIRE(p);
+
+  runtime vm;
+  CHECK(vm.fuel() == runtime::unlimited_fuel);
+  vm.set_fuel(50);
+
+  // Every invocation gets the whole budget
+  CHECK(vm.execute(*p, "sum_to", {30}) == 465);
+  CHECK(vm.fuel_left() == 20);
+  CHECK(vm.execute(*p, "sum_to", {30}) == 465);
+  CHECK_FALSE(vm.execute(*p, "sum_to", {100}));
+
+  auto checked = verified<program>::make(*p);
+  REQUIRE(checked);
+  CHECK(vm.execute(*checked, "sum_to", {30}) == 465);
+  CHECK_FALSE(vm.execute(*checked, "sum_to", {100}));
+
+  SECTION("Batches trap the rows that run out") {
+    std::vector<stack_value_t> n{1, 2, 3, 4, 5, 6, 7, 100}, out(n.size());
+    CHECK_FALSE(vm.execute_batch<"sum_to", 8>(*checked, n, out));
+    CHECK(out[6] == 28);
+  }
+
+  SECTION("A preempted coroutine finishes over several steps") {
+    auto co = vm.start(*p, "sum_to", {100});
+    REQUIRE(co);
+    std::size_t steps = 1;
+    while (not co->done()) {
+      REQUIRE(vm.resume(*co));
+      ++steps;
+    }
+    CHECK(co->value() == 5050);
+    CHECK(steps == 3);
+  }
+
+  SECTION("Fibers that never yield still take turns") {
+    fiber_scheduler fibers{0, 40};
+    std::vector<stack_value_t> finished;
+    fibers.spawn(*p, "sum_to", {100}, [&](runtime::result_t r) { finished.push_back(*r); });
+    fibers.spawn(*p, "sum_to", {10}, [&](runtime::result_t r) { finished.push_back(*r); });
+    fibers.run();
+    CHECK(finished == std::vector<stack_value_t>{55, 5050});
+  }
+}
@@ -0,0 +1,75 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/image.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <filesystem>
+
+using namespace korka;
+
+static auto compile_ok(std::string_view code) -> program {
+  auto result = compile_runtime(code);
+  if (not result) {
+    FAIL(to_string(result.error()));
+  }
+  return std::move(result).value();
+}
+
+constexpr std::string_view image_script = R"(
+  int add(int a, int b) { return a + b; }
+  int main() { return add(40, 2); }
+)";
+
+TEST_CASE("Image keeps the function table and code", "[image]") {
+  auto p = compile_ok(image_script);
+  auto bytes = vm::write_image(p);
+
+  auto image = vm::image_view::from_bytes(bytes);
+  REQUIRE(image);
+  REQUIRE(image->function_count() == 2);
+  CHECK(image->find("add") == 0);
+  CHECK(image->find("main") == 1);
+  CHECK_FALSE(image->find("sub"));
+  CHECK(image->function_name(0) == "add");
+  CHECK(image->param_types(0).size() == 2);
+
+  auto view = image->view();
+  CHECK(view.code.size() == p.code().size());
+  CHECK(std::ranges::equal(view.code, p.code()));
+  CHECK(reinterpret_cast<std::uintptr_t>(view.code.data()) % vm::image_code_alignment
+        == reinterpret_cast<std::uintptr_t>(bytes.data()) % vm::image_code_alignment);
+
+  runtime vm;
+  CHECK(vm.execute(*image, "main") == 42);
+}
+
+TEST_CASE("Image rejects malformed input", "[image]") {
+  auto bytes = vm::write_image(compile_ok(image_script));
+
+  SECTION("Truncated") {
+    CHECK_FALSE(vm::image_view::from_bytes(std::span{bytes}.first(bytes.size() - 1)));
+    CHECK_FALSE(vm::image_view::from_bytes(std::span{bytes}.first(8)));
+  }
+
+  SECTION("Bad magic") {
+    auto copy = bytes;
+    copy[0] = std::byte{'X'};
+    CHECK_FALSE(vm::image_view::from_bytes(copy));
+  }
+}
+
+TEST_CASE("Mapped image executes from the file", "[image]") {
+  auto path = std::filesystem::temp_directory_path() / "korka_test_image.kimg";
+  REQUIRE(vm::save_image(compile_ok(image_script), path));
+
+  auto mapped = vm::mapped_image::open(path);
+  REQUIRE(mapped);
+
+  runtime vm;
+  CHECK(vm.execute(*mapped, "add", {1, 2}) == 3);
+  CHECK(vm.execute(*mapped, "main") == 42);
+
+  auto moved = std::move(*mapped);
+  CHECK(vm.execute(moved, "main") == 42);
+
+  std::filesystem::remove(path);
+}
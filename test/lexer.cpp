@@ -1,5 +1,7 @@
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
 #include "korka/compiler/lexer.hpp"
+#include <format>
 
 TEST_CASE("lex_token: Equality operator", "[lexer][unit]") {
   using namespace korka;
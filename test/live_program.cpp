@@ -0,0 +1,107 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/live_program.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace korka;
+
+static auto compile_or_fail(std::string_view source) -> program {
+  auto p = compile_runtime(source);
+  REQUIRE(p);
+  return std::move(*p);
+}
+
+TEST_CASE("Replacing a function keeps its callers linked", "[live_program]") {
+  live_program live{compile_or_fail(R"(
+    int scale(int x) { return x * 2; }
+    int main(int x) { return scale(x) + 1; }
+  )")};
+  runtime vm;
+
+  CHECK(vm.execute(live.acquire(), "main", {10}) == 21);
+
+  // The replacement is declared in another order, calls are relinked by name
+  auto patch = compile_or_fail(R"(
+    int offset() { return 100; }
+    int scale(int x) { return x * 3 + offset(); }
+  )");
+  CHECK_FALSE(live.replace_function("scale", patch));
+
+  live.publish(compile_or_fail(R"(
+    int offset() { return 100; }
+    int scale(int x) { return x * 2; }
+    int main(int x) { return scale(x) + 1; }
+  )"));
+  REQUIRE(live.replace_function("scale", patch));
+  CHECK(vm.execute(live.acquire(), "main", {10}) == 131);
+  CHECK(vm.execute(live.acquire(), "offset") == 100);
+}
+
+TEST_CASE("Replacements bring their own frame layout", "[live_program]") {
+  live_program live{compile_or_fail("int f(int x) { return x + 1; }")};
+  auto patch = compile_or_fail(R"(
+    int f(int x) {
+      char low = x;
+      int doubled = low * 2;
+      return doubled;
+    }
+  )");
+  REQUIRE(live.replace_function("f", patch));
+
+  auto current = live.acquire();
+  const auto &entry = current.get().table()[*current.find("f")];
+  const auto &source = patch.table()[*patch.find("f")];
+  CHECK(entry.narrow_size == source.narrow_size);
+  CHECK(entry.max_stack == source.max_stack);
+  CHECK(entry.locals_count == source.locals_count);
+
+  runtime vm;
+  CHECK(vm.execute(current, "f", {3}) == 6);
+  CHECK(vm.execute(current, "f", {257}) == 2);
+  auto v = vm::verified<program>::make(program{current.get()});
+  REQUIRE(v);
+  CHECK(vm.execute(*v, "f", {-1}) == -2);
+}
+
+TEST_CASE("Replacements with another signature are rejected", "[live_program]") {
+  live_program live{compile_or_fail("int f(int x) { return x; }")};
+  runtime vm;
+
+  CHECK_FALSE(live.replace_function("f", compile_or_fail("int f(int x, int y) { return x + y; }")));
+  CHECK_FALSE(live.replace_function("g", compile_or_fail("int g() { return 1; }")));
+  CHECK(vm.execute(live.acquire(), "f", {5}) == 5);
+}
+
+TEST_CASE("Running invocations survive swaps", "[live_program]") {
+  live_program live{compile_or_fail("int f(int x) { return x + 0; }")};
+  std::vector<program> versions;
+  for (int i = 1; i <= 4; ++i) {
+    versions.push_back(compile_or_fail("int f(int x) { return x + " + std::to_string(i) + "; }"));
+  }
+
+  std::atomic<bool> stop{false};
+  std::atomic<int> bad{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      runtime vm;
+      while (not stop.load()) {
+        auto r = vm.execute(live.acquire(), "f", {1000});
+        if (not r || *r < 1000 || *r > 1004) ++bad;
+      }
+    });
+  }
+
+  for (int round = 0; round < 200; ++round) {
+    if (not live.replace_function("f", versions[round % versions.size()])) ++bad;
+  }
+  stop = true;
+  for (auto &t: readers) t.join();
+
+  CHECK(bad == 0);
+  CHECK(live.collect() == 0);
+}
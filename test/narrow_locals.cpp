@@ -0,0 +1,113 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/embed.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <array>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto chars_source = R"(
+  int low(int x) {
+    char c = x;
+    return c;
+  }
+  int mix(int a, int b) {
+    char c0 = a;
+    char c1 = b;
+    char c2 = a + b;
+    int wide = a * b;
+    char c3 = low(c2 * 2);
+    return c0 + c1 + c2 + c3 + wide;
+  }
+  int steps(int n) {
+    char c = n;
+    if (n) {
+      yield c;
+    }
+    return c + 1;
+  }
+)";
+
+TEST_CASE("Narrow locals are stored at their own width", "[narrow]") {
+  auto p = compile_runtime(chars_source);
+  REQUIRE(p);
+  const auto &mix = p->table()[*p->find("mix")];
+  CHECK(mix.locals_count == 3);
+  CHECK(mix.narrow_size == 4);
+  CHECK(p->table()[*p->find("low")].narrow_size == 1);
+
+  runtime vm;
+  CHECK(vm.execute(*p, "low", {300}) == 44);
+  CHECK(vm.execute(*p, "low", {200}) == -56);
+  CHECK(vm.execute(*p, "low", {-1}) == -1);
+  // 100 + 100 keeps its low byte, -56, doubled and narrowed again gives -112
+  CHECK(vm.execute(*p, "mix", {100, 100}) == 100 + 100 - 56 - 112 + 10000);
+}
+
+TEST_CASE("Every loop agrees on narrow locals", "[narrow]") {
+  auto p = compile_runtime(chars_source);
+  REQUIRE(p);
+  auto words = compile_runtime(chars_source, {.encoding = instruction_encoding::words});
+  REQUIRE(words);
+
+  auto checked = *p;
+  auto v = verified<program>::make(std::move(*p));
+  auto vw = verified<program>::make(std::move(*words));
+  REQUIRE(v);
+  REQUIRE(vw);
+
+  runtime vm;
+  for (stack_value_t a: {-300, -1, 0, 7, 127, 128, 1000}) {
+    for (stack_value_t b: {-129, 3, 255}) {
+      auto expected = vm.execute(checked, "mix", {a, b});
+      REQUIRE(expected);
+      CHECK(vm.execute(*v, "mix", {a, b}) == *expected);
+      CHECK(vm.execute(*vw, "mix", {a, b}) == *expected);
+
+      std::array<stack_value_t, 2> args{a, b};
+      CHECK(run_embed<embed_bounds{8, 8, 4, 8}>(v->view(), *v->find("mix"), args) == *expected);
+    }
+  }
+
+  std::vector<stack_value_t> column_a{1, 200, 3, 400, 5}, column_b{6, 7, 8, 9, 10}, out(5);
+  std::array<runtime::column_t, 2> columns{column_a, column_b};
+  REQUIRE(vm.execute_batch<4>(*v, "mix", columns, out));
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    CHECK(out[i] == *vm.execute(checked, "mix", {column_a[i], column_b[i]}));
+  }
+
+  SECTION("Coroutines keep their narrow locals while suspended") {
+    auto co = vm.start(checked, "steps", {258});
+    REQUIRE(co);
+    CHECK(co->value() == 2);
+    CHECK(vm.execute(checked, "low", {77}) == 77);
+    CHECK(vm.resume(*co) == 3);
+  }
+}
+
+TEST_CASE("Narrow types are checked", "[narrow]") {
+  CHECK_FALSE(compile_runtime("int f(char c) { return c; }"));
+  CHECK_FALSE(compile_runtime("char f() { return 1; }"));
+
+  bytecode_builder b;
+  b.emit_const<type::i64>(1);
+  b.emit_save_local_i8(1);
+  b.emit_const<type::i64>(0);
+  b.emit_op(op_code::ret);
+  auto code = b.build();
+  function_entry entry{
+    .offset = 0,
+    .size = static_cast<std::uint32_t>(code.size()),
+    .param_count = 0,
+    .locals_count = 0,
+    .return_type = type::i64,
+    .narrow_size = 1
+  };
+  program p{std::move(code), {entry}, {{"f", {}, type::i64}}};
+  CHECK_FALSE(verify(p.view()));
+  runtime vm;
+  CHECK_FALSE(vm.execute(p, "f"));
+}
@@ -0,0 +1,220 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/fibers.hpp"
+#include "korka/vm/natives.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto profile_source = R"(
+  int fetch(int id);
+  void note(int value);
+  int clamp(int value);
+
+  int profile(int id) {
+    int score = fetch(id);
+    note(score);
+    return clamp(score + 1);
+  }
+  int plain(int x) { return x * 2; }
+)";
+
+namespace {
+  // Stand-in for a remote lookup, requests are answered whenever `serve` runs
+  struct lookup_service {
+    std::mutex mutex;
+    std::vector<std::pair<stack_value_t, native_call>> requests;
+
+    auto request(stack_value_t id, native_call done) -> void {
+      std::lock_guard lock{mutex};
+      requests.emplace_back(id, std::move(done));
+    }
+
+    auto serve() -> std::size_t {
+      std::vector<std::pair<stack_value_t, native_call>> batch;
+      {
+        std::lock_guard lock{mutex};
+        batch.swap(requests);
+      }
+      for (auto &[id, done]: batch) {
+        done.complete(id * 10);
+      }
+      return batch.size();
+    }
+  };
+
+  auto link(const program &p, lookup_service &service, std::vector<stack_value_t> &notes,
+            std::mutex &notes_mutex) -> linked<program> {
+    linked<program> app{p};
+    REQUIRE(app.bind_async("fetch", [&](std::span<const stack_value_t> args, native_call done) {
+      service.request(args[0], std::move(done));
+    }));
+    REQUIRE(app.bind("note", [&](std::span<const stack_value_t> args) -> stack_value_t {
+      std::lock_guard lock{notes_mutex};
+      notes.push_back(args[0]);
+      return 0;
+    }));
+    REQUIRE(app.bind("clamp", [](std::span<const stack_value_t> args) {
+      return std::min<stack_value_t>(args[0], 100);
+    }));
+    return app;
+  }
+}
+
+TEST_CASE("Scripts call host functions", "[natives]") {
+  auto p = compile_runtime(profile_source);
+  REQUIRE(p);
+  REQUIRE(p->find("fetch"));
+  CHECK(is_native(p->table()[*p->find("fetch")]));
+
+  lookup_service service;
+  std::vector<stack_value_t> notes;
+  std::mutex notes_mutex;
+  auto app = link(*p, service, notes, notes_mutex);
+
+  CHECK_FALSE(app.bind("plain", [](auto) { return stack_value_t{}; }));
+  CHECK_FALSE(app.bind("missing", [](auto) { return stack_value_t{}; }));
+
+  runtime vm;
+  CHECK(vm.execute(app, "plain", {4}) == 8);
+  CHECK_FALSE(vm.execute(app, "fetch", {4}));
+
+  SECTION("Unlinked programs and unbound natives fail") {
+    CHECK_FALSE(vm.execute(*p, "profile", {1}));
+    linked<program> partial{*p};
+    CHECK_FALSE(vm.execute(partial, "profile", {1}));
+  }
+
+  SECTION("Coroutines are suspended until the call completes") {
+    auto calls = vm.stats().native_calls;
+    auto co = vm.start(app, "profile", {4});
+    REQUIRE(co);
+    CHECK_FALSE(co->done());
+    CHECK(co->waiting());
+    CHECK_FALSE(co->ready());
+    CHECK_FALSE(vm.resume(*co));
+
+    bool woken = false;
+    co->on_ready([&] { woken = true; });
+    CHECK(service.serve() == 1);
+    CHECK(woken);
+    CHECK(co->ready());
+
+    CHECK(vm.resume(*co) == 41);
+    CHECK(co->done());
+    CHECK(notes == std::vector<stack_value_t>{40});
+    CHECK(vm.stats().native_calls - calls == 3);
+  }
+
+  SECTION("Natives that complete right away do not suspend") {
+    linked<program> eager{*p};
+    REQUIRE(eager.bind_async("fetch", [](auto args, native_call done) { done.complete(args[0] + 500); }));
+    REQUIRE(eager.bind("note", [](auto) { return stack_value_t{}; }));
+    REQUIRE(eager.bind("clamp", [](auto args) { return args[0]; }));
+
+    auto co = vm.start(eager, "profile", {1});
+    REQUIRE(co);
+    CHECK(co->done());
+    CHECK(co->value() == 502);
+
+    auto checked = verified<linked<program>>::make(eager);
+    REQUIRE(checked);
+    CHECK(vm.execute(*checked, "profile", {2}) == 503);
+  }
+
+  SECTION("Plain calls block until the call completes") {
+    std::atomic<bool> stop{};
+    std::thread server{[&] {
+      while (not stop) {
+        service.serve();
+        std::this_thread::yield();
+      }
+    }};
+    CHECK(vm.execute(app, "profile", {7}) == 71);
+
+    auto checked = verified<linked<program>>::make(app);
+    REQUIRE(checked);
+    CHECK(vm.execute(*checked, "profile", {20}) == 100);
+    stop = true;
+    server.join();
+  }
+}
+
+TEST_CASE("Fibers waiting on host calls free their thread", "[natives]") {
+  auto p = compile_runtime(profile_source);
+  REQUIRE(p);
+
+  lookup_service service;
+  std::vector<stack_value_t> notes;
+  std::mutex notes_mutex;
+  auto app = link(*p, service, notes, notes_mutex);
+
+  SECTION("A single worker keeps running other fibers") {
+    fiber_scheduler fibers{1};
+    std::atomic<stack_value_t> waiting{-1}, other{-1};
+    fibers.spawn(app, "profile", {3}, [&](runtime::result_t r) { waiting = r ? *r : -2; });
+    fibers.spawn(app, "plain", {5}, [&](runtime::result_t r) { other = r ? *r : -2; });
+
+    while (other == -1 || fibers.active() != 1) std::this_thread::yield();
+    CHECK(other == 10);
+    CHECK(waiting == -1);
+
+    while (service.serve() == 0) std::this_thread::yield();
+    while (waiting == -1) std::this_thread::yield();
+    CHECK(waiting == 31);
+  }
+
+  SECTION("Many sessions resume on whichever thread picks them up") {
+    constexpr stack_value_t sessions = 200;
+    fiber_scheduler fibers{3};
+    std::atomic<stack_value_t> total{}, finished{};
+    notes.clear();
+
+    std::atomic<bool> stop{};
+    std::thread server{[&] {
+      while (not stop) {
+        service.serve();
+        std::this_thread::yield();
+      }
+    }};
+
+    for (stack_value_t i = 0; i < sessions; ++i) {
+      fibers.spawn(app, "profile", {i % 10}, [&](runtime::result_t r) {
+        total += r ? *r : -1000;
+        ++finished;
+      });
+    }
+    while (finished != sessions) std::this_thread::yield();
+    stop = true;
+    server.join();
+
+    // fetch gives 10 * id, clamp leaves everything below 100 alone
+    CHECK(total == 20 * (0 + 10 + 20 + 30 + 40 + 50 + 60 + 70 + 80 + 90) + sessions);
+    CHECK(notes.size() == sessions);
+  }
+
+  SECTION("The host drives fibers and waits for completions") {
+    fiber_scheduler fibers;
+    std::vector<stack_value_t> results;
+    for (stack_value_t i = 1; i <= 3; ++i) {
+      fibers.spawn(app, "profile", {i}, [&](runtime::result_t r) { results.push_back(*r); });
+    }
+
+    CHECK(fibers.run() == 3);
+    CHECK(fibers.active() == 3);
+    CHECK(service.serve() == 3);
+    fibers.wait();
+    CHECK(fibers.run() == 3);
+    CHECK(fibers.active() == 0);
+    std::ranges::sort(results);
+    CHECK(results == std::vector<stack_value_t>{11, 21, 31});
+  }
+}
@@ -0,0 +1,103 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/vm_runtime.hpp"
+
+using namespace korka;
+
+static auto compile_ok(std::string_view code) -> program {
+  auto result = compile_runtime(code);
+  if (not result) {
+    FAIL(to_string(result.error()));
+  }
+  return std::move(result).value();
+}
+
+TEST_CASE("Runtime compiled program has a function table", "[runtime]") {
+  auto p = compile_ok(R"(
+    int main() { return 1; }
+    int foo(int a, int b) { return a + b; }
+  )");
+
+  REQUIRE(p.functions().size() == 2);
+  REQUIRE(p.find("main") == 0);
+  REQUIRE(p.find("foo") == 1);
+  CHECK_FALSE(p.find("bar"));
+
+  const auto &foo = p.functions()[1];
+  CHECK(foo.name == "foo");
+  CHECK(foo.params.size() == 2);
+  CHECK(foo.return_type == type::i64);
+  CHECK(p.table()[1].param_count == 2);
+  CHECK(p.table()[0].offset + p.table()[0].size == p.table()[1].offset);
+}
+
+TEST_CASE("Runtime executes arithmetic and branches", "[runtime]") {
+  auto p = compile_ok(R"(
+    int main() {
+      int a = 2;
+      if (a) {
+        return a;
+      } else {
+        return 5 + a;
+      }
+    }
+
+    int foo(int a, int b) {
+      return a - b * 2;
+    }
+
+    int pick(int c) {
+      if (c) return 10;
+      return 20;
+    }
+  )");
+
+  runtime vm;
+  CHECK(vm.execute(p, "main") == 2);
+  CHECK(vm.execute(p, "foo", {10, 3}) == 4);
+  CHECK(vm.execute(p, "pick", {1}) == 10);
+  CHECK(vm.execute(p, "pick", {0}) == 20);
+}
+
+TEST_CASE("Runtime calls script functions", "[runtime]") {
+  auto p = compile_ok(R"(
+    int add(int a, int b) { return a + b; }
+    int twice(int a) { return add(a, a); }
+    void nothing() { twice(1); return; }
+    int main() {
+      nothing();
+      return twice(add(1, 2)) * 10;
+    }
+  )");
+
+  runtime vm;
+  CHECK(vm.execute(p, "main") == 60);
+  CHECK(vm.execute(p, "nothing") == 0);
+}
+
+TEST_CASE("Runtime reports errors", "[runtime]") {
+  runtime vm;
+
+  SECTION("Unknown function") {
+    auto p = compile_ok("int main() { return 1; }");
+    CHECK_FALSE(vm.execute(p, "nope"));
+  }
+
+  SECTION("Division by zero") {
+    auto p = compile_ok("int div(int a, int b) { return a / b; }");
+    CHECK(vm.execute(p, "div", {9, 3}) == 3);
+    CHECK_FALSE(vm.execute(p, "div", {1, 0}));
+  }
+
+  SECTION("Runaway recursion") {
+    auto p = compile_ok("int f(int a) { return f(a); }");
+    CHECK_FALSE(vm.execute(p, "f", {1}));
+  }
+
+  SECTION("Compile errors") {
+    CHECK_FALSE(compile_runtime("int main() { return x; }"));
+    CHECK_FALSE(compile_runtime("int main() { return foo(); }"));
+    CHECK_FALSE(compile_runtime("int f(int a) { return a; } int main() { return f(); }"));
+    CHECK_FALSE(compile_runtime("int f() { return 1; } int f() { return 2; }"));
+  }
+}
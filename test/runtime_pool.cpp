@@ -0,0 +1,68 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/runtime_pool.hpp"
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace korka;
+
+TEST_CASE("Leases hand out distinct runtimes and return them", "[runtime_pool]") {
+  runtime_pool pool{2};
+
+  runtime *first{}, *second{};
+  {
+    auto a = pool.acquire();
+    auto b = pool.acquire();
+    first = &*a;
+    second = &*b;
+    CHECK(first != second);
+
+    auto c = pool.acquire();
+    CHECK(&*c != first);
+    CHECK(&*c != second);
+    CHECK(pool.overflows() == 1);
+  }
+
+  auto again = pool.acquire();
+  CHECK((&*again == first || &*again == second));
+}
+
+TEST_CASE("Threads share one program through pooled runtimes", "[runtime_pool]") {
+  auto p = compile_runtime(R"(
+    int twice(int x) { return x * 2; }
+    int score(int a, int b) { return twice(a) - b; }
+  )");
+  REQUIRE(p);
+  const auto &shared = *p;
+
+  runtime_pool pool{4};
+  std::atomic<int> bad{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 500; ++i) {
+        auto vm = pool.acquire();
+        if (vm->execute(shared, "score", {i, t}) != 2 * i - t) ++bad;
+      }
+    });
+  }
+  for (auto &th: threads) th.join();
+  CHECK(bad == 0);
+
+  std::uint64_t invocations{}, calls{};
+  std::vector<runtime_pool::lease> all;
+  for (std::size_t i = 0; i < pool.capacity(); ++i) {
+    all.push_back(pool.acquire());
+    invocations += all.back()->stats().invocations;
+    calls += all.back()->stats().calls;
+  }
+  std::set<runtime *> distinct;
+  for (auto &l: all) distinct.insert(&*l);
+  CHECK(distinct.size() == pool.capacity());
+
+  // Overflow runtimes are dropped with their counters
+  CHECK(invocations <= 8 * 500);
+  CHECK(invocations == calls);
+}
@@ -0,0 +1,101 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/script_cache.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+using namespace korka;
+
+static auto fresh_cache_dir(std::string_view name) -> std::filesystem::path {
+  auto dir = std::filesystem::temp_directory_path() / name;
+  std::filesystem::remove_all(dir);
+  return dir;
+}
+
+TEST_CASE("Script cache compiles on a miss and maps on a hit", "[script_cache]") {
+  auto dir = fresh_cache_dir("korka_test_cache");
+  constexpr std::string_view source = "int main() { return 7; }";
+
+  script_cache cache{dir};
+  runtime vm;
+
+  auto first = cache.load(source);
+  REQUIRE(first);
+  CHECK(cache.misses() == 1);
+  CHECK(vm.execute(*first, "main") == 7);
+  CHECK(std::filesystem::exists(cache.entry_path(source)));
+
+  auto second = cache.load(source);
+  REQUIRE(second);
+  CHECK(cache.hits() == 1);
+  CHECK(vm.execute(*second, "main") == 7);
+
+  // Different source, different entry
+  CHECK(cache.entry_path(source) != cache.entry_path("int main() { return 8; }"));
+
+  SECTION("Damaged entries are recompiled") {
+    std::filesystem::resize_file(cache.entry_path(source), 10);
+    auto third = cache.load(source);
+    REQUIRE(third);
+    CHECK(vm.execute(*third, "main") == 7);
+  }
+
+  SECTION("Entries that fail verification are recompiled") {
+    // A well formed image whose function compares two numbers as strings
+    vm::bytecode_builder b;
+    b.emit_const<type::i64>(4096);
+    b.emit_const<type::i64>(4096);
+    b.emit_op(vm::op_code::str_eq);
+    b.emit_op(vm::op_code::ret);
+    auto code = b.build();
+    vm::function_entry entry{.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 0,
+                             .locals_count = 0, .return_type = type::i64};
+    program forged{code, {entry}, {{"main", {}, type::i64}}, b.constants()};
+    REQUIRE(vm::save_image(forged, cache.entry_path(source)));
+
+    auto misses = cache.misses();
+    auto third = cache.load(source);
+    REQUIRE(third);
+    CHECK(cache.misses() == misses + 1);
+    CHECK(vm.execute(*third, "main") == 7);
+  }
+
+  SECTION("Compile errors are not cached") {
+    CHECK_FALSE(cache.load("int main() { return x; }"));
+    CHECK_FALSE(std::filesystem::exists(cache.entry_path("int main() { return x; }")));
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Script cache survives concurrent writers", "[script_cache]") {
+  auto dir = fresh_cache_dir("korka_test_cache_concurrent");
+  constexpr std::string_view source = "int twice(int a) { return a * 2; }";
+
+  std::vector<std::thread> threads;
+  std::atomic<int> ok{};
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&] {
+      script_cache cache{dir};
+      runtime vm;
+      for (int j = 0; j < 20; ++j) {
+        auto image = cache.load(source);
+        if (image && vm.execute(*image, "twice", {21}) == 42) {
+          ok.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto &t: threads) t.join();
+
+  CHECK(ok == 8 * 20);
+
+  // No temporaries are left behind
+  std::size_t files{};
+  for ([[maybe_unused]] auto &entry: std::filesystem::directory_iterator{dir}) ++files;
+  CHECK(files == 1);
+
+  std::filesystem::remove_all(dir);
+}
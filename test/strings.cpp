@@ -0,0 +1,241 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/embed.hpp"
+#include "korka/vm/image.hpp"
+#include "korka/vm/live_program.hpp"
+#include "korka/vm/natives.hpp"
+#include "korka/vm/strings.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <array>
+#include <string>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static constexpr auto strings_source = R"(
+  string greeting() { return "hello"; }
+  string pick(int i) {
+    if (i == 1) {
+      return "one";
+    }
+    if (i == 2) {
+      return "two";
+    }
+    return "hello";
+  }
+  int is_hello(string s) { return s == "hello"; }
+  int same(string a, string b) { return a == b; }
+  int differ(string a, string b) { return a != b; }
+  int empty(string s) {
+    string nothing;
+    return s == nothing;
+  }
+  int round_trip(int i) { return is_hello(pick(i)); }
+)";
+
+TEST_CASE("String literals are pooled once per text", "[strings]") {
+  auto p = compile_runtime(strings_source);
+  REQUIRE(p);
+
+  // "hello", "one", "two" and the empty string of `nothing`
+  std::size_t records{};
+  for (std::size_t offset = 0; offset < p->strings().size(); ++records) {
+    offset += string_header_size + as_string(string_at(p->strings(), static_cast<stack_value_t>(offset))).size() + 1;
+  }
+  CHECK(records == 4);
+
+  runtime vm;
+  auto hello = vm.execute(*p, "greeting");
+  REQUIRE(hello);
+  CHECK(as_string(*hello) == "hello");
+  // Every "hello" in the script is the same record
+  CHECK(vm.execute(*p, "pick", {0}) == *hello);
+  CHECK(as_string(*vm.execute(*p, "pick", {2})) == "two");
+
+  CHECK(vm.execute(*p, "round_trip", {0}) == 1);
+  CHECK(vm.execute(*p, "round_trip", {1}) == 0);
+  CHECK(vm.execute(*p, "same", {*hello, *vm.execute(*p, "pick", {3})}) == 1);
+  CHECK(vm.execute(*p, "differ", {*hello, *vm.execute(*p, "pick", {1})}) == 1);
+}
+
+TEST_CASE("Host strings are compared by their text", "[strings]") {
+  auto p = compile_runtime(strings_source);
+  REQUIRE(p);
+
+  runtime vm;
+  host_string hello{"hello"}, other{"hello!"}, empty{""};
+  CHECK(hello.view() == "hello");
+  CHECK(vm.execute(*p, "is_hello", {string_arg(hello)}) == 1);
+  CHECK(vm.execute(*p, "is_hello", {string_arg(other)}) == 0);
+  CHECK(vm.execute(*p, "empty", {string_arg(empty)}) == 1);
+  CHECK(vm.execute(*p, "empty", {string_arg(hello)}) == 0);
+  CHECK(vm.execute(*p, "same", {string_arg(hello), *vm.execute(*p, "greeting")}) == 1);
+  CHECK_FALSE(vm.execute(*p, "is_hello", {0}));
+
+  SECTION("Natives get views into the pool") {
+    auto with_native = compile_runtime(R"(
+      int length(string s);
+      int name_length() { return length("korka"); }
+    )");
+    REQUIRE(with_native);
+    const auto &pool = with_native->strings();
+    linked<program> app{std::move(*with_native)};
+
+    bool in_pool{};
+    REQUIRE(app.bind("length", [&](std::span<const stack_value_t> args) {
+      auto text = as_string(args[0]);
+      in_pool = reinterpret_cast<const std::byte *>(text.data()) >= pool.data()
+                && reinterpret_cast<const std::byte *>(text.data()) < pool.data() + pool.size();
+      return static_cast<stack_value_t>(text.size());
+    }));
+    CHECK(vm.execute(app, "name_length") == 5);
+    CHECK(in_pool);
+  }
+}
+
+TEST_CASE("Every loop agrees on strings", "[strings]") {
+  auto p = compile_runtime(strings_source);
+  REQUIRE(p);
+  auto words = compile_runtime(strings_source, {.encoding = instruction_encoding::words});
+  REQUIRE(words);
+
+  auto checked = *p;
+  auto v = verified<program>::make(std::move(*p));
+  auto vw = verified<program>::make(std::move(*words));
+  REQUIRE(v);
+  REQUIRE(vw);
+
+  runtime vm;
+  for (stack_value_t i: {0, 1, 2, 3}) {
+    auto expected = vm.execute(checked, "round_trip", {i});
+    REQUIRE(expected);
+    CHECK(vm.execute(*v, "round_trip", {i}) == *expected);
+    CHECK(vm.execute(*vw, "round_trip", {i}) == *expected);
+
+    std::array<stack_value_t, 1> args{i};
+    CHECK(run_embed<embed_bounds{8, 8, 4}>(v->view(), *v->find("round_trip"), args) == *expected);
+    CHECK(as_string(*vm.execute(*vw, "pick", {i})) == as_string(*vm.execute(checked, "pick", {i})));
+  }
+
+  host_string empty{""};
+  CHECK(vm.execute(*vw, "empty", {string_arg(empty)}) == 1);
+  CHECK_FALSE(vm.execute(*v, "is_hello", {0}));
+  std::array<stack_value_t, 1> missing{0};
+  CHECK_FALSE(run_embed<embed_bounds{8, 8, 4}>(v->view(), *v->find("is_hello"), missing));
+
+  // Falling off the end of a string function returns the empty string
+  auto fall = compile_runtime(R"(string f(int i) { if (i) { return "a"; } })");
+  REQUIRE(fall);
+  auto vf = verified<program>::make(std::move(*fall));
+  REQUIRE(vf);
+  CHECK(as_string(*vm.execute(*vf, "f", {0})).empty());
+  CHECK(as_string(*vm.execute(*vf, "f", {1})) == "a");
+
+  // Rows with strings leave the lanes for the scalar loop
+  std::vector<stack_value_t> column{0, 1, 2, 0}, results(4);
+  std::array<runtime::column_t, 1> columns{column};
+  REQUIRE(vm.execute_batch<4>(*v, "round_trip", columns, results));
+  CHECK(results == std::vector<stack_value_t>{1, 0, 0, 1});
+}
+
+TEST_CASE("Strings travel with images and replacements", "[strings]") {
+  auto p = compile_runtime(strings_source);
+  REQUIRE(p);
+
+  auto bytes = write_image(*p);
+  auto image = image_view::from_bytes(bytes);
+  REQUIRE(image);
+  auto v = verified<image_view>::make(*image);
+  REQUIRE(v);
+
+  runtime vm;
+  CHECK(as_string(*vm.execute(*v, "pick", {1})) == "one");
+  CHECK(vm.execute(*v, "round_trip", {0}) == 1);
+
+  // The replacement pools its strings into the program it lands in
+  live_program live{std::move(*p)};
+  auto patch = compile_runtime(R"(
+    string pick(int i) {
+      if (i == 1) {
+        return "uno";
+      }
+      return "hello";
+    }
+  )");
+  REQUIRE(patch);
+  REQUIRE(live.replace_function("pick", *patch));
+  CHECK(as_string(*vm.execute(live.acquire(), "pick", {1})) == "uno");
+  CHECK(vm.execute(live.acquire(), "round_trip", {0}) == 1);
+  CHECK(*vm.execute(live.acquire(), "pick", {0}) == *vm.execute(live.acquire(), "greeting"));
+}
+
+TEST_CASE("String types are checked", "[strings]") {
+  CHECK_FALSE(compile_runtime(R"(int f(string s) { return s + "x"; })"));
+  CHECK_FALSE(compile_runtime(R"(int f(string s) { return s < "x"; })"));
+  CHECK_FALSE(compile_runtime(R"(int f(string s) { return s == 1; })"));
+  CHECK_FALSE(compile_runtime(R"(int f(string s) { if (s) { return 1; } return 0; })"));
+  CHECK_FALSE(compile_runtime(R"(int f() { int x = "x"; return x; })"));
+  CHECK_FALSE(compile_runtime(R"(string f() { return 1; })"));
+
+  // Pooling is per text, tampering with the offset is caught before anything runs
+  auto p = compile_runtime(R"(string f() { return "x"; })");
+  REQUIRE(p);
+  std::vector<stack_value_t> constants{static_cast<stack_value_t>(p->strings().size())};
+  program broken{
+    {p->code().begin(), p->code().end()},
+    {p->table().begin(), p->table().end()},
+    {p->functions().begin(), p->functions().end()},
+    constants,
+    p->encoding(),
+    {p->strings().begin(), p->strings().end()}
+  };
+  CHECK_FALSE(verify(broken.view()));
+  runtime vm;
+  CHECK_FALSE(vm.execute(broken, "f"));
+
+  // Only strings reach the string ops and string returns
+  bytecode_builder b;
+  b.emit_const<type::i64>(0);
+  b.emit_const<type::i64>(0);
+  b.emit_op(op_code::str_eq);
+  b.emit_op(op_code::ret);
+  auto code = b.build();
+  function_entry entry{.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 0, .locals_count = 0,
+                       .return_type = type::i64};
+  program forged{code, {entry}, {{"f", {}, type::i64}}};
+  CHECK_FALSE(verify(forged.view()));
+
+  bytecode_builder r;
+  r.emit_const<type::i64>(4096);
+  r.emit_op(op_code::ret);
+  code = r.build();
+  entry = {.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 0, .locals_count = 0,
+           .return_type = type::str};
+  program number{code, {entry}, {{"f", {}, type::str}}};
+  CHECK_FALSE(verify(number.view()));
+
+  // The checked loop only compares pool records and strings the host handed in
+  bytecode_builder n;
+  n.emit_const<type::i64>(4096);
+  n.emit_const<type::i64>(4096);
+  n.emit_op(op_code::str_eq);
+  n.emit_op(op_code::ret);
+  code = n.build();
+  entry = {.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 0, .locals_count = 0,
+           .return_type = type::i64};
+  program made_up{code, {entry}, {{"f", {}, type::i64}}, n.constants()};
+  CHECK_FALSE(vm.execute(made_up, "f"));
+
+  auto with_native = compile_runtime(R"(
+    string name();
+    int is_korka() { return name() == "korka"; }
+  )");
+  REQUIRE(with_native);
+  linked<program> app{std::move(*with_native)};
+  host_string korka{"korka"};
+  REQUIRE(app.bind("name", [&](std::span<const stack_value_t>) { return string_arg(korka); }));
+  CHECK(vm.execute(app, "is_korka") == 1);
+}
@@ -0,0 +1,235 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/embed.hpp"
+#include "korka/vm/f64.hpp"
+#include "korka/vm/live_program.hpp"
+#include "korka/vm/natives.hpp"
+#include "korka/vm/structs.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+namespace {
+  struct order {
+    std::int64_t id;
+    char side;
+    double price;
+    std::int64_t quantity;
+  };
+
+  auto order_layout() -> struct_layout {
+    return layout_of<order>("order", {
+      field("id", &order::id),
+      field("side", &order::side),
+      field("price", &order::price),
+      field("quantity", &order::quantity),
+    });
+  }
+}
+
+static constexpr auto structs_source = R"(
+  struct order {
+    int id;
+    char side;
+    double price;
+    int quantity;
+  };
+  double notional(order o) { return o.price * o.quantity; }
+  int fill(order o, int n) {
+    if (n > o.quantity) {
+      n = o.quantity;
+    }
+    o.quantity = o.quantity - n;
+    return n;
+  }
+  void flip(order o) { o.side = 0 - o.side; }
+  void reprice(order o, int ticks) { o.price = o.price + ticks * 0.25; }
+  int remaining(order o) { return fill(o, 0) + o.quantity; }
+)";
+
+TEST_CASE("Script structs are laid out like C++ structs", "[structs]") {
+  struct_layout layout{.name = "order"};
+  append_field(layout, "id", type::i64);
+  append_field(layout, "side", type::i8);
+  append_field(layout, "price", type::f64);
+  append_field(layout, "quantity", type::i64);
+  finish_layout(layout);
+
+  auto host = order_layout();
+  CHECK(layout.size == host.size);
+  CHECK(layout.alignment == host.alignment);
+  CHECK(layout.fields == host.fields);
+  CHECK(host.find("price")->offset == offsetof(order, price));
+}
+
+TEST_CASE("Scripts read and write host objects in place", "[structs]") {
+  auto layout = order_layout();
+  auto p = compile_runtime(structs_source, {.structs = std::span{&layout, 1}});
+  REQUIRE(p);
+
+  runtime vm;
+  order o{.id = 7, .side = 1, .price = 10.5, .quantity = 4};
+  CHECK(as_f64(*vm.execute(*p, "notional", {object_arg(o)})) == 42.0);
+  CHECK(vm.execute(*p, "fill", {object_arg(o), 3}) == 3);
+  CHECK(o.quantity == 1);
+  CHECK(vm.execute(*p, "fill", {object_arg(o), 3}) == 1);
+  CHECK(o.quantity == 0);
+  CHECK(vm.execute(*p, "flip", {object_arg(o)}));
+  CHECK(o.side == -1);
+  CHECK(vm.execute(*p, "reprice", {object_arg(o), 2}));
+  CHECK(o.price == 11.0);
+  CHECK(o.id == 7);
+  CHECK_FALSE(vm.execute(*p, "notional", {0}));
+
+  SECTION("Registered structs need no declaration in the script") {
+    auto partial = layout_of<order>("order", {field("price", &order::price)});
+    auto q = compile_runtime("double price(order o) { return o.price; }", {.structs = std::span{&partial, 1}});
+    REQUIRE(q);
+    CHECK(as_f64(*vm.execute(*q, "price", {object_arg(o)})) == 11.0);
+    CHECK_FALSE(compile_runtime("int id(order o) { return o.id; }", {.structs = std::span{&partial, 1}}));
+  }
+
+  SECTION("Natives get the objects the script got") {
+    auto with_native = compile_runtime(R"(
+      struct order { int id; char side; double price; int quantity; };
+      void cancel(order o);
+      int cancel_and_count(order o) { cancel(o); return o.quantity; }
+    )");
+    REQUIRE(with_native);
+    linked<program> app{std::move(*with_native)};
+    REQUIRE(app.bind("cancel", [](std::span<const stack_value_t> args) {
+      field_store(args[0], offsetof(order, quantity), 0);
+      return stack_value_t{};
+    }));
+    o.quantity = 9;
+    CHECK(vm.execute(app, "cancel_and_count", {object_arg(o)}) == 0);
+  }
+}
+
+TEST_CASE("Every loop agrees on structs", "[structs]") {
+  auto p = compile_runtime(structs_source);
+  REQUIRE(p);
+  auto words = compile_runtime(structs_source, {.encoding = instruction_encoding::words});
+  REQUIRE(words);
+
+  auto checked = *p;
+  auto v = verified<program>::make(std::move(*p));
+  auto vw = verified<program>::make(std::move(*words));
+  REQUIRE(v);
+  REQUIRE(vw);
+
+  runtime vm;
+  for (std::int64_t n: {0, 2, 5}) {
+    order a{.id = 1, .side = 1, .price = 2.0, .quantity = 4}, b = a, c = a, d = a;
+    auto expected = vm.execute(checked, "fill", {object_arg(a), n});
+    REQUIRE(expected);
+    CHECK(vm.execute(*v, "fill", {object_arg(b), n}) == *expected);
+    CHECK(vm.execute(*vw, "fill", {object_arg(c), n}) == *expected);
+
+    std::array<stack_value_t, 2> args{object_arg(d), n};
+    CHECK(run_embed<embed_bounds{8, 8, 4}>(v->view(), *v->find("fill"), args) == *expected);
+    CHECK((b.quantity == a.quantity && c.quantity == a.quantity && d.quantity == a.quantity));
+  }
+
+  order o{.id = 1, .side = 5, .price = 2.0, .quantity = 4};
+  CHECK(vm.execute(*vw, "flip", {object_arg(o)}));
+  CHECK(o.side == -5);
+  CHECK(vm.execute(*v, "remaining", {object_arg(o)}) == 4);
+  CHECK_FALSE(vm.execute(*v, "fill", {0, 1}));
+  std::array<stack_value_t, 2> missing{0, 1};
+  CHECK_FALSE(run_embed<embed_bounds{8, 8, 4}>(v->view(), *v->find("fill"), missing));
+
+  // Rows with objects leave the lanes for the scalar loop
+  order other{.id = 2, .side = 1, .price = 1.0, .quantity = 1};
+  std::vector<stack_value_t> column{object_arg(o), object_arg(other)}, results(2);
+  std::array<runtime::column_t, 1> columns{column};
+  REQUIRE(vm.execute_batch<4>(*v, "remaining", columns, results));
+  CHECK(results == std::vector<stack_value_t>{4, 1});
+}
+
+TEST_CASE("Struct types are checked", "[structs]") {
+  auto layout = order_layout();
+  auto with_layout = [&](std::string_view source) {
+    return compile_runtime(source, {.structs = std::span{&layout, 1}});
+  };
+
+  // Declarations of a registered struct have to match it
+  CHECK_FALSE(with_layout("struct order { int id; double price; char side; int quantity; };"));
+  CHECK_FALSE(with_layout("struct order { int id; char side; double price; };"));
+  CHECK_FALSE(with_layout("struct order { int id; char side; double price; int qty; };"));
+  CHECK(with_layout("struct order { int id; char side; double price; int quantity; };"));
+
+  CHECK_FALSE(compile_runtime("struct s { string name; };"));
+  CHECK_FALSE(compile_runtime("struct s { int a; int a; };"));
+  CHECK_FALSE(compile_runtime("struct s { int a; }; struct s { int a; };"));
+  CHECK_FALSE(compile_runtime("struct s { };"));
+  CHECK_FALSE(compile_runtime("struct s { int a; }; s f(s x) { return x; }"));
+  CHECK_FALSE(compile_runtime("struct s { int a; }; int f(s x) { return x.b; }"));
+  CHECK_FALSE(compile_runtime("struct s { int a; }; int f(int x) { return x.a; }"));
+  CHECK_FALSE(compile_runtime("struct s { int a; }; int f(s x, s y) { x = y; return 0; }"));
+  CHECK_FALSE(compile_runtime("struct s { int a; }; int f(s x) { return x + 1; }"));
+  CHECK_FALSE(compile_runtime("struct s { int a; }; struct t { int a; }; int g(t y) { return y.a; } int f(s x) { return g(x); }"));
+  CHECK(compile_runtime("struct s { double d; }; double f(s x, int i) { x.d = i; return x.d + 1; }"));
+}
+
+TEST_CASE("Field ops stay inside the objects passed in", "[structs]") {
+  auto object_function = [](field_offset_t offset, bool narrow) {
+    bytecode_builder b;
+    b.emit_param_load(1);
+    b.emit_load_local(0);
+    b.emit_field_load(offset, narrow);
+    b.emit_op(op_code::ret);
+    auto code = b.build();
+    function_entry entry{.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 1,
+                         .locals_count = 1, .return_type = type::i64};
+    return program{std::move(code), {entry}, {{"f", {type::object}, type::i64}}, {}, instruction_encoding::bytes,
+                   {}, {{.type = type::object, .object_size = 16}}};
+  };
+  CHECK(verify(object_function(8, false).view()));
+  CHECK(verify(object_function(15, true).view()));
+  CHECK_FALSE(verify(object_function(9, false).view()));
+  CHECK_FALSE(verify(object_function(16, true).view()));
+
+  // The checked loop holds fields to the objects the host passed in as well
+  order o{.id = 7, .side = 1, .price = 2.0, .quantity = 4};
+  runtime vm;
+  CHECK(vm.execute(object_function(0, false), "f", {object_arg(o)}) == 7);
+  CHECK(vm.execute(object_function(8, true), "f", {object_arg(o)}) == 1);
+  CHECK_FALSE(vm.execute(object_function(16, true), "f", {object_arg(o)}));
+
+  // A number is no object
+  bytecode_builder b;
+  b.emit_const<type::i64>(4096);
+  b.emit_field_load(0, false);
+  b.emit_op(op_code::ret);
+  auto code = b.build();
+  function_entry entry{.offset = 0, .size = static_cast<std::uint32_t>(code.size()), .param_count = 0, .locals_count = 0,
+                       .return_type = type::i64};
+  program forged{code, {entry}, {{"f", {}, type::i64}}, b.constants()};
+  CHECK_FALSE(verify(forged.view()));
+  CHECK_FALSE(vm.execute(forged, "f"));
+
+  // Nor is an object of a smaller struct, passed on or swapped in
+  auto p = compile_runtime(R"(
+    struct big { int a; int b; };
+    int second(big x) { return x.b; }
+    int first(big x) { return x.a; }
+  )");
+  REQUIRE(p);
+  auto small = compile_runtime(R"(
+    struct big { int a; };
+    int second(big x) { return 0; }
+    int first(big x) { return second(x); }
+  )");
+  REQUIRE(small);
+  live_program live{std::move(*p)};
+  CHECK_FALSE(live.replace_function("first", *small));
+}
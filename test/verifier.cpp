@@ -0,0 +1,321 @@
+#include <catch2/catch_test_macros.hpp>
+#include "korka/compiler/compile_runtime.hpp"
+#include "korka/vm/arrays.hpp"
+#include "korka/vm/bytecode_builder.hpp"
+#include "korka/vm/verifier.hpp"
+#include "korka/vm/vm_runtime.hpp"
+#include <atomic>
+#include <bit>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace korka;
+using namespace korka::vm;
+
+static auto typed_function(bytecode_builder &b, std::vector<type> params, std::uint16_t locals,
+                           type return_type = type::i64) -> program {
+  auto code = b.build();
+  function_entry entry{
+    .offset = 0,
+    .size = static_cast<std::uint32_t>(code.size()),
+    .param_count = static_cast<std::uint16_t>(params.size()),
+    .locals_count = locals,
+    .return_type = return_type
+  };
+  return {std::move(code), {entry}, {{"f", std::move(params), return_type}}};
+}
+
+static auto single_function(bytecode_builder &b, std::uint16_t params, std::uint16_t locals,
+                            type return_type = type::i64) -> program {
+  return typed_function(b, std::vector<type>(params, type::i64), locals, return_type);
+}
+
+TEST_CASE("Compiled programs pass verification", "[verifier]") {
+  auto p = compile_runtime(R"(
+    int twice(int x) { return x * 2; }
+    void nothing() { }
+    int main(int a, int b) {
+      int c = twice(a) - b;
+      nothing();
+      if (c) { return c / 2; }
+      return 0;
+    }
+  )");
+  REQUIRE(p);
+
+  auto facts = verify(p->view());
+  REQUIRE(facts);
+  REQUIRE(facts->size() == 3);
+  CHECK((*facts)[0].max_stack == 2);
+
+  auto checked = *p;
+  auto v = verified<program>::make(std::move(*p));
+  REQUIRE(v);
+
+  runtime vm;
+  CHECK(vm.execute(*v, "main", {10, 4}) == 8);
+  CHECK(vm.execute(*v, "main", {2, 4}) == 0);
+  CHECK(*vm.execute(*v, "main", {7, 1}) == *vm.execute(checked, "main", {7, 1}));
+  CHECK_FALSE(vm.execute(*v, "main", {1}));
+}
+
+TEST_CASE("The verified loop agrees with the checked one", "[verifier]") {
+  auto source = R"(
+    void nothing(int x) { }
+    int none() { return 7; }
+    int pick(int a, int b, int c) { return a - b * c; }
+    int deep(int a, int b) {
+      nothing(a);
+      int c = (a + (b - (a * (b + (a - 3))))) / (1 + b * b);
+      int d = pick(a, pick(b, c, none()), a - pick(c, a, b)) - none();
+      if (d - c) { return d * (c - pick(1, 2, none())); }
+      return c;
+    }
+  )";
+  auto p = compile_runtime(source);
+  REQUIRE(p);
+  auto words = compile_runtime(source, {.encoding = instruction_encoding::words});
+  REQUIRE(words);
+  auto checked = *p;
+  auto v = verified<program>::make(std::move(*p));
+  auto vw = verified<program>::make(std::move(*words));
+  REQUIRE(v);
+  REQUIRE(vw);
+
+  runtime vm;
+  for (stack_value_t a: {-5, 0, 1, 3, 1000}) {
+    for (stack_value_t b: {-2, 0, 7}) {
+      auto expected = vm.execute(checked, "deep", {a, b});
+      REQUIRE(expected);
+      CHECK(vm.execute(*v, "deep", {a, b}) == *expected);
+      CHECK(vm.execute(*vw, "deep", {a, b}) == *expected);
+    }
+  }
+  CHECK(vm.execute(*v, "none") == 7);
+}
+
+TEST_CASE("Arguments are taken in place or as operands", "[verifier]") {
+  auto p = compile_runtime("int add(int a, int b) { return a + b; }");
+  REQUIRE(p);
+  auto facts = verify(p->view());
+  REQUIRE(facts);
+  CHECK((*facts)[0].body_offset > 0);
+
+  // No pload, the arguments are the first operands
+  bytecode_builder b;
+  b.emit_op(op_code::i64_add);
+  b.emit_save_local(2);
+  b.emit_load_local(2);
+  b.emit_load_local(2);
+  b.emit_op(op_code::i64_mul);
+  b.emit_op(op_code::ret);
+  auto raw = single_function(b, 2, 3);
+  auto raw_facts = verify(raw.view());
+  REQUIRE(raw_facts);
+  CHECK((*raw_facts)[0].body_offset == 0);
+
+  auto checked = raw;
+  auto v = verified<program>::make(std::move(raw));
+  REQUIRE(v);
+  runtime vm;
+  CHECK(vm.execute(checked, "f", {3, 4}) == 49);
+  CHECK(vm.execute(*v, "f", {3, 4}) == 49);
+}
+
+TEST_CASE("Verified programs still trap on runtime errors", "[verifier]") {
+  auto p = compile_runtime(R"(
+    int div(int a, int b) { return a / b; }
+    int forever(int n) { return forever(n + 1); }
+  )");
+  REQUIRE(p);
+  auto v = verified<program>::make(std::move(*p));
+  REQUIRE(v);
+
+  runtime vm;
+  CHECK_FALSE(vm.execute(*v, "div", {1, 0}));
+  CHECK_FALSE(vm.execute(*v, "forever", {0}));
+  CHECK(vm.execute(*v, "div", {9, 3}) == 3);
+}
+
+TEST_CASE("Malformed bytecode is rejected", "[verifier]") {
+  SECTION("local out of range") {
+    bytecode_builder b;
+    b.emit_load_local(3);
+    b.emit_op(op_code::ret);
+    CHECK_FALSE(verify(single_function(b, 0, 1).view()));
+  }
+
+  SECTION("stack underflow") {
+    bytecode_builder b;
+    b.emit_const<type::i64>(1);
+    b.emit_op(op_code::i64_add);
+    b.emit_op(op_code::ret);
+    CHECK_FALSE(verify(single_function(b, 0, 0).view()));
+  }
+
+  SECTION("paths with different depths") {
+    bytecode_builder b;
+    auto join = b.make_label();
+    b.emit_load_local(0);
+    b.emit_const<type::i64>(1);
+    b.emit_op(op_code::pop);
+    b.emit_jmp_if_zero(join);
+    b.emit_const<type::i64>(2);
+    b.bind_label(join);
+    b.emit_const<type::i64>(3);
+    b.emit_op(op_code::ret);
+    CHECK_FALSE(verify(single_function(b, 0, 1).view()));
+  }
+
+  SECTION("falling off the end") {
+    bytecode_builder b;
+    b.emit_const<type::i64>(1);
+    CHECK_FALSE(verify(single_function(b, 0, 0).view()));
+  }
+
+  SECTION("wrong return kind") {
+    bytecode_builder b;
+    b.emit_op(op_code::ret_void);
+    CHECK_FALSE(verify(single_function(b, 0, 0, type::i64).view()));
+    CHECK(verify(single_function(b, 0, 0, type::void_).view()));
+  }
+
+  SECTION("jump into an instruction") {
+    auto op = [](op_code c) { return static_cast<std::byte>(c); };
+    std::vector<std::byte> code{
+      op(op_code::i64_const_i16), std::byte{0xe8}, std::byte{0x03},
+      op(op_code::pop),
+      op(op_code::jmp_s), std::bit_cast<std::byte>(std::int8_t{-3})
+    };
+    function_entry entry{.offset = 0, .size = 6, .param_count = 0, .locals_count = 0, .return_type = type::void_};
+    program p{std::move(code), {entry}, {{"f", {}, type::void_}}};
+    CHECK_FALSE(verify(p.view()));
+  }
+}
+
+TEST_CASE("Array ops only reach arrays the caller passed", "[verifier]") {
+  SECTION("a number used as an array") {
+    bytecode_builder b;
+    b.emit_const<type::i64>(4096);
+    b.emit_save_local(0);
+    b.emit_const<type::i64>(0);
+    b.emit_array_load(0, false);
+    b.emit_op(op_code::ret);
+    CHECK_FALSE(verify(single_function(b, 0, 1).view()));
+  }
+
+  SECTION("an overwritten array parameter") {
+    bytecode_builder b;
+    b.emit_param_load(1);
+    b.emit_const<type::i64>(4096);
+    b.emit_save_local(0);
+    b.emit_array_size(0);
+    b.emit_op(op_code::ret);
+    CHECK_FALSE(verify(typed_function(b, {type::i64_array}, 1).view()));
+  }
+
+  SECTION("an array that is one only on some paths") {
+    bytecode_builder b;
+    auto join = b.make_label();
+    b.emit_param_load(2);
+    b.emit_load_local(0);
+    b.emit_save_local(2);
+    b.emit_load_local(1);
+    b.emit_jmp_if_zero(join);
+    b.emit_load_local(1);
+    b.emit_save_local(2);
+    b.bind_label(join);
+    b.emit_array_size(2);
+    b.emit_op(op_code::ret);
+    CHECK_FALSE(verify(typed_function(b, {type::i64_array, type::i64}, 3).view()));
+  }
+
+  SECTION("an array of the wrong type passed on") {
+    auto p = compile_runtime(R"(
+      int first(int xs[]) { return xs[0]; }
+      int twice(int xs[]) { return first(xs) * 2; }
+    )");
+    REQUIRE(p);
+    // `twice` claims to take doubles and hands them to `first`
+    std::vector<param_entry> params{p->params().begin(), p->params().end()};
+    params[p->table()[*p->find("twice")].params].type = type::f64_array;
+    program forged{{p->code().begin(), p->code().end()}, {p->table().begin(), p->table().end()},
+                   {p->functions().begin(), p->functions().end()}, {p->constants().begin(), p->constants().end()},
+                   p->encoding(), {}, std::move(params)};
+    CHECK(verify(p->view()));
+    CHECK_FALSE(verify(forged.view()));
+  }
+}
+
+TEST_CASE("Unchecked array ops are checked outside of compiled programs", "[verifier]") {
+  bytecode_builder b;
+  b.emit_param_load(2);
+  b.emit_load_local(1);
+  b.emit_array_load(0, false);
+  b.emit_op(op_code::ret);
+  auto v = verified<program>::make(typed_function(b, {type::i64_array, type::i64}, 2));
+  REQUIRE(v);
+
+  std::vector<std::int64_t> values{5, 6};
+  array_view view{std::span{values}};
+  runtime vm;
+  CHECK(vm.execute(*v, "f", {array_arg(view), 1}) == 6);
+  CHECK_FALSE(vm.execute(*v, "f", {array_arg(view), 2}));
+  CHECK_FALSE(vm.execute(*v, "f", {array_arg(view), -1}));
+  CHECK_FALSE(vm.execute(*v, "f", {0, 0}));
+}
+
+TEST_CASE("Lazily verified programs verify what they run", "[verifier]") {
+  auto p = compile_runtime(R"(
+    int leaf(int x) { return x + 1; }
+    int middle(int x) { return leaf(x) * 2; }
+    int unused(int x) { return x; }
+    int broken() { return 0; }
+  )");
+  REQUIRE(p);
+
+  // Corrupt `broken` so only calling it can fail: it now starts with a read from the empty pool
+  auto code = std::vector<std::byte>{p->code().begin(), p->code().end()};
+  auto broken = p->table()[*p->find("broken")];
+  code[broken.offset] = static_cast<std::byte>(op_code::i64_const_pool);
+  program patched{std::move(code), {p->table().begin(), p->table().end()},
+                  {p->functions().begin(), p->functions().end()}};
+
+  lazily_verified<program> lazy{std::move(patched)};
+  CHECK(lazy.verifier().verified_count() == 0);
+
+  runtime vm;
+  CHECK(vm.execute(lazy, "middle", {4}) == 10);
+  CHECK(lazy.verifier().verified_count() == 2);
+
+  CHECK_FALSE(vm.execute(lazy, "broken"));
+  CHECK_FALSE(vm.execute(lazy, "broken"));
+  CHECK(vm.execute(lazy, "leaf", {1}) == 2);
+  CHECK(lazy.verifier().verified_count() == 2);
+}
+
+TEST_CASE("Concurrent first calls verify once", "[verifier]") {
+  std::string source;
+  for (int i = 0; i < 64; ++i) {
+    source += "int f" + std::to_string(i) + "(int x) { return x + " + std::to_string(i) + "; }\n";
+  }
+  auto p = compile_runtime(source);
+  REQUIRE(p);
+  lazily_verified<program> lazy{std::move(*p)};
+
+  std::atomic<int> bad{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      runtime vm;
+      for (int i = 0; i < 64; ++i) {
+        if (vm.execute(lazy, "f" + std::to_string(i), {100}) != 100 + i) ++bad;
+      }
+    });
+  }
+  for (auto &t: threads) t.join();
+
+  CHECK(bad == 0);
+  CHECK(lazy.verifier().verified_count() == 64);
+}